@@ -0,0 +1,167 @@
+#include "AreaBuilder.h"
+#include <unordered_map>
+#include <unordered_set>
+#include <numeric>
+#include <bitset>
+#include <algorithm>
+#include <cmath>
+
+// Widest opening, in Doom units, that REJECT data alone can make a chokepoint
+#define PORTAL_MAX_WIDTH 256.0f
+
+// Share of the sectors seen from either side that must differ across an opening
+#define PORTAL_VISIBILITY_CHANGE 0.5f
+
+// Doors opened by using the linedef, which act on the sector behind it
+bool IsManualDoor(uint16_t special) {
+	switch (special) {
+		case 1: case 26: case 27: case 28: case 31: case 32: case 33: case 34: case 117: case 118:
+		return true;
+	}
+	return false;
+}
+
+// Doors acting on every sector with the linedef's tag
+bool IsTaggedDoor(uint16_t special) {
+	switch (special) {
+		case 2: case 3: case 4: case 16: case 29: case 42: case 46: case 50: case 61: case 63:
+		case 75: case 76: case 86: case 90: case 103: case 105: case 106: case 107: case 108: case 109:
+		case 110: case 111: case 112: case 113: case 114: case 115: case 116: case 133: case 134: case 135:
+		case 136: case 137:
+		return true;
+	}
+	return false;
+}
+
+// Two neighbouring sectors, and every linedef joining them
+struct Opening {
+	int32_t a;
+	int32_t b;
+	float width = 0;
+	bool chokepoint = false;
+};
+
+int32_t FindRoot(std::vector<int32_t>& parents, int32_t i) {
+	while (parents[i] != i) {
+		parents[i] = parents[parents[i]];
+		i = parents[i];
+	}
+	return i;
+}
+
+void BuildAreas(const WadLevel& level, LevelAreas& areas) {
+	int32_t sectorCount = level.sectors.Num();
+	areas.sectorAreas.assign(sectorCount, 0);
+	areas.areaCount = 0;
+	areas.portals.clear();
+	if (sectorCount == 0)
+		return;
+
+	// Find the door sectors
+	std::vector<bool> isDoor(sectorCount, false);
+	std::unordered_set<int16_t> doorTags;
+	for (int32_t i = 0; i < level.linedefs.Num(); i++) {
+		const LineDef& line = level.linedefs[i];
+		if (IsManualDoor(line.specialType) && line.sideBack != NO_SIDEDEF)
+			isDoor[level.sidedefs[line.sideBack].sector] = true;
+		else if (IsTaggedDoor(line.specialType) && line.sectorTag != 0)
+			doorTags.insert(static_cast<int16_t>(line.sectorTag));
+	}
+	for (int32_t i = 0; i < sectorCount; i++) {
+		const Sector& sector = level.sectors[i];
+		if (sector.ceilHeight <= sector.floorHeight || doorTags.count(sector.tagNumber) > 0)
+			isDoor[i] = true;
+	}
+
+	// Gather the openings between sectors
+	std::vector<Opening> openings;
+	std::unordered_map<uint64_t, size_t> openingIndex;
+	std::vector<int32_t> lineOpenings(level.linedefs.Num(), -1);
+	for (int32_t i = 0; i < level.linedefs.Num(); i++) {
+		const LineDef& line = level.linedefs[i];
+		if (line.sideFront == NO_SIDEDEF || line.sideBack == NO_SIDEDEF)
+			continue;
+		int32_t a = level.sidedefs[line.sideFront].sector;
+		int32_t b = level.sidedefs[line.sideBack].sector;
+		if (a == b)
+			continue;
+		if (a > b)
+			std::swap(a, b);
+
+		uint64_t key = static_cast<uint64_t>(a) << 32 | static_cast<uint32_t>(b);
+		auto found = openingIndex.emplace(key, openings.size());
+		if (found.second)
+			openings.push_back({a, b});
+		Opening& opening = openings[found.first->second];
+		lineOpenings[i] = static_cast<int32_t>(found.first->second);
+
+		const Vertex& v0 = level.vertices[line.vertexStart];
+		const Vertex& v1 = level.vertices[line.vertexEnd];
+		opening.width += sqrtf(static_cast<float>((v1.x - v0.x) * (v1.x - v0.x) + (v1.y - v0.y) * (v1.y - v0.y)));
+	}
+
+	// Sectors seen from each sector, as bitsets, if the REJECT table can tell
+	size_t words = (sectorCount + 63) / 64;
+	std::vector<uint64_t> visible;
+	if (!level.reject.empty()) {
+		visible.assign(words * sectorCount, 0);
+		for (int32_t from = 0; from < sectorCount; from++)
+			for (int32_t to = 0; to < sectorCount; to++)
+				if (!level.Rejected(from, to))
+					visible[from * words + to / 64] |= 1ull << (to % 64);
+	}
+
+	// Choose the chokepoints
+	for (Opening& opening : openings) {
+		if (isDoor[opening.a] || isDoor[opening.b]) {
+			opening.chokepoint = true;
+			continue;
+		}
+		if (visible.empty() || opening.width > PORTAL_MAX_WIDTH)
+			continue;
+
+		size_t shared = 0, either = 0;
+		const uint64_t* va = &visible[opening.a * words];
+		const uint64_t* vb = &visible[opening.b * words];
+		for (size_t w = 0; w < words; w++) {
+			shared += std::bitset<64>(va[w] & vb[w]).count();
+			either += std::bitset<64>(va[w] | vb[w]).count();
+		}
+		opening.chokepoint = either > 0 && 1.0f - static_cast<float>(shared) / either >= PORTAL_VISIBILITY_CHANGE;
+	}
+
+	// Join sectors across every other opening
+	std::vector<int32_t> parents(sectorCount);
+	std::iota(parents.begin(), parents.end(), 0);
+	for (const Opening& opening : openings) {
+		if (!opening.chokepoint)
+			parents[FindRoot(parents, opening.a)] = FindRoot(parents, opening.b);
+	}
+	for (Opening& opening : openings) {
+		if (opening.chokepoint && FindRoot(parents, opening.a) == FindRoot(parents, opening.b))
+			opening.chokepoint = false;
+	}
+
+	// Number the areas in sector order
+	std::vector<int32_t> rootAreas(sectorCount, -1);
+	for (int32_t i = 0; i < sectorCount; i++) {
+		int32_t& area = rootAreas[FindRoot(parents, i)];
+		if (area < 0)
+			area = areas.areaCount++;
+		areas.sectorAreas[i] = area;
+	}
+
+	// Place a portal across the opening of each linedef at a chokepoint. Doors shut
+	// at the start of the level are already sealed by their wall brushes.
+	for (int32_t i = 0; i < level.linedefs.Num(); i++) {
+		if (lineOpenings[i] < 0 || !openings[lineOpenings[i]].chokepoint)
+			continue;
+		const LineDef& line = level.linedefs[i];
+		const Sector& front = level.sectors[level.sidedefs[line.sideFront].sector];
+		const Sector& back = level.sectors[level.sidedefs[line.sideBack].sector];
+		float minHeight = std::max(front.floorHeight, back.floorHeight);
+		float maxHeight = std::min(front.ceilHeight, back.ceilHeight);
+		if (maxHeight > minHeight)
+			areas.portals.push_back({i, minHeight, maxHeight});
+	}
+}
@@ -0,0 +1,35 @@
+#pragma once
+#include <WadStructs.h>
+
+/*
+* Areas and Visportals
+*
+* Splits a level into areas the renderer can cull, separated by visportals. The
+* level is divided at chokepoints between pairs of neighbouring sectors:
+* - Every sector next to a door sector, found from the door specials acting on
+*   it, or from its ceiling being shut at the start of the level
+* - Narrow openings where the REJECT table shows that what can be seen changes
+*   sharply from one side to the other, such as a bend in a corridor
+*
+* Areas are the groups of sectors still connected once the chokepoints are cut.
+* A chokepoint that doesn't separate two areas, because the sectors are also
+* joined some other way, is dropped, since its portals would leak.
+*/
+
+// A visportal across the opening of a two-sided linedef
+struct Visportal {
+	int32_t line;
+	float minHeight;
+	float maxHeight;
+};
+
+struct LevelAreas {
+	std::vector<int32_t> sectorAreas; // The area each sector belongs to
+	int32_t areaCount = 0;
+	std::vector<Visportal> portals;   // In linedef order
+};
+
+void BuildAreas(const WadLevel& level, LevelAreas& areas);
+
+// Root of a union-find set, halving the path to it along the way
+int32_t FindRoot(std::vector<int32_t>& parents, int32_t i);
@@ -0,0 +1,148 @@
+#include "Batch.h"
+#include "Parallel.h"
+#include "Process.h"
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <unordered_set>
+#include <vector>
+
+struct BatchJob {
+	std::string line;
+	std::vector<std::string> args; // WAD, map, output directory, transforms
+	std::string id;
+
+	enum Status {
+		PENDING,
+		SKIPPED,
+		DONE,
+		FAILED,
+		TIMED_OUT
+	};
+	Status status = PENDING;
+	int exitCode = 0;
+	double seconds = 0.0;
+};
+
+// Identifies a job by its arguments, ignoring how the manifest line is spaced and quoted
+std::string JobId(const std::vector<std::string>& args) {
+	uint64_t hash = 14695981039346656037ULL;
+	for (const std::string& arg : args) {
+		for (char c : arg) {
+			hash ^= static_cast<unsigned char>(c);
+			hash *= 1099511628211ULL;
+		}
+		hash ^= 0x1F; // Separates "A" "BC" from "AB" "C"
+		hash *= 1099511628211ULL;
+	}
+
+	std::stringstream id;
+	id << std::hex << std::setw(16) << std::setfill('0') << hash;
+	return id.str();
+}
+
+// The path with a suffix, and the shard for sharded batches
+std::string ShardPath(const BatchSettings& settings, const char* suffix) {
+	std::string path = settings.manifest;
+	if (settings.shardCount > 1)
+		path += "." + std::to_string(settings.shard) + "of" + std::to_string(settings.shardCount);
+	return path + suffix;
+}
+
+bool RunBatch(const BatchSettings& settings, std::ostream& log) {
+	std::ifstream manifest(settings.manifest);
+	if (manifest.fail()) {
+		log << "ERROR READING MANIFEST " << settings.manifest << "\n";
+		return false;
+	}
+	std::string journalPath = settings.journal.empty() ? ShardPath(settings, ".journal") : settings.journal;
+	std::string summaryPath = settings.summary.empty() ? ShardPath(settings, ".summary.tsv") : settings.summary;
+
+	// Read this shard's jobs
+	std::vector<BatchJob> jobs;
+	std::string line;
+	for (int lineNumber = 1; std::getline(manifest, line); lineNumber++) {
+		if (!line.empty() && line.back() == '\r')
+			line.pop_back();
+		BatchJob job;
+		job.line = line;
+		job.args = SplitArguments(line);
+		if (job.args.empty() || job.args[0][0] == '#')
+			continue;
+		if (job.args.size() < 3) {
+			log << "ERROR: LINE " << lineNumber << " OF THE MANIFEST NEEDS A WAD, MAP AND OUTPUT DIRECTORY\n";
+			return false;
+		}
+
+		job.id = JobId(job.args);
+		if (std::stoull(job.id, nullptr, 16) % settings.shardCount == static_cast<uint64_t>(settings.shard))
+			jobs.push_back(job);
+	}
+
+	// Skip finished jobs
+	std::unordered_set<std::string> finished;
+	{
+		std::ifstream journal(journalPath);
+		while (std::getline(journal, line))
+			finished.insert(line.substr(0, line.find('\t')));
+	}
+	size_t remaining = 0;
+	for (BatchJob& job : jobs) {
+		if (finished.count(job.id) > 0)
+			job.status = BatchJob::SKIPPED;
+		else remaining++;
+	}
+	log << "Batch has " << jobs.size() << " jobs in this shard, " << jobs.size() - remaining << " already finished\n-----\n";
+
+	std::ofstream journal(journalPath, std::ios_base::app);
+	std::mutex journalLock;
+	ParallelFor(jobs.size(), settings.jobs, [&](size_t index, int) {
+		BatchJob& job = jobs[index];
+		if (job.status == BatchJob::SKIPPED)
+			return;
+
+		// A single level is written to a file in the output directory, several to the directory itself
+		const std::string& map = job.args[1];
+		std::filesystem::path outputDir(job.args[2]);
+		std::filesystem::path output = outputDir;
+		if (map != "ALL" && map.find_first_of("*?,") == std::string::npos)
+			output /= map + ".map";
+
+		std::vector<std::string> command = {settings.executable, "--jobs", "1", "--output", output.string(), job.args[0], map};
+		command.insert(command.end(), job.args.begin() + 3, job.args.end());
+
+		std::error_code error;
+		std::filesystem::create_directories(outputDir, error);
+		auto start = std::chrono::steady_clock::now();
+		job.exitCode = RunProcess(command, (outputDir / (job.id + ".log")).string(), settings.timeout);
+		job.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+		if (job.exitCode == 0)
+			job.status = BatchJob::DONE;
+		else if (job.exitCode == PROCESS_TIMED_OUT)
+			job.status = BatchJob::TIMED_OUT;
+		else job.status = BatchJob::FAILED;
+
+		std::lock_guard<std::mutex> guard(journalLock);
+		if (job.status == BatchJob::DONE)
+			journal << job.id << '\t' << job.seconds << '\t' << job.line << std::endl;
+		log << (job.status == BatchJob::DONE ? "Finished " : "FAILED ") << job.line << "\n";
+	});
+	journal.close();
+
+	// Summarize in manifest order
+	std::ofstream summary(summaryPath);
+	summary << "id\tstatus\texit code\tseconds\twad\tmap\toutput\n";
+	const char* statusNames[] = {"PENDING", "SKIPPED", "DONE", "FAILED", "TIMED OUT"};
+	size_t failures = 0;
+	for (const BatchJob& job : jobs) {
+		if (job.status == BatchJob::FAILED || job.status == BatchJob::TIMED_OUT)
+			failures++;
+		summary << job.id << '\t' << statusNames[job.status] << '\t' << job.exitCode << '\t' << job.seconds << '\t'
+			<< job.args[0] << '\t' << job.args[1] << '\t' << job.args[2] << '\n';
+	}
+	log << "-----\n" << remaining - failures << " jobs finished, " << failures << " failed. Summary written to " << summaryPath << "\n";
+	return failures == 0;
+}
@@ -0,0 +1,40 @@
+#pragma once
+#include <iostream>
+#include <string>
+
+/*
+* Batch mode - converts every job listed in a manifest file, one job per line:
+*
+*    [WAD] [Map] [Output Directory] [XY Downscale] [Z Downscale] [X Shift] [Y Shift]
+*
+* [Map] accepts the same lists, wildcards and ALL as the command line. Arguments
+* containing spaces may be "quoted". Blank lines and lines starting with # are ignored.
+*
+* Each job is converted by a separate run of this program, so a bad WAD can only
+* fail its own job. A job taking longer than the timeout is killed. Its output is
+* logged to [Output Directory]/[Job ID].log.
+*
+* Finished jobs are recorded in a journal as they complete. Running the same
+* manifest again skips every job in the journal, so an interrupted batch resumes
+* where it left off, and only failed jobs are retried.
+*
+* Jobs are split between shards by a hash of their arguments, so several processes
+* given the same manifest and "--shard i/N" never convert the same job, and a job
+* stays on the same shard when other lines of the manifest change.
+*
+* The summary lists every job of the shard with its status and time taken, as
+* tab-separated values.
+*/
+struct BatchSettings {
+	std::string manifest;
+	std::string journal;    // Defaults to [manifest].journal, or [manifest].[i]of[N].journal when sharded
+	std::string summary;    // Defaults to [manifest].summary.tsv, or [manifest].[i]of[N].summary.tsv when sharded
+	std::string executable; // Program run for each job - normally this one
+	int shard = 0;
+	int shardCount = 1;
+	int jobs = 1;           // Jobs converted at once
+	double timeout = 0.0;   // Seconds allowed for each job, or 0 for no limit
+};
+
+// Returns false if any job failed
+bool RunBatch(const BatchSettings& settings, std::ostream& log);
@@ -1 +1,48 @@
 #include "BrushBuilder.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define PLANEBATCH_SSE
+#endif
+
+/*
+* The vector path uses full precision square roots and divides rather than
+* an rsqrt estimate, so every lane is bit-identical to the scalar
+* Vector::Normalize. An estimate would write axis-aligned normals
+* as 0.99999994 instead of 1.
+*/
+void PlaneBatch::Compute() {
+	size_t count = dx.size();
+	nx.resize(count);
+	ny.resize(count);
+	lengths.resize(count);
+
+	size_t i = 0;
+	#ifdef PLANEBATCH_SSE
+	const __m128 zero = _mm_setzero_ps();
+	for (; i + 4 <= count; i += 4) {
+		__m128 x = _mm_loadu_ps(dy.data() + i);
+		__m128 y = _mm_sub_ps(zero, _mm_loadu_ps(dx.data() + i));
+		__m128 magnitude = _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y)));
+
+		// Zero-length edges are left unnormalized, like Vector::Normalize
+		__m128 valid = _mm_cmpneq_ps(magnitude, zero);
+		__m128 normX = _mm_div_ps(x, magnitude);
+		__m128 normY = _mm_div_ps(y, magnitude);
+		normX = _mm_or_ps(_mm_and_ps(valid, normX), _mm_andnot_ps(valid, x));
+		normY = _mm_or_ps(_mm_and_ps(valid, normY), _mm_andnot_ps(valid, y));
+
+		_mm_storeu_ps(nx.data() + i, normX);
+		_mm_storeu_ps(ny.data() + i, normY);
+		_mm_storeu_ps(lengths.data() + i, magnitude);
+	}
+	#endif
+
+	for (; i < count; i++) {
+		Vector n(dy[i], -dx[i], 0);
+		lengths[i] = n.Magnitude();
+		n.Normalize();
+		nx[i] = n.x;
+		ny[i] = n.y;
+	}
+}
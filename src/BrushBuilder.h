@@ -1,4 +1,6 @@
+#pragma once
 #include <WadStructs.h>
+#include <cmath>
 
 struct Vector {
 	float x, y, z;
@@ -32,4 +34,236 @@ struct Plane {
 		n.Normalize();
 		d = n.x * point.x + n.y * point.y;
 	}
-};
\ No newline at end of file
+};
+
+/*
+* Texture Mapping
+*
+* A brushDef3 surface maps each point on it to texture coordinates through a
+* 2x3 matrix, applied to the point's position along the two texture axes of the
+* surface's plane. Coordinates are in units of the texture's size.
+*/
+struct TextureMatrix {
+	float s[3]; // Horizontal coordinate: scale along each axis, then the shift
+	float t[3]; // Vertical coordinate
+
+	// Texture coordinates of a point, given the texture axes of its plane
+	void Apply(const Vector& point, const Vector& axisS, const Vector& axisT, float& u, float& v) const {
+		float ps = point.x * axisS.x + point.y * axisS.y + point.z * axisS.z;
+		float pt = point.x * axisT.x + point.y * axisT.y + point.z * axisT.z;
+		u = s[0] * ps + s[1] * pt + s[2];
+		v = t[0] * ps + t[1] * pt + t[2];
+	}
+};
+
+// The texture axes the engine derives from a plane's normal
+inline void TextureAxes(const Vector& normal, Vector& axisS, Vector& axisT) {
+	Vector n(fabsf(normal.x) < 1e-6f ? 0.0f : normal.x, fabsf(normal.y) < 1e-6f ? 0.0f : normal.y, fabsf(normal.z) < 1e-6f ? 0.0f : normal.z);
+	float rotY = -atan2f(n.z, sqrtf(n.x * n.x + n.y * n.y));
+	float rotZ = atan2f(n.y, n.x);
+	axisS = Vector(-sinf(rotZ), cosf(rotZ), 0);
+	axisT = Vector(-sinf(rotY) * cosf(rotZ), -sinf(rotY) * sinf(rotZ), -cosf(rotY));
+}
+
+// Computes the texture matrices of a level's walls and flats
+class TextureMapper {
+	private:
+	VertexTransforms tforms;
+	const std::unordered_map<WadString, DimFloat>& wallRatios;
+
+	const float flatScale;
+	const float flatXShift;
+	const float flatYShift;
+
+	public:
+	TextureMapper(const WadLevel& level) : tforms(level.transforms), wallRatios(level.metersPerPixel),
+		flatScale(0.015625f * tforms.xyDownscale), //Flats are always 64x64, allowing us to use 1 / 64 as a constant
+		flatXShift(-0.015625f * tforms.xShift),    // Full formula is xShift / xyDownscale * xyDownscale * 0.015625f * -1
+		flatYShift(0.015625f * tforms.yShift)      // Sign is flipped for right/left shift, but not for up/down shift
+	{
+	}
+
+	TextureMatrix Wall(VertexFloat v0, VertexFloat v1, float length, float drawHeight, WadString texture, float offsetX) const {
+		Vector horizontal(v0, v1);
+
+		// Shared between threads, so missing textures must not be inserted
+		DimFloat ratios;
+		auto found = wallRatios.find(texture);
+		if (found != wallRatios.end())
+			ratios = found->second;
+		float xScale = ratios.width * tforms.xyDownscale;
+		float yScale = ratios.height * tforms.zDownscale;
+
+		/*
+		* We must shift the texture grid such that the origin is centered on
+		* the wall's left vertex. To do this accurately, we calculate the magnitude
+		* of the projection of the shift vector onto the horizontal wall vector.
+		* We finalize this by adding the texture X offset to this value.
+		* The math works out such that the XY downscale cancels in both terms when
+		* the texture's X scale is multiplied in at the end.
+		*/
+		float projection = ((horizontal.x * v0.x + horizontal.y * v0.y) / length - offsetX) * xScale * -1;
+
+		return {{xScale, 0, projection}, {0, yScale, drawHeight * yScale}};
+	}
+
+	// horizontal: (0, -1) Vertical (1, 0) - Ensures proper rotation of textures (for floors)
+	TextureMatrix Flat(bool isCeiling) const {
+		return {{0, isCeiling ? -flatScale : flatScale, flatXShift}, {-flatScale, 0, flatYShift}};
+	}
+};
+
+/*
+* Batched plane construction
+*
+* Brush generation records the 2D edge of every wall and floor triangle side
+* up front, then computes all of their normals in a single vectorized pass
+* before any brushes are written. Each edge's plane normal is the edge vector
+* rotated clockwise: (y, -x), normalized.
+*/
+class PlaneBatch {
+	private:
+	// Input - edge vectors
+	std::vector<float> dx;
+	std::vector<float> dy;
+
+	// Output - normalized edge normals and edge lengths
+	std::vector<float> nx;
+	std::vector<float> ny;
+	std::vector<float> lengths;
+
+	public:
+	void Reserve(size_t count) {
+		dx.reserve(count);
+		dy.reserve(count);
+	}
+
+	void Clear() {
+		dx.clear();
+		dy.clear();
+	}
+
+	size_t AddEdge(VertexFloat v0, VertexFloat v1) {
+		dx.push_back(v1.x - v0.x);
+		dy.push_back(v1.y - v0.y);
+		return dx.size() - 1;
+	}
+
+	size_t Num() const {
+		return dx.size();
+	}
+
+	// Normalizes every recorded edge
+	void Compute();
+
+	// Plane through the given point, using the edge's normal
+	Plane GetPlane(size_t edge, VertexFloat point) const {
+		Plane p;
+		p.n = Vector(nx[edge], ny[edge], 0);
+		p.d = p.n.x * point.x + p.n.y * point.y;
+		return p;
+	}
+
+	float Length(size_t edge) const {
+		return lengths[edge];
+	}
+};
+
+/*
+* Brush Handles
+*
+* Handles are derived from the source entity a brush is generated from, rather
+* than the order brushes are emitted in, so conversions are byte-stable and
+* diffable across runs. Every linedef owns a block of BRUSHSLOT_COUNT handles:
+* - The six wall brushes that can be generated from its sidedefs
+* - A floor and ceiling triangle for each side. A sector's earcut yields at most
+*   one triangle per linedef bordering it, so triangle t of a sector is assigned
+*   to the t-th linedef side bordering that sector.
+*
+* Each level gets its own band of handles, selected by a hash of its name.
+*/
+enum BrushSlot : uint32_t {
+	BRUSHSLOT_FRONT_LOWER,
+	BRUSHSLOT_FRONT_MIDDLE,
+	BRUSHSLOT_FRONT_UPPER,
+	BRUSHSLOT_BACK_LOWER,
+	BRUSHSLOT_BACK_MIDDLE,
+	BRUSHSLOT_BACK_UPPER,
+	BRUSHSLOT_FRONT_FLOOR,
+	BRUSHSLOT_FRONT_CEILING,
+	BRUSHSLOT_BACK_FLOOR,
+	BRUSHSLOT_BACK_CEILING,
+	BRUSHSLOT_COUNT
+};
+
+#define HANDLE_MINIMUM 100000000
+#define HANDLE_LEVEL_BAND 1000000 // Fits 100,000 linedefs per level
+#define HANDLE_LEVEL_BANDS 1000
+
+inline uint32_t LevelHandleBase(WadString levelName) {
+	// FNV-1a
+	uint32_t hash = 2166136261u;
+	for (const char* c = levelName.Data(); *c != '\0'; c++) {
+		hash ^= static_cast<unsigned char>(*c);
+		hash *= 16777619u;
+	}
+	return HANDLE_MINIMUM + (hash % HANDLE_LEVEL_BANDS) * HANDLE_LEVEL_BAND;
+}
+
+inline uint32_t BrushHandle(uint32_t levelBase, int32_t lineIndex, BrushSlot slot) {
+	return levelBase + static_cast<uint32_t>(lineIndex) * BRUSHSLOT_COUNT + slot;
+}
+
+/*
+* Brushes that aren't drawn, such as visportals, take their handles from a second
+* band for each level, above every level's first band, with the same number of
+* slots per linedef. The handles of drawn brushes never change as more kinds of
+* brushes are added, and every handle still fits in a signed 32-bit integer.
+* Player clip pieces are assigned to linedef sides the same way floor triangles
+* are, and each run of clipped walls to its lowest-numbered linedef.
+*/
+enum ExtraSlot : uint32_t {
+	EXTRASLOT_PORTAL,
+	EXTRASLOT_CLIP_WALL,
+	EXTRASLOT_CLIP_FRONT_FLOOR,
+	EXTRASLOT_CLIP_FRONT_CEILING,
+	EXTRASLOT_CLIP_BACK_FLOOR,
+	EXTRASLOT_CLIP_BACK_CEILING,
+	EXTRASLOT_COUNT = BRUSHSLOT_COUNT
+};
+
+inline uint32_t ExtraHandle(uint32_t levelBase, int32_t lineIndex, ExtraSlot slot) {
+	uint32_t extraBase = levelBase + HANDLE_LEVEL_BAND * HANDLE_LEVEL_BANDS;
+	return extraBase + static_cast<uint32_t>(lineIndex) * EXTRASLOT_COUNT + slot;
+}
+
+// True if the handle belongs to one of the level's bands
+inline bool IsLevelHandle(uint32_t handle, uint32_t levelBase) {
+	uint32_t extraBase = levelBase + HANDLE_LEVEL_BAND * HANDLE_LEVEL_BANDS;
+	return (handle >= levelBase && handle - levelBase < HANDLE_LEVEL_BAND)
+		|| (handle >= extraBase && handle - extraBase < HANDLE_LEVEL_BAND);
+}
+
+// A wall brush waiting on its PlaneBatch edge to be computed
+struct WallBrush {
+	VertexFloat v0;
+	VertexFloat v1;
+	float minHeight;
+	float maxHeight;
+	float drawHeight;
+	float offsetX;
+	WadString texture;
+	uint32_t handle;
+	size_t edge;
+};
+
+// A floor/ceiling triangle waiting on its PlaneBatch edges to be computed
+// Its three edges are stored consecutively, starting at firstEdge
+struct FloorTriangle {
+	VertexFloat a;
+	VertexFloat b;
+	VertexFloat c;
+	int32_t sector;
+	uint32_t floorHandle; // The ceiling brush uses the following handle
+	size_t firstEdge;
+};
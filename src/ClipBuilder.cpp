@@ -0,0 +1,257 @@
+#include "ClipBuilder.h"
+#include "LevelBuilder.h"
+#include "Parallel.h"
+#include <earcut.hpp>
+#include <array>
+#include <unordered_map>
+#include <algorithm>
+
+// Thickness, in Doom units, of the slabs behind walls and of the volumes past the level's heights
+#define CLIP_THICKNESS 16.0f
+
+// Player width, in Doom units. Wall runs and floor pieces narrower than this are dropped.
+#define CLIP_MIN_WIDTH 32
+
+// Sector corners are kept in the WAD's integer units, so convexity tests are exact
+struct ClipPoint {
+	int64_t x;
+	int64_t y;
+
+	ClipPoint(uint32_t key) : x(static_cast<int16_t>(key >> 16)), y(static_cast<int16_t>(key & 0xFFFF)) {}
+};
+
+// Positive if a -> b -> c turns counter-clockwise, zero if they're collinear
+inline int64_t Turn(const ClipPoint& a, const ClipPoint& b, const ClipPoint& c) {
+	return (b.x - a.x) * (c.y - b.y) - (b.y - a.y) * (c.x - b.x);
+}
+
+// Heights and transforms shared by every brush of the hull
+struct ClipFrame {
+	VertexTransforms tforms;
+	uint32_t handleBase;
+	float bottom;    // Below the lowest floor
+	float top;       // Above the highest ceiling
+	float thickness; // Of the wall slabs, in map units
+
+	VertexFloat Transform(const ClipPoint& p) const {
+		return VertexFloat((p.x + tforms.xShift) / tforms.xyDownscale, (p.y + tforms.yShift) / tforms.xyDownscale);
+	}
+};
+
+// A slab behind the wall from p to q, on its left, where the linedef's back would be
+void AddWallSlab(const ClipFrame& frame, int32_t lineIndex, const ClipPoint& p, const ClipPoint& q, std::vector<ClipBrush>& brushes) {
+	int64_t dx = q.x - p.x, dy = q.y - p.y;
+	if (dx * dx + dy * dy < CLIP_MIN_WIDTH * CLIP_MIN_WIDTH)
+		return;
+
+	VertexFloat v0 = frame.Transform(p);
+	VertexFloat v1 = frame.Transform(q);
+	Vector left(static_cast<float>(-dy), static_cast<float>(dx), 0);
+	left.Normalize();
+	float ox = left.x * frame.thickness, oy = left.y * frame.thickness;
+
+	ClipBrush brush;
+	brush.handle = ExtraHandle(frame.handleBase, lineIndex, EXTRASLOT_CLIP_WALL);
+	brush.points = {v0, v1, VertexFloat(v1.x + ox, v1.y + oy), VertexFloat(v0.x + ox, v0.y + oy)};
+	brush.minHeight = frame.bottom;
+	brush.maxHeight = frame.top;
+	brushes.push_back(brush);
+}
+
+/*
+* Merges neighbouring triangles into convex polygons (Hertel-Mehlhorn): any
+* diagonal shared by two pieces is removed if the union is still convex. This
+* yields at most four times the minimum number of convex pieces.
+*/
+void MergeConvex(const std::vector<ClipPoint>& points, std::vector<std::vector<int32_t>>& pieces) {
+	// The piece on the left of each directed edge
+	std::unordered_map<uint64_t, size_t> edgeOwners;
+	auto edgeKey = [](int32_t a, int32_t b) {
+		return static_cast<uint64_t>(static_cast<uint32_t>(a)) << 32 | static_cast<uint32_t>(b);
+	};
+	for (size_t p = 0; p < pieces.size(); p++)
+		for (size_t i = 0; i < pieces[p].size(); i++)
+			edgeOwners[edgeKey(pieces[p][i], pieces[p][(i + 1) % pieces[p].size()])] = p;
+
+	std::vector<int32_t> merged;
+	bool changed = true;
+	while (changed) {
+		changed = false;
+		for (size_t p = 0; p < pieces.size(); p++) {
+			for (size_t i = 0; i < pieces[p].size(); i++) {
+				std::vector<int32_t>& a = pieces[p];
+				int32_t from = a[i], to = a[(i + 1) % a.size()];
+				auto found = edgeOwners.find(edgeKey(to, from));
+				if (found == edgeOwners.end() || found->second == p || pieces[found->second].empty())
+					continue;
+				std::vector<int32_t>& b = pieces[found->second];
+
+				// Around a from the diagonal's end to its start, then around b back to the end
+				merged.clear();
+				for (size_t k = 1; k <= a.size(); k++)
+					merged.push_back(a[(i + k) % a.size()]);
+				size_t j = 0;
+				while (b[j] != to || b[(j + 1) % b.size()] != from)
+					j++;
+				for (size_t k = 2; k < b.size(); k++)
+					merged.push_back(b[(j + k) % b.size()]);
+
+				bool convex = true;
+				for (size_t k = 0; k < merged.size() && convex; k++) {
+					const ClipPoint& prev = points[merged[(k + merged.size() - 1) % merged.size()]];
+					convex = Turn(prev, points[merged[k]], points[merged[(k + 1) % merged.size()]]) >= 0;
+				}
+				if (!convex)
+					continue;
+
+				b.clear();
+				a.swap(merged);
+				for (size_t k = 0; k < a.size(); k++)
+					edgeOwners[edgeKey(a[k], a[(k + 1) % a.size()])] = p;
+				changed = true;
+				i = static_cast<size_t>(-1); // Restart on the merged piece's edges
+			}
+		}
+	}
+}
+
+void BuildSectorClip(const WadLevel& level, int32_t sectorIndex, const SectorLoop& loop, const ClipFrame& frame, std::vector<ClipBrush>& brushes) {
+	const Sector& sector = level.sectors[sectorIndex];
+	auto isOneSided = [&](const SimpleLineDef& s) {
+		return level.linedefs[s.lineIndex].sideBack == NO_SIDEDEF;
+	};
+
+	// Without a loop to follow, only the walls can be clipped, one linedef at a time
+	if (!loop.complete) {
+		for (const SimpleLineDef& s : sector.lines)
+			if (isOneSided(s))
+				AddWallSlab(frame, s.lineIndex, ClipPoint(s.key0), ClipPoint(s.key1), brushes);
+		return;
+	}
+
+	std::vector<ClipPoint> points;
+	points.reserve(loop.edges.size());
+	for (const SectorLoop::Edge& e : loop.edges) {
+		const SimpleLineDef& s = sector.lines[e.line];
+		points.push_back(ClipPoint(e.reversed ? s.key1 : s.key0));
+	}
+	size_t count = points.size();
+
+	// STEP 1: WALL SLABS
+	// Consecutive one-sided edges are joined while they run in a straight line
+	{
+		auto joins = [&](size_t i) {
+			const SectorLoop::Edge& prev = loop.edges[(i + count - 1) % count];
+			const SectorLoop::Edge& current = loop.edges[i];
+			if (!isOneSided(sector.lines[prev.line]) || !isOneSided(sector.lines[current.line]))
+				return false;
+			const ClipPoint& a = points[(i + count - 1) % count];
+			const ClipPoint& b = points[i];
+			const ClipPoint& c = points[(i + 1) % count];
+			return Turn(a, b, c) == 0 && (b.x - a.x) * (c.x - b.x) + (b.y - a.y) * (c.y - b.y) > 0;
+		};
+
+		size_t start = 0;
+		while (start < count && joins(start))
+			start++;
+		if (start == count)
+			start = 0;
+
+		for (size_t k = 0; k < count; ) {
+			size_t first = (start + k) % count;
+			const SectorLoop::Edge& edge = loop.edges[first];
+			if (!isOneSided(sector.lines[edge.line])) {
+				k++;
+				continue;
+			}
+
+			int32_t lineIndex = sector.lines[edge.line].lineIndex;
+			size_t end = k + 1;
+			for (; end < count && joins((start + end) % count); end++)
+				lineIndex = std::min(lineIndex, sector.lines[loop.edges[(start + end) % count].line].lineIndex);
+
+			// Linedefs have the sector on their right, so the slab goes on the linedef's left
+			const ClipPoint& p = points[first];
+			const ClipPoint& q = points[(start + end) % count];
+			if (edge.reversed)
+				AddWallSlab(frame, lineIndex, q, p, brushes);
+			else AddWallSlab(frame, lineIndex, p, q, brushes);
+			k = end;
+		}
+	}
+
+	// STEP 2: FLOOR AND CEILING VOLUMES
+	typedef std::array<float, 2> Point;
+	std::vector<std::vector<Point>> polylines(1);
+	for (const ClipPoint& p : points)
+		polylines[0].push_back({static_cast<float>(p.x), static_cast<float>(p.y)});
+	std::vector<int32_t> indices = mapbox::earcut<int32_t>(polylines);
+
+	std::vector<std::vector<int32_t>> pieces;
+	for (size_t i = 0; i + 2 < indices.size(); i += 3) {
+		int64_t turn = Turn(points[indices[i]], points[indices[i + 1]], points[indices[i + 2]]);
+		if (turn > 0)
+			pieces.push_back({indices[i], indices[i + 1], indices[i + 2]});
+		else if (turn < 0)
+			pieces.push_back({indices[i], indices[i + 2], indices[i + 1]});
+	}
+	MergeConvex(points, pieces);
+
+	// Like floor triangles, piece t is assigned to the t-th linedef side bordering the sector
+	size_t owner = 0;
+	for (std::vector<int32_t>& piece : pieces) {
+		if (piece.empty())
+			continue;
+
+		// Collinear corners would give the brush duplicate planes
+		std::vector<VertexFloat> corners;
+		int64_t minX = INT64_MAX, minY = INT64_MAX, maxX = INT64_MIN, maxY = INT64_MIN;
+		for (size_t k = 0; k < piece.size(); k++) {
+			const ClipPoint& prev = points[piece[(k + piece.size() - 1) % piece.size()]];
+			const ClipPoint& p = points[piece[k]];
+			if (Turn(prev, p, points[piece[(k + 1) % piece.size()]]) == 0)
+				continue;
+			corners.push_back(frame.Transform(p));
+			minX = std::min(minX, p.x);
+			minY = std::min(minY, p.y);
+			maxX = std::max(maxX, p.x);
+			maxY = std::max(maxY, p.y);
+		}
+		if (corners.size() < 3 || (maxX - minX < CLIP_MIN_WIDTH && maxY - minY < CLIP_MIN_WIDTH))
+			continue;
+
+		const SimpleLineDef& s = sector.lines[owner++];
+		ClipBrush brush;
+		brush.handle = ExtraHandle(frame.handleBase, s.lineIndex, s.isBack ? EXTRASLOT_CLIP_BACK_FLOOR : EXTRASLOT_CLIP_FRONT_FLOOR);
+		brush.points = corners;
+		brush.minHeight = frame.bottom;
+		brush.maxHeight = sector.floorHeight;
+		brushes.push_back(brush);
+
+		brush.handle = ExtraHandle(frame.handleBase, s.lineIndex, s.isBack ? EXTRASLOT_CLIP_BACK_CEILING : EXTRASLOT_CLIP_FRONT_CEILING);
+		brush.points.swap(corners);
+		brush.minHeight = sector.ceilHeight;
+		brush.maxHeight = frame.top;
+		brushes.push_back(brush);
+	}
+}
+
+void BuildClipHull(const WadLevel& level, SectorLoopCache& loops, int jobs, std::vector<ClipBrush>& brushes) {
+	ClipFrame frame;
+	frame.tforms = level.transforms;
+	frame.handleBase = LevelHandleBase(level.lumpHeader->name);
+	frame.bottom = level.minHeight - CLIP_THICKNESS / frame.tforms.zDownscale;
+	frame.top = level.maxHeight + CLIP_THICKNESS / frame.tforms.zDownscale;
+	frame.thickness = CLIP_THICKNESS / frame.tforms.xyDownscale;
+
+	std::vector<std::vector<ClipBrush>> sectorBrushes(level.sectors.Num());
+	ParallelForChecked(sectorBrushes.size(), jobs, [&](size_t i, int) {
+		int32_t sectorIndex = static_cast<int32_t>(i);
+		const SectorLoop& loop = loops.Get(sectorIndex, level.sectors[sectorIndex]);
+		BuildSectorClip(level, sectorIndex, loop, frame, sectorBrushes[i]);
+	});
+
+	brushes.clear();
+	for (std::vector<ClipBrush>& list : sectorBrushes)
+		brushes.insert(brushes.end(), list.begin(), list.end());
+}
@@ -0,0 +1,30 @@
+#pragma once
+#include "BrushBuilder.h"
+
+class SectorLoopCache;
+
+/*
+* Player Clip Hull
+*
+* A coarse stand-in for the level's collision, so movement is tested against a
+* few large volumes rather than every textured brush:
+* - Below each sector's floor and above its ceiling, the sector's shape split
+*   into as few convex pieces as possible. The volumes reach past the lowest
+*   floor and highest ceiling of the level, so steps and ledges between
+*   neighbouring sectors are solid too.
+* - Behind each run of collinear one-sided linedefs, a single slab.
+*
+* Wall runs shorter than a player can fit through are dropped, as are sectors
+* whose linedefs don't form a single loop.
+*/
+
+// A vertical prism over a convex polygon
+struct ClipBrush {
+	uint32_t handle;
+	std::vector<VertexFloat> points; // Counter-clockwise
+	float minHeight;
+	float maxHeight;
+};
+
+// Every sector's lines must already be gathered. Brushes are returned in sector order.
+void BuildClipHull(const WadLevel& level, SectorLoopCache& loops, int jobs, std::vector<ClipBrush>& brushes);
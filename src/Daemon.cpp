@@ -0,0 +1,233 @@
+#include "Daemon.h"
+#include "LevelBuilder.h"
+#include "Parallel.h"
+#include "Process.h"
+#include <chrono>
+#include <filesystem>
+#include <list>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+
+// Requests waiting for a free worker, per worker
+#define QUEUED_REQUESTS_PER_JOB 4
+
+// A loaded WAD and everything derived from it that doesn't depend on transforms
+struct CachedWad {
+	Wad wad;
+	bool loaded = false;
+	std::once_flag loadOnce;
+
+	std::mutex levelLock;
+	std::unordered_map<int32_t, std::unique_ptr<SectorLoopCache>> loops;
+
+	SectorLoopCache* Loops(int32_t levelIndex, int32_t sectorCount) {
+		std::lock_guard<std::mutex> guard(levelLock);
+		std::unique_ptr<SectorLoopCache>& cache = loops[levelIndex];
+		if (cache == nullptr)
+			cache.reset(new SectorLoopCache(sectorCount));
+		return cache.get();
+	}
+};
+
+/*
+* Least recently used cache of loaded WADs. Entries are shared, so a WAD dropped
+* from the cache stays alive until the requests using it have finished.
+*/
+class WadCache {
+	private:
+	typedef std::pair<std::string, std::shared_ptr<CachedWad>> Entry;
+
+	size_t capacity;
+	std::mutex lock;
+	std::list<Entry> entries; // Most recently used first
+
+	public:
+	WadCache(size_t p_capacity) : capacity(p_capacity < 1 ? 1 : p_capacity) {}
+
+	std::shared_ptr<CachedWad> Get(const std::string& path, const EventSink& events) {
+		std::error_code error;
+		std::filesystem::path canonical = std::filesystem::canonical(path, error);
+		if (error) {
+			events.Reportf(EVENT_ERROR, "Cannot find %s", path.data());
+			return nullptr;
+		}
+		std::stringstream key;
+		key << canonical.string() << '|' << std::filesystem::file_size(canonical, error) << '|'
+			<< std::filesystem::last_write_time(canonical, error).time_since_epoch().count();
+
+		std::shared_ptr<CachedWad> cached;
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			for (auto i = entries.begin(); i != entries.end(); ++i) {
+				if (i->first == key.str()) {
+					entries.splice(entries.begin(), entries, i);
+					cached = i->second;
+					break;
+				}
+			}
+			if (cached == nullptr) {
+				cached = std::make_shared<CachedWad>();
+				entries.emplace_front(key.str(), cached);
+				if (entries.size() > capacity)
+					entries.pop_back();
+			}
+		}
+
+		// Requests for a WAD that's still loading wait for it here, outside the cache lock
+		std::call_once(cached->loadOnce, [&] {
+			try {
+				cached->loaded = cached->wad.ReadFrom(canonical.string().data(), events);
+			}
+			catch (const std::exception&) {
+				events.Reportf(EVENT_ERROR, "%s is truncated or malformed", path.data());
+			}
+		});
+		if (!cached->loaded) {
+			std::lock_guard<std::mutex> guard(lock);
+			entries.remove_if([&](const Entry& e) { return e.second == cached; });
+			return nullptr;
+		}
+		return cached;
+	}
+};
+
+class Daemon {
+	private:
+	std::ostream& output;
+	std::mutex outputLock;
+	WadCache cache;
+
+	// Routes a request's warnings and errors to its response lines
+	struct RequestEvents {
+		Daemon* daemon;
+		const std::string* id;
+	};
+
+	static void OnEvent(const Event& e, void* userData) {
+		RequestEvents* request = static_cast<RequestEvents*>(userData);
+		if (e.type == EVENT_WARNING)
+			request->daemon->Respond(*request->id, "WARNING", e.message);
+		else if (e.type == EVENT_ERROR)
+			request->daemon->Respond(*request->id, "ERROR", e.message);
+	}
+
+	void Respond(const std::string& id, const char* status, const std::string& message) {
+		std::lock_guard<std::mutex> guard(outputLock);
+		output << id << ' ' << status << ' ' << message << std::endl;
+	}
+
+	bool Convert(const std::vector<std::string>& args, const EventSink& events) {
+		if (args.size() < 5) {
+			events.Report(EVENT_ERROR, "Usage: convert [id] [WAD] [Map] [Output] [XY Downscale] [Z Downscale] [X Shift] [Y Shift]");
+			return false;
+		}
+
+		std::shared_ptr<CachedWad> cached = cache.Get(args[2], events);
+		if (cached == nullptr)
+			return false;
+
+		std::vector<int32_t> indices = cached->wad.FindLevels(args[3].data());
+		if (indices.size() != 1) {
+			events.Reportf(EVENT_ERROR, "%s must name a single level", args[3].data());
+			return false;
+		}
+
+		VertexTransforms transforms;
+		if(args.size() > 5) transforms.xyDownscale = atof(args[5].data());
+		if(args.size() > 6) transforms.zDownscale = atof(args[6].data());
+		if(args.size() > 7) transforms.xShift = atof(args[7].data());
+		if(args.size() > 8) transforms.yShift = atof(args[8].data());
+
+		std::unique_ptr<WadLevel> level = cached->wad.DecodeLevel(indices[0], transforms, events);
+		if (level == nullptr)
+			return false;
+		BuildSettings settings;
+		settings.events = events;
+		settings.loopCache = cached->Loops(indices[0], level->sectors.Num());
+
+		AsyncFileSink sink;
+		if (!sink.Open(args[4])) {
+			events.Reportf(EVENT_ERROR, "Cannot create output file %s", args[4].data());
+			return false;
+		}
+		BuildLevel(*level, sink, settings);
+		if (sink.Failed()) {
+			events.Reportf(EVENT_ERROR, "Failed to write output file %s", args[4].data());
+			return false;
+		}
+		return true;
+	}
+
+	bool Export(const std::vector<std::string>& args, const EventSink& events) {
+		if (args.size() < 4) {
+			events.Report(EVENT_ERROR, "Usage: export [id] [WAD] [Output Directory]");
+			return false;
+		}
+
+		std::shared_ptr<CachedWad> cached = cache.Get(args[2], events);
+		if (cached == nullptr)
+			return false;
+
+		DiskAssetWriter assets(args[3]);
+		cached->wad.ExportTextures(true, true, true, assets, events);
+		return true;
+	}
+
+	public:
+	Daemon(std::ostream& p_output, size_t cacheSize) : output(p_output), cache(cacheSize) {}
+
+	void Serve(const std::string& line) {
+		std::vector<std::string> args = SplitArguments(line);
+		if (args.empty())
+			return;
+		std::string id = args.size() > 1 ? args[1] : "-";
+		RequestEvents request = {this, &id};
+		EventSink events(OnEvent, &request);
+
+		auto start = std::chrono::steady_clock::now();
+		bool success = false;
+		try {
+			if (args[0] == "convert")
+				success = Convert(args, events);
+			else if (args[0] == "export")
+				success = Export(args, events);
+			else events.Reportf(EVENT_ERROR, "Unknown request %s", args[0].data());
+		}
+		catch (const std::exception&) {
+			events.Report(EVENT_ERROR, "WAD data is truncated or malformed");
+		}
+
+		auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+		Respond(id, success ? "OK" : "FAILED", std::to_string(elapsed.count()));
+	}
+};
+
+void RunDaemon(std::istream& input, std::ostream& output, const DaemonSettings& settings) {
+	int jobs = settings.jobs < 1 ? 1 : settings.jobs;
+	Daemon daemon(output, settings.cacheSize);
+	BoundedQueue<std::string> requests(QUEUED_REQUESTS_PER_JOB * jobs);
+
+	std::vector<std::thread> workers;
+	for (int i = 0; i < jobs; i++) {
+		workers.emplace_back([&] {
+			std::string line;
+			while (requests.Pop(line))
+				daemon.Serve(line);
+		});
+	}
+
+	std::string line;
+	while (std::getline(input, line)) {
+		if (!line.empty() && line.back() == '\r')
+			line.pop_back();
+		if (line == "quit")
+			break;
+		requests.Push(line);
+	}
+
+	// Finish every request already received
+	requests.Close();
+	for (std::thread& t : workers)
+		t.join();
+}
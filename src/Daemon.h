@@ -0,0 +1,35 @@
+#pragma once
+#include <iostream>
+#include <cstddef>
+
+/*
+* Daemon mode - a long-running converter for editor integration.
+*
+* Requests are read one per line. Arguments containing spaces may be "quoted".
+* Each request is answered with any number of WARNING and ERROR lines, followed
+* by a single OK or FAILED line. Every line is tagged with the request's id.
+*
+*    convert [id] [WAD] [Map] [Output] [XY Downscale] [Z Downscale] [X Shift] [Y Shift]
+*    export [id] [WAD] [Output Directory]
+*    quit
+*
+*    [id] WARNING [Message]
+*    [id] ERROR [Message]
+*    [id] OK [Milliseconds]
+*    [id] FAILED [Milliseconds]
+*
+* Every WAD read stays loaded, along with its texture table and the sector loops
+* of every level converted from it, so repeated conversions of the same level
+* with different transforms skip straight to generating brushes. WADs are
+* identified by their path, size and modification time - a WAD that changes
+* on disk is read again. The least recently used WADs are dropped once more
+* than cacheSize are loaded.
+*
+* Up to jobs requests are served at once. Responses may arrive out of order.
+*/
+struct DaemonSettings {
+	int jobs = 1;
+	size_t cacheSize = 4;
+};
+
+void RunDaemon(std::istream& input, std::ostream& output, const DaemonSettings& settings);
@@ -0,0 +1,39 @@
+#include "Events.h"
+#include <cstdio>
+#include <cstdarg>
+
+void EventSink::Report(EventType type, const char* message, int32_t current, int32_t total) const {
+	if (callback != nullptr) {
+		Event e = {type, message, current, total};
+		callback(e, userData);
+		return;
+	}
+
+	switch (type) {
+		case EVENT_INFO:
+		printf("%s\n", message);
+		break;
+
+		case EVENT_WARNING:
+		case EVENT_ERROR:
+		fprintf(stderr, "%s\n", message);
+		break;
+
+		case EVENT_PROGRESS: // Redraw the same line until the final item
+		printf("\r   - %s: %i / %i", message, current, total);
+		if(current == total)
+			printf("\n");
+		break;
+	}
+}
+
+void EventSink::Reportf(EventType type, const char* format, ...) const {
+	const size_t BUFFER_MAX = 1024;
+	char buffer[BUFFER_MAX];
+
+	va_list args;
+	va_start(args, format);
+	vsnprintf(buffer, BUFFER_MAX, format, args);
+	va_end(args);
+	Report(type, buffer);
+}
@@ -0,0 +1,41 @@
+#pragma once
+#include <cstdint>
+
+/*
+* Progress and diagnostics are reported as structured events rather than printed
+* directly, so programs embedding the converter can present them however they like.
+*/
+enum EventType : int32_t {
+	EVENT_INFO,
+	EVENT_WARNING,
+	EVENT_ERROR,
+	EVENT_PROGRESS
+};
+
+struct Event {
+	EventType type;
+	const char* message;
+	int32_t current; // Progress events only - the item just completed
+	int32_t total;   // Progress events only - the number of items
+};
+
+typedef void (*EventCallback)(const Event& event, void* userData);
+
+// Delivers events to a callback. Without one, events are printed to the console.
+struct EventSink {
+	EventCallback callback = nullptr;
+	void* userData = nullptr;
+
+	EventSink() {}
+
+	EventSink(EventCallback p_callback, void* p_userData) : callback(p_callback), userData(p_userData) {}
+
+	void Report(EventType type, const char* message, int32_t current = 0, int32_t total = 0) const;
+
+	// Formats the message with printf-style arguments
+	void Reportf(EventType type, const char* format, ...) const;
+
+	void Progress(const char* message, int32_t current, int32_t total) const {
+		Report(EVENT_PROGRESS, message, current, total);
+	}
+};
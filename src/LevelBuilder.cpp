@@ -0,0 +1,1093 @@
+#include "LevelBuilder.h"
+#include "Parallel.h"
+#include <earcut.hpp>
+#include <array>
+#include <algorithm>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+
+// Linedefs converted by a single task
+#define LINEDEFS_PER_TASK 64
+
+// Tasks in each scheduling window, per thread
+#define WINDOW_TASKS_PER_JOB 16
+
+/*
+* Brushes generated by a single task. They are queued while walking the level, and
+* written once the planes for every wall and floor triangle are computed in bulk.
+*/
+struct BrushBatch {
+	uint32_t handleBase = 0;
+	PlaneBatch planes;
+	std::vector<WallBrush> walls;
+	std::vector<FloorTriangle> triangles;
+
+	void Clear() {
+		planes.Clear();
+		walls.clear();
+		triangles.clear();
+	}
+
+	void QueueWall(int32_t lineIndex, BrushSlot slot, VertexFloat v0, VertexFloat v1, float minHeight, float maxHeight, float drawHeight, WadString texture, float offsetX) {
+		uint32_t handle = BrushHandle(handleBase, lineIndex, slot);
+		walls.push_back({v0, v1, minHeight, maxHeight, drawHeight, offsetX, texture, handle, planes.AddEdge(v0, v1)});
+	}
+
+	void QueueTriangle(int32_t sectorIndex, uint32_t handle, VertexFloat a, VertexFloat b, VertexFloat c) {
+		size_t firstEdge = planes.AddEdge(a, b);
+		planes.AddEdge(b, c);
+		planes.AddEdge(c, a);
+		triangles.push_back({a, b, c, sectorIndex, handle, firstEdge});
+	}
+
+	template<typename Sink>
+	void Write(WadLevel& level, MapWriter<Sink>& writer) {
+		planes.Compute();
+		WriteWalls(writer, 0, walls.size());
+		WriteTriangles(level, writer);
+	}
+
+	// Planes must already be computed. Writes to a MapWriter or MeshWriter.
+	template<typename Writer>
+	void WriteWalls(Writer& writer, size_t first, size_t end) {
+		for (size_t i = first; i < end; i++) {
+			const WallBrush& w = walls[i];
+			Plane surface = planes.GetPlane(w.edge, w.v1);
+			writer.WriteWallBrush(w.handle, w.v0, w.v1, surface, planes.Length(w.edge), w.minHeight, w.maxHeight, w.drawHeight, w.texture, w.offsetX);
+		}
+	}
+
+	template<typename Sink>
+	void WriteTriangles(WadLevel& level, MapWriter<Sink>& writer) {
+		for (const FloorTriangle& t : triangles) {
+			// The triangle's side planes are shared by its floor and ceiling brush
+			Plane sides[3] = {
+				planes.GetPlane(t.firstEdge, t.a),
+				planes.GetPlane(t.firstEdge + 1, t.b),
+				planes.GetPlane(t.firstEdge + 2, t.c)
+			};
+			Sector& sector = level.sectors[t.sector];
+			writer.WriteFloorBrush(t.floorHandle, sides, sector.floorHeight, false, sector.floorTexture);
+			writer.WriteFloorBrush(t.floorHandle + 1, sides, sector.ceilHeight, true, sector.ceilingTexture);
+		}
+	}
+
+	void WriteTriangles(WadLevel& level, MeshWriter& writer) {
+		for (const FloorTriangle& t : triangles) {
+			Sector& sector = level.sectors[t.sector];
+			writer.WriteFloorTriangle(t.a, t.b, t.c, sector.floorHeight, false, sector.floorTexture);
+			writer.WriteFloorTriangle(t.a, t.b, t.c, sector.ceilHeight, true, sector.ceilingTexture);
+		}
+	}
+};
+
+/*
+* Records every linedef bordering each sector, for use during floor construction.
+* Done up front so sectors can be converted without waiting on the walls.
+*/
+void BuildSectorLines(WadLevel& level) {
+	for (int32_t i = 0; i < level.sectors.Num(); i++)
+		level.sectors[i].lines.clear();
+
+	for (int32_t i = 0; i < level.linedefs.Num(); i++) {
+		LineDef& line = level.linedefs[i];
+		if(line.sideFront == NO_SIDEDEF)
+			continue;
+
+		SimpleLineDef simple;
+		simple.v0 = level.verts[line.vertexStart];
+		simple.v1 = level.verts[line.vertexEnd];
+		simple.key0 = level.vertices[line.vertexStart].Key();
+		simple.key1 = level.vertices[line.vertexEnd].Key();
+		simple.lineIndex = i;
+		level.sectors[level.sidedefs[line.sideFront].sector].lines.push_back(simple);
+
+		if (line.sideBack != NO_SIDEDEF) {
+			simple.isBack = true;
+			level.sectors[level.sidedefs[line.sideBack].sector].lines.push_back(simple);
+		}
+	}
+}
+
+// STEP 1: WALL BRUSHES
+void QueueLineDef(WadLevel& level, int32_t lineIndex, BrushBatch& batch) {
+	LineDef& line = level.linedefs[lineIndex];
+	VertexFloat v0(level.verts[line.vertexStart]);
+	VertexFloat v1(level.verts[line.vertexEnd]);
+	bool upperUnpegged = line.flags & UPPER_UNPEGGED;
+	bool lowerUnpegged = line.flags & LOWER_UNPEGGED;
+
+	// We assume linedefs can't have a back sidedef without a front
+	if(line.sideFront == NO_SIDEDEF)
+		return;
+
+	SideDef& frontSide = level.sidedefs[line.sideFront];
+	Sector& frontSector = level.sectors[frontSide.sector];
+
+	/*
+	* Draw Height Rules:
+	*
+	* One Sided: Ceiling (Default) / Floor (Lower Unpegged)
+	* Lower Textures: Highest Floor (Default) / Ceiling the side is facing (Lower Unpegged) 
+		- WIKI IS INCORRECT: Falsely asserts Lower Unpegged draws it from the higher ceiling downward
+	* Upper Textures: Lowest Ceiling (Default) / Highest Ceiling (Upper Unpegged)
+	* Middle Textures:
+	*	- Do not repeat vertically - we must modify the brush bounds to account for this
+	*		- TODO: THIS QUIRK IS NOT YET IMPLEMENTED
+	*	- Highest Ceiling (Default) / Highest Floor (Lower Unpegged)
+	*
+	* No need for any crazy vector projection when calculating drawheight, so we can simply add in the
+	* vertical offset right now
+	*/
+
+	if (line.sideBack == NO_SIDEDEF) {
+		float drawHeight = frontSide.offsetY + (lowerUnpegged ? frontSector.floorHeight : frontSector.ceilHeight);
+		// level.minHeight, level.maxHeight
+		batch.QueueWall(lineIndex, BRUSHSLOT_FRONT_MIDDLE, v0, v1, frontSector.floorHeight, frontSector.ceilHeight, drawHeight, frontSide.middleTexture, frontSide.offsetX);
+	} else {
+		SideDef& backSide = level.sidedefs[line.sideBack];
+		Sector& backSector = level.sectors[backSide.sector];
+
+		// Texture pegging is based on the lowest/highest floor/ceiling - so we must distinguish
+		// which values are smaller / larger - no way around this ugly chain of if statements unfortunately
+		float lowerFloor, lowerCeiling, higherFloor, higherCeiling;
+		if (frontSector.ceilHeight < backSector.ceilHeight) {
+			lowerCeiling = frontSector.ceilHeight;
+			higherCeiling = backSector.ceilHeight;
+		} else {
+			lowerCeiling = backSector.ceilHeight;
+			higherCeiling = frontSector.ceilHeight;
+		}
+		if (frontSector.floorHeight < backSector.floorHeight) {
+			lowerFloor = frontSector.floorHeight;
+			higherFloor = backSector.floorHeight;
+		} else {
+			lowerFloor = backSector.floorHeight;
+			higherFloor = frontSector.floorHeight;
+		}
+
+		// Brush the front sidedefs in relation to the back sector heights
+		if (frontSide.lowerTexture != "-") {
+			
+			//float drawHeight = frontSide.offsetY + (lowerUnpegged ? higherCeiling : higherFloor);
+			//float drawHeight = frontSide.offsetY + (lowerUnpegged ? frontSector.ceilHeight : frontSector.floorHeight);
+			float drawHeight = frontSide.offsetY + (lowerUnpegged ? frontSector.ceilHeight : higherFloor);
+			// level.minHeight, backSector.floorHeight
+			batch.QueueWall(lineIndex, BRUSHSLOT_FRONT_LOWER, v0, v1, frontSector.floorHeight, backSector.floorHeight, drawHeight, frontSide.lowerTexture, frontSide.offsetX);
+		}
+		if (frontSide.middleTexture != "-") {
+			float drawHeight = frontSide.offsetY + (lowerUnpegged ? higherFloor : higherCeiling);
+			batch.QueueWall(lineIndex, BRUSHSLOT_FRONT_MIDDLE, v0, v1, backSector.floorHeight, backSector.ceilHeight, drawHeight, frontSide.middleTexture, frontSide.offsetX);
+		}
+		if (frontSide.upperTexture != "-") {
+			float drawHeight = frontSide.offsetY + upperUnpegged ? higherCeiling : lowerCeiling;
+			// backSector.ceilHeight, level.maxHeight
+			batch.QueueWall(lineIndex, BRUSHSLOT_FRONT_UPPER, v0, v1, backSector.ceilHeight, frontSector.ceilHeight, drawHeight, frontSide.upperTexture, frontSide.offsetX);
+		}
+
+		// Brush the back sidedefs in relation to the front sector heights
+		// Technically this results in two overlapped brushes. However, this is rare
+		// enough to not be considered an issue (yet) - back-textured surfaces mainly
+		// appear to be windows
+		// BUG FIXED: Must swap start/end vertices to ensure texture is drawn on correct face
+		// and begins at correct position
+		if (backSide.lowerTexture != "-") {
+			//float drawHeight = backSide.offsetY + lowerUnpegged ? higherCeiling : higherFloor;
+			//float drawHeight = backSide.offsetY + (lowerUnpegged ? backSector.ceilHeight : backSector.floorHeight);
+			float drawHeight = backSide.offsetY + lowerUnpegged ? backSector.ceilHeight : higherFloor;
+			// level.minHeight, frontSector.floorHeight
+			batch.QueueWall(lineIndex, BRUSHSLOT_BACK_LOWER, v1, v0, backSector.floorHeight, frontSector.floorHeight, drawHeight, backSide.lowerTexture, backSide.offsetX);
+		}
+		if (backSide.middleTexture != "-") {
+			float drawHeight = backSide.offsetY + (lowerUnpegged ? higherFloor : higherCeiling);
+			batch.QueueWall(lineIndex, BRUSHSLOT_BACK_MIDDLE, v1, v0, frontSector.floorHeight, frontSector.ceilHeight, drawHeight, backSide.middleTexture, backSide.offsetX);
+		}
+		if (backSide.upperTexture != "-") {
+			float drawHeight = backSide.offsetY + upperUnpegged ? higherCeiling : lowerCeiling;
+			// frontSector.ceilHeight, level.maxHeight
+			batch.QueueWall(lineIndex, BRUSHSLOT_BACK_UPPER, v1, v0, frontSector.ceilHeight, backSector.ceilHeight, drawHeight, backSide.upperTexture, backSide.offsetX);
+		}
+	}
+}
+
+bool SortSectorLoop(const Sector& sector, SectorLoop& loop) {
+	struct LoopLine {
+		int32_t line;
+		bool reversed;
+		uint32_t key0;
+		uint32_t key1;
+
+		void swapOrder() {
+			reversed = !reversed;
+			std::swap(key0, key1);
+		}
+	};
+
+	loop.edges.clear();
+	loop.complete = true;
+	if (sector.lines.empty())
+		return true;
+
+	std::vector<LoopLine> unsorted;
+	std::vector<LoopLine> sorted;
+	unsorted.reserve(sector.lines.size());
+	sorted.reserve(sector.lines.size());
+	for (size_t i = 0; i < sector.lines.size(); i++)
+		unsorted.push_back({static_cast<int32_t>(i), false, sector.lines[i].key0, sector.lines[i].key1});
+
+	// Sort first linedef
+	sorted.push_back(unsorted[0]);
+	unsorted.erase(unsorted.begin());
+
+	bool forceBreak = false;
+
+	while (!unsorted.empty() && !forceBreak) {
+		LoopLine firstSorted = sorted[0];
+		LoopLine lastSorted = sorted[sorted.size() - 1];
+
+		for(int i = 0, max = unsorted.size(); i < max; i++) {
+			LoopLine current = unsorted[i];
+			if (current.key0 == firstSorted.key0) { // TODO: CONSOLIDATE
+				current.swapOrder();
+				sorted.insert(sorted.begin(), current);
+				unsorted.erase(unsorted.begin() + i);
+				goto LABEL_SKIP_FORCEBREAK;
+			} else if (current.key1 == firstSorted.key0) {
+				sorted.insert(sorted.begin(), current);
+				unsorted.erase(unsorted.begin() + i);
+				goto LABEL_SKIP_FORCEBREAK;
+			} else if (current.key0 == lastSorted.key1) {
+				sorted.push_back(current);
+				unsorted.erase(unsorted.begin() + i);
+				goto LABEL_SKIP_FORCEBREAK;
+			} else if (current.key1 == lastSorted.key1) {
+				current.swapOrder();
+				sorted.push_back(current);
+				unsorted.erase(unsorted.begin() + i);
+				goto LABEL_SKIP_FORCEBREAK;
+			}
+		}
+		forceBreak = true; // For polygons with holes
+		LABEL_SKIP_FORCEBREAK:;
+	}
+
+	loop.complete = !forceBreak;
+	if (loop.complete) {
+		loop.edges.reserve(sorted.size());
+		for(const LoopLine& l : sorted)
+			loop.edges.push_back({l.line, l.reversed});
+	}
+	return loop.complete;
+}
+
+SectorLoopCache::SectorLoopCache(int32_t sectorCount) : loops(sectorCount), sorted(new std::once_flag[sectorCount]) {}
+
+const SectorLoop& SectorLoopCache::Get(int32_t sectorIndex, const Sector& sector) {
+	std::call_once(sorted[sectorIndex], [&] {
+		SortSectorLoop(sector, loops[sectorIndex]);
+	});
+	return loops[sectorIndex];
+}
+
+// STEP TWO: FLOOR AND CEILING BRUSHES....
+// Returns false if the sector's floor and ceiling could not be generated
+bool QueueSector(WadLevel& level, int32_t sectorIndex, BrushBatch& batch, SectorLoopCache* loopCache) {
+	Sector& sector = level.sectors[sectorIndex];
+
+	if (sector.lines.empty())
+		return true;
+
+	// Join the linedefs into a loop, unless an earlier conversion already has
+	SectorLoop localLoop;
+	const SectorLoop* loop = &localLoop;
+	if (loopCache != nullptr)
+		loop = &loopCache->Get(sectorIndex, sector);
+	else SortSectorLoop(sector, localLoop);
+
+	if (!loop->complete)
+		return false;
+
+	// Triangle handles are assigned from the linedefs in their original order
+	const std::vector<SimpleLineDef>& owners = sector.lines;
+
+	// Execute EarCut
+	{
+		typedef std::array<float, 2> Point;
+		std::vector<std::vector<Point>> polylines;
+		polylines.emplace_back();
+		std::vector<Point>& mainLine = polylines[0];
+
+		// Each consecutive edge shares a end/beginning point
+		for (const SectorLoop::Edge& e : loop->edges) {
+			const SimpleLineDef& s = sector.lines[e.line];
+			const VertexFloat& start = e.reversed ? s.v1 : s.v0;
+			mainLine.push_back({start.x, start.y});
+		}
+
+		std::vector<int16_t> triangleIndices = mapbox::earcut<int16_t>(polylines);
+
+		for (int i = 0, t = 0, max = triangleIndices.size(); i < max; t++) {
+			const SimpleLineDef& owner = owners[t];
+			uint32_t handle = BrushHandle(batch.handleBase, owner.lineIndex, owner.isBack ? BRUSHSLOT_BACK_FLOOR : BRUSHSLOT_FRONT_FLOOR);
+
+			VertexFloat a(mainLine[triangleIndices[i++]]);
+			VertexFloat b(mainLine[triangleIndices[i++]]);
+			VertexFloat c(mainLine[triangleIndices[i++]]);
+
+			batch.QueueTriangle(sectorIndex, handle, a, b, c);
+		}
+	}
+	return true;
+}
+
+// Hashes every record the linedef's wall brushes are generated from
+uint64_t LineCacheKey(const WadLevel& level, int32_t lineIndex, uint32_t handleBase, int precision) {
+	const LineDef& line = level.linedefs[lineIndex];
+	CacheKey key;
+	key.Add('L');
+	key.Add(handleBase);
+	key.Add(precision);
+	key.Add(level.transforms);
+	key.Add(lineIndex);
+	key.Add(line.flags);
+	key.Add(level.vertices[line.vertexStart].Key());
+	key.Add(level.vertices[line.vertexEnd].Key());
+
+	uint16_t sides[2] = {line.sideFront, line.sideBack};
+	for (uint16_t sideIndex : sides) {
+		key.Add(sideIndex == NO_SIDEDEF);
+		if (sideIndex == NO_SIDEDEF)
+			continue;
+
+		const SideDef& side = level.sidedefs[sideIndex];
+		const Sector& sector = level.sectors[side.sector];
+		key.Add(side.offsetX);
+		key.Add(side.offsetY);
+		key.Add(sector.floorHeight);
+		key.Add(sector.ceilHeight);
+
+		const WadString* textures[3] = {&side.upperTexture, &side.middleTexture, &side.lowerTexture};
+		for (const WadString* texture : textures) {
+			key.Add(texture->Data(), LENGTH_WADSTRING);
+			auto ratios = level.metersPerPixel.find(*texture);
+			DimFloat dim = ratios == level.metersPerPixel.end() ? DimFloat() : ratios->second;
+			key.Add(dim);
+		}
+	}
+	return key.hash;
+}
+
+// Hashes every record the sector's floor and ceiling brushes are generated from
+uint64_t SectorCacheKey(const WadLevel& level, int32_t sectorIndex, uint32_t handleBase, int precision) {
+	const Sector& sector = level.sectors[sectorIndex];
+	CacheKey key;
+	key.Add('S');
+	key.Add(handleBase);
+	key.Add(precision);
+	key.Add(level.transforms);
+	key.Add(sector.floorHeight);
+	key.Add(sector.ceilHeight);
+	key.Add(sector.floorTexture.Data(), LENGTH_WADSTRING);
+	key.Add(sector.ceilingTexture.Data(), LENGTH_WADSTRING);
+	for (const SimpleLineDef& s : sector.lines) {
+		key.Add(s.key0);
+		key.Add(s.key1);
+		key.Add(s.lineIndex);
+		key.Add(s.isBack);
+	}
+	return key.hash;
+}
+
+/*
+* Spatial Grid
+*
+* Every brush of the level is generated up front as geometry, rather than text,
+* then binned into square cells by the position of its center. Walls are placed
+* by their midpoint, and floor triangles by their centroid. A triangle's floor
+* and ceiling brush always stay together.
+*/
+struct GridWall {
+	WallBrush brush;
+	Plane surface;
+	float length;
+};
+
+struct GridTriangle {
+	FloorTriangle triangle;
+	Plane sides[3];
+};
+
+enum GridBrushType : uint8_t {
+	GRID_WALL,
+	GRID_TRIANGLE,
+	GRID_PORTAL
+};
+
+struct GridBrush {
+	uint32_t morton;  // Position along the Morton curve over the level's bounds
+	uint32_t handle;
+	uint32_t index;   // Into LevelGrid::walls, LevelGrid::triangles or the level's portals
+	GridBrushType type;
+};
+
+struct GridCell {
+	int32_t x;
+	int32_t y;
+	std::vector<GridBrush> brushes;
+};
+
+struct LevelGrid {
+	uint32_t handleBase = 0;
+	std::vector<GridWall> walls;
+	std::vector<GridTriangle> triangles;
+	std::vector<GridCell> cells; // Cells holding brushes, by row and then column
+};
+
+// Interleaves the bits of two 16 bit coordinates
+uint32_t MortonCode(uint32_t x, uint32_t y) {
+	auto spread = [](uint32_t v) {
+		v &= 0xFFFF;
+		v = (v | (v << 8)) & 0x00FF00FF;
+		v = (v | (v << 4)) & 0x0F0F0F0F;
+		v = (v | (v << 2)) & 0x33333333;
+		v = (v | (v << 1)) & 0x55555555;
+		return v;
+	};
+	return spread(x) | (spread(y) << 1);
+}
+
+// Writes a visportal brush for each of the level's portals
+template<typename Sink>
+void WritePortals(WadLevel& level, const LevelAreas& areas, uint32_t handleBase, MapWriter<Sink>& writer) {
+	for (const Visportal& p : areas.portals) {
+		const LineDef& line = level.linedefs[p.line];
+		writer.WritePortalBrush(ExtraHandle(handleBase, p.line, EXTRASLOT_PORTAL), level.verts[line.vertexStart], level.verts[line.vertexEnd],
+			p.minHeight, p.maxHeight);
+	}
+}
+
+void ReportAreas(const LevelAreas& areas, const BuildSettings& settings) {
+	settings.events.Reportf(EVENT_INFO, "Split level into %i areas with %i visportals", areas.areaCount, static_cast<int>(areas.portals.size()));
+}
+
+// Writes the player clip hull. Sector lines must already be gathered.
+template<typename Sink>
+void WriteClipHull(WadLevel& level, const BuildSettings& settings, MapWriter<Sink>& writer) {
+	SectorLoopCache* loopCache = settings.loopCache;
+	std::unique_ptr<SectorLoopCache> localLoops;
+	if (loopCache == nullptr || loopCache->Num() != level.sectors.Num()) {
+		localLoops.reset(new SectorLoopCache(level.sectors.Num()));
+		loopCache = localLoops.get();
+	}
+
+	std::vector<ClipBrush> brushes;
+	BuildClipHull(level, *loopCache, settings.jobs < 1 ? 1 : settings.jobs, brushes);
+	for (const ClipBrush& b : brushes)
+		writer.WriteClipBrush(b.handle, b.points.data(), b.points.size(), b.minHeight, b.maxHeight);
+	settings.events.Reportf(EVENT_INFO, "Generated a player clip hull of %i brushes", static_cast<int>(brushes.size()));
+}
+
+// Writes a light entity for each cluster of sectors
+template<typename Sink>
+void WriteLights(WadLevel& level, const BuildSettings& settings, MapWriter<Sink>& writer) {
+	LevelAreas areas;
+	BuildAreas(level, areas);
+	std::vector<SectorLight> lights;
+	BuildLights(level, areas, settings.lighting, lights);
+
+	std::string prefix = std::string(level.lumpHeader->name) + "_light_";
+	for (const SectorLight& light : lights) {
+		std::string name = prefix + std::to_string(light.sector);
+		writer.WriteLight(name.data(), light.origin, light.radius, light.brightness);
+	}
+	settings.events.Reportf(EVENT_INFO, "Lit %i sectors with %i lights", level.sectors.Num(), static_cast<int>(lights.size()));
+}
+
+// Writes an entity for each converted thing
+template<typename Sink>
+void WriteThings(WadLevel& level, const BuildSettings& settings, MapWriter<Sink>& writer) {
+	std::vector<ThingEntity> entities;
+	BuildThings(level, *settings.things, entities);
+
+	std::string name = std::string(level.lumpHeader->name) + "_thing_";
+	std::string inherit;
+	size_t nameLength = name.length();
+	for (const ThingEntity& e : entities) {
+		name.resize(nameLength);
+		name.append(std::to_string(e.thing));
+		inherit.assign(THING_TEMPLATE_PREFIX);
+		inherit.append(e.source->name);
+		writer.WriteTemplateEntity(name.data(), inherit.data(), e.origin, e.angle);
+	}
+	settings.events.Reportf(EVENT_INFO, "Converted %i of %i things", static_cast<int>(entities.size()), level.things.Num());
+}
+
+// Converts each prefab not yet in the library into its own map, and writes an entity placing each copy
+template<typename Sink>
+void WritePrefabs(WadLevel& level, const LevelPrefabs& prefabs, const BuildSettings& settings, MapWriter<Sink>& writer) {
+	ParallelForChecked(prefabs.prefabs.size(), settings.jobs < 1 ? 1 : settings.jobs, [&](size_t i, int) {
+		const Prefab& prefab = prefabs.prefabs[i];
+		if (!settings.prefabs->Claim(prefab.hash))
+			return;
+
+		WadLevel prefabLevel;
+		BuildPrefabLevel(level, prefab, prefabLevel);
+		BuildSectorLines(prefabLevel);
+
+		MemorySink sink;
+		MapWriter<MemorySink> prefabWriter(prefabLevel, sink, settings.precision);
+		prefabWriter.Begin();
+		// Batched in the same chunks as BuildLevel, so a large prefab is never queued whole
+		BrushBatch batch;
+		batch.handleBase = HANDLE_MINIMUM;
+		for (int32_t first = 0; first < prefabLevel.linedefs.Num(); first += LINEDEFS_PER_TASK) {
+			int32_t max = std::min(prefabLevel.linedefs.Num(), first + LINEDEFS_PER_TASK);
+			batch.Clear();
+			for (int32_t line = first; line < max; line++)
+				QueueLineDef(prefabLevel, line, batch);
+			batch.Write(prefabLevel, prefabWriter);
+		}
+		for (int32_t sector : prefab.enclosed) {
+			batch.Clear();
+			if (!QueueSector(prefabLevel, sector, batch, nullptr))
+				settings.events.Reportf(EVENT_WARNING, "Unable to generate floors/ceilings for Sector %i", prefab.sectors[sector]);
+			batch.Write(prefabLevel, prefabWriter);
+		}
+		prefabWriter.Finish();
+
+		if (!settings.prefabs->Write(prefab.hash, sink.data))
+			settings.events.Reportf(EVENT_ERROR, "ERROR: FAILED TO WRITE %s.map", PrefabLibrary::MapPath(prefab.hash).data());
+	});
+
+	std::vector<std::string> paths;
+	for (const Prefab& prefab : prefabs.prefabs)
+		paths.push_back(PrefabLibrary::MapPath(prefab.hash));
+	std::string name = std::string(level.lumpHeader->name) + "_prefab_";
+	size_t nameLength = name.length();
+	for (const PrefabInstance& instance : prefabs.instances) {
+		name.resize(nameLength);
+		name.append(std::to_string(instance.line));
+		writer.WritePrefabInstance(name.data(), paths[instance.prefab].data(), instance.origin, settings.clip ? NONSOLID_ENTITY_EDIT : nullptr);
+	}
+	settings.events.Reportf(EVENT_INFO, "Placed %i copies of %i prefabs", static_cast<int>(prefabs.instances.size()),
+		static_cast<int>(prefabs.prefabs.size()));
+}
+
+// Portals are binned with the other brushes, if given. Prefab copies are left out.
+void BuildGrid(WadLevel& level, const BuildSettings& settings, LevelGrid& grid, const LevelAreas* areas, const LevelPrefabs& prefabs) {
+	BuildSectorLines(level);
+
+	// Generate the brushes with the same tasks as BuildLevel
+	int jobs = settings.jobs < 1 ? 1 : settings.jobs;
+	int32_t lineTasks = settings.walls ? (level.linedefs.Num() + LINEDEFS_PER_TASK - 1) / LINEDEFS_PER_TASK : 0;
+	int32_t taskCount = lineTasks + (settings.floors ? level.sectors.Num() : 0);
+
+	struct Chunk {
+		std::vector<GridWall> walls;
+		std::vector<GridTriangle> triangles;
+		bool failed = false;
+	};
+	std::vector<BrushBatch> batches(jobs);
+	std::vector<Chunk> chunks(taskCount);
+	uint32_t handleBase = LevelHandleBase(level.lumpHeader->name);
+	grid.handleBase = handleBase;
+	SectorLoopCache* loopCache = settings.loopCache;
+	if (loopCache != nullptr && loopCache->Num() != level.sectors.Num())
+		loopCache = nullptr;
+
+	ParallelForChecked(taskCount, jobs, [&](size_t taskIndex, int workerIndex) {
+		int32_t task = static_cast<int32_t>(taskIndex);
+		BrushBatch& batch = batches[workerIndex];
+		Chunk& chunk = chunks[task];
+
+		batch.Clear();
+		batch.handleBase = handleBase;
+		if (task < lineTasks) {
+			int32_t max = std::min(level.linedefs.Num(), (task + 1) * LINEDEFS_PER_TASK);
+			for (int32_t i = task * LINEDEFS_PER_TASK; i < max; i++)
+				if (!prefabs.LineInstanced(i))
+					QueueLineDef(level, i, batch);
+		}
+		else if (!prefabs.SectorInstanced(task - lineTasks))
+			chunk.failed = !QueueSector(level, task - lineTasks, batch, loopCache);
+
+		batch.planes.Compute();
+		for (const WallBrush& w : batch.walls)
+			chunk.walls.push_back({w, batch.planes.GetPlane(w.edge, w.v1), batch.planes.Length(w.edge)});
+		for (const FloorTriangle& t : batch.triangles) {
+			chunk.triangles.push_back({t, {
+				batch.planes.GetPlane(t.firstEdge, t.a),
+				batch.planes.GetPlane(t.firstEdge + 1, t.b),
+				batch.planes.GetPlane(t.firstEdge + 2, t.c)
+			}});
+		}
+	});
+
+	for (int32_t i = 0; i < taskCount; i++) {
+		Chunk& chunk = chunks[i];
+		if (chunk.failed)
+			settings.events.Reportf(EVENT_WARNING, "Unable to generate floors/ceilings for Sector %i", i - lineTasks);
+		grid.walls.insert(grid.walls.end(), chunk.walls.begin(), chunk.walls.end());
+		grid.triangles.insert(grid.triangles.end(), chunk.triangles.begin(), chunk.triangles.end());
+		std::vector<GridWall>().swap(chunk.walls);
+		std::vector<GridTriangle>().swap(chunk.triangles);
+	}
+	if (level.verts.Num() == 0)
+		return;
+
+	// Bin the brushes
+	VertexFloat min = level.verts[0], max = level.verts[0];
+	for (int32_t i = 1; i < level.verts.Num(); i++) {
+		const VertexFloat& v = level.verts[i];
+		min.x = std::min(min.x, v.x);
+		min.y = std::min(min.y, v.y);
+		max.x = std::max(max.x, v.x);
+		max.y = std::max(max.y, v.y);
+	}
+	float extent = std::max(max.x - min.x, max.y - min.y);
+	float mortonScale = extent > 0 ? 65535.0f / extent : 0;
+	float cellScale = 1.0f / settings.gridSize;
+
+	std::unordered_map<uint64_t, size_t> cellIndex;
+	auto place = [&](VertexFloat center, uint32_t handle, uint32_t index, GridBrushType type) {
+		int32_t x = static_cast<int32_t>(floorf((center.x - min.x) * cellScale));
+		int32_t y = static_cast<int32_t>(floorf((center.y - min.y) * cellScale));
+		uint64_t key = static_cast<uint64_t>(static_cast<uint32_t>(y)) << 32 | static_cast<uint32_t>(x);
+		auto found = cellIndex.emplace(key, grid.cells.size());
+		if (found.second)
+			grid.cells.push_back({x, y, {}});
+
+		float mx = std::clamp((center.x - min.x) * mortonScale, 0.0f, 65535.0f);
+		float my = std::clamp((center.y - min.y) * mortonScale, 0.0f, 65535.0f);
+		uint32_t morton = MortonCode(static_cast<uint32_t>(mx), static_cast<uint32_t>(my));
+		grid.cells[found.first->second].brushes.push_back({morton, handle, index, type});
+	};
+	for (size_t i = 0; i < grid.walls.size(); i++) {
+		const WallBrush& w = grid.walls[i].brush;
+		place(VertexFloat((w.v0.x + w.v1.x) * 0.5f, (w.v0.y + w.v1.y) * 0.5f), w.handle, static_cast<uint32_t>(i), GRID_WALL);
+	}
+	for (size_t i = 0; i < grid.triangles.size(); i++) {
+		const FloorTriangle& t = grid.triangles[i].triangle;
+		place(VertexFloat((t.a.x + t.b.x + t.c.x) / 3.0f, (t.a.y + t.b.y + t.c.y) / 3.0f), t.floorHandle, static_cast<uint32_t>(i), GRID_TRIANGLE);
+	}
+	for (size_t i = 0; areas != nullptr && i < areas->portals.size(); i++) {
+		const LineDef& line = level.linedefs[areas->portals[i].line];
+		const VertexFloat& v0 = level.verts[line.vertexStart];
+		const VertexFloat& v1 = level.verts[line.vertexEnd];
+		place(VertexFloat((v0.x + v1.x) * 0.5f, (v0.y + v1.y) * 0.5f), ExtraHandle(handleBase, areas->portals[i].line, EXTRASLOT_PORTAL),
+			static_cast<uint32_t>(i), GRID_PORTAL);
+	}
+
+	std::sort(grid.cells.begin(), grid.cells.end(), [](const GridCell& a, const GridCell& b) {
+		return a.y != b.y ? a.y < b.y : a.x < b.x;
+	});
+	ParallelForChecked(grid.cells.size(), jobs, [&](size_t i, int) {
+		std::sort(grid.cells[i].brushes.begin(), grid.cells[i].brushes.end(), [](const GridBrush& a, const GridBrush& b) {
+			return a.morton != b.morton ? a.morton < b.morton : a.handle < b.handle;
+		});
+	});
+}
+
+template<typename Sink>
+void WriteGridCell(WadLevel& level, const LevelGrid& grid, const LevelAreas* areas, const GridCell& cell, MapWriter<Sink>& writer) {
+	for (const GridBrush& b : cell.brushes) {
+		if (b.type == GRID_PORTAL) {
+			const Visportal& p = areas->portals[b.index];
+			const LineDef& line = level.linedefs[p.line];
+			writer.WritePortalBrush(b.handle, level.verts[line.vertexStart], level.verts[line.vertexEnd], p.minHeight, p.maxHeight);
+		}
+		else if (b.type == GRID_WALL) {
+			const GridWall& g = grid.walls[b.index];
+			const WallBrush& w = g.brush;
+			writer.WriteWallBrush(w.handle, w.v0, w.v1, g.surface, g.length, w.minHeight, w.maxHeight, w.drawHeight, w.texture, w.offsetX);
+		}
+		else {
+			const GridTriangle& g = grid.triangles[b.index];
+			Sector& sector = level.sectors[g.triangle.sector];
+			writer.WriteFloorBrush(g.triangle.floorHandle, g.sides, sector.floorHeight, false, sector.floorTexture);
+			writer.WriteFloorBrush(g.triangle.floorHandle + 1, g.sides, sector.ceilHeight, true, sector.ceilingTexture);
+		}
+	}
+}
+
+// BuildLevel, when a grid size is set
+template<typename Sink>
+void BuildGridLevel(WadLevel& level, Sink& sink, const BuildSettings& settings) {
+	LevelPrefabs prefabs;
+	if (settings.prefabs != nullptr)
+		FindPrefabs(level, prefabs);
+	LevelGrid grid;
+	BuildGrid(level, settings, grid, nullptr, prefabs);
+
+	MapWriter<Sink> writer(level, sink, settings.precision);
+	writer.Begin();
+	if (settings.portals) {
+		LevelAreas areas;
+		BuildAreas(level, areas);
+		WritePortals(level, areas, grid.handleBase, writer);
+		ReportAreas(areas, settings);
+	}
+	if (settings.clip)
+		WriteClipHull(level, settings, writer);
+
+	// Cells are formatted at once, and written in order as they finish
+	struct Chunk {
+		std::string text;
+		bool done = false;
+	};
+	std::vector<Chunk> chunks(grid.cells.size());
+	size_t nextChunk = 0;
+	std::mutex commitLock;
+	ParallelForChecked(grid.cells.size(), settings.jobs < 1 ? 1 : settings.jobs, [&](size_t i, int) {
+		const GridCell& cell = grid.cells[i];
+		std::string name = std::string(level.lumpHeader->name) + "_cell_" + std::to_string(cell.x) + "_" + std::to_string(cell.y);
+
+		MemorySink cellSink;
+		MapWriter<MemorySink> cellWriter(level, cellSink, settings.precision);
+		cellWriter.BeginEntity(name.data(), GRID_ENTITY_INHERIT, settings.clip ? NONSOLID_ENTITY_EDIT : nullptr);
+		WriteGridCell(level, grid, nullptr, cell, cellWriter);
+		cellWriter.Flush();
+
+		std::lock_guard<std::mutex> guard(commitLock);
+		chunks[i].text.swap(cellSink.data);
+		chunks[i].done = true;
+		while (nextChunk < chunks.size() && chunks[nextChunk].done) {
+			writer.WriteRaw(chunks[nextChunk].text.data(), chunks[nextChunk].text.length());
+			std::string().swap(chunks[nextChunk].text);
+			nextChunk++;
+		}
+	});
+
+	if (settings.prefabs != nullptr)
+		WritePrefabs(level, prefabs, settings, writer);
+	if (settings.lights)
+		WriteLights(level, settings, writer);
+	if (settings.things != nullptr)
+		WriteThings(level, settings, writer);
+	writer.Finish();
+}
+
+bool BuildLevelCells(WadLevel& level, const std::string& basePath, const BuildSettings& settings) {
+	// Each cell's brushes are in its map's worldspawn, so portals can go with them
+	LevelAreas areas;
+	if (settings.portals) {
+		BuildAreas(level, areas);
+		ReportAreas(areas, settings);
+	}
+	LevelGrid grid;
+	BuildGrid(level, settings, grid, &areas, LevelPrefabs());
+
+	std::atomic<bool> success(true);
+	ParallelForChecked(grid.cells.size(), settings.jobs < 1 ? 1 : settings.jobs, [&](size_t i, int) {
+		const GridCell& cell = grid.cells[i];
+		std::string path = basePath + "_" + std::to_string(cell.x) + "_" + std::to_string(cell.y) + ".map";
+
+		FileSink sink;
+		if (!sink.Open(path)) {
+			settings.events.Reportf(EVENT_ERROR, "Unable to create %s", path.data());
+			success = false;
+			return;
+		}
+		MapWriter<FileSink> writer(level, sink, settings.precision);
+		writer.Begin();
+		WriteGridCell(level, grid, &areas, cell, writer);
+		writer.Finish();
+		if (sink.Failed()) {
+			settings.events.Reportf(EVENT_ERROR, "Unable to write %s", path.data());
+			success = false;
+		}
+	});
+	return success;
+}
+
+template<typename Sink>
+void BuildLevel(WadLevel& level, Sink& sink, const BuildSettings& settings) {
+	if (settings.gridSize > 0) {
+		BuildGridLevel(level, sink, settings);
+		return;
+	}
+
+	MapWriter<Sink> writer(level, sink, settings.precision);
+	writer.Begin();
+	BuildSectorLines(level);
+	LevelPrefabs prefabs;
+	if (settings.prefabs != nullptr)
+		FindPrefabs(level, prefabs);
+
+	// Visportals and the clip hull go in the worldspawn, ahead of the non-solid drawn brushes
+	auto writePortals = [&] {
+		LevelAreas areas;
+		BuildAreas(level, areas);
+		WritePortals(level, areas, LevelHandleBase(level.lumpHeader->name), writer);
+		ReportAreas(areas, settings);
+	};
+	if (settings.clip) {
+		if (settings.portals)
+			writePortals();
+		WriteClipHull(level, settings, writer);
+		std::string name = std::string(level.lumpHeader->name) + "_render";
+		writer.BeginEntity(name.data(), GRID_ENTITY_INHERIT, NONSOLID_ENTITY_EDIT);
+	}
+
+	/*
+	* Tasks in canonical order: blocks of linedefs, followed by each sector.
+	*
+	* The tasks are split into windows of consecutive tasks. Within a window
+	* they're scheduled with the most expensive tasks first. Sectors are
+	* weighted by the square of their linedef count, since sorting their
+	* linedefs into a loop is quadratic.
+	*
+	* A thread may not start a task until every window before the previous
+	* one is written to the sink. Finished chunks waiting on earlier ones are
+	* therefore bounded by two windows, no matter how big the level is.
+	*/
+	int jobs = settings.jobs < 1 ? 1 : settings.jobs;
+	int32_t lineTasks = settings.walls ? (level.linedefs.Num() + LINEDEFS_PER_TASK - 1) / LINEDEFS_PER_TASK : 0;
+	int32_t taskCount = lineTasks + (settings.floors ? level.sectors.Num() : 0);
+	int32_t windowSize = WINDOW_TASKS_PER_JOB * jobs;
+	std::vector<size_t> costs(taskCount);
+	std::vector<int32_t> schedule(taskCount);
+	for (int32_t i = 0; i < taskCount; i++) {
+		schedule[i] = i;
+		if (i < lineTasks)
+			costs[i] = LINEDEFS_PER_TASK;
+		else {
+			size_t lines = level.sectors[i - lineTasks].lines.size();
+			costs[i] = lines * lines;
+		}
+	}
+	for (int32_t start = 0; start < taskCount; start += windowSize) {
+		int32_t end = std::min(taskCount, start + windowSize);
+		std::stable_sort(schedule.begin() + start, schedule.begin() + end, [&](int32_t a, int32_t b) {
+			return costs[a] > costs[b];
+		});
+	}
+
+	// Brushes of a single linedef, when converting with a cache
+	struct LineText {
+		uint64_t key;
+		bool cached;
+		std::string text;
+		size_t firstWall;
+		size_t endWall;
+	};
+
+	// Each worker formats its tasks with its own writer
+	struct Worker {
+		MemorySink sink;
+		BrushBatch batch;
+		std::vector<LineText> lines;
+	};
+	struct Chunk {
+		std::string text;
+		bool done = false;
+		bool failed = false;
+	};
+	std::vector<Worker> workers(jobs);
+	std::vector<Chunk> chunks(taskCount);
+	int32_t nextChunk = 0;
+	std::mutex commitLock;
+	std::condition_variable committed;
+	uint32_t handleBase = LevelHandleBase(level.lumpHeader->name);
+	LevelCache* cache = settings.cache;
+	SectorLoopCache* loopCache = settings.loopCache;
+	if (loopCache != nullptr && loopCache->Num() != level.sectors.Num())
+		loopCache = nullptr;
+
+	bool aborted = false;
+	auto formatTask = [&](size_t scheduleIndex, int workerIndex) {
+		int32_t task = schedule[scheduleIndex];
+		Worker& worker = workers[workerIndex];
+
+		int32_t window = static_cast<int32_t>(scheduleIndex) / windowSize;
+		if (window > 1) {
+			std::unique_lock<std::mutex> guard(commitLock);
+			committed.wait(guard, [&] { return aborted || nextChunk >= (window - 1) * windowSize; });
+			if (aborted)
+				return;
+		}
+
+		MapWriter<MemorySink> chunkWriter(level, worker.sink, settings.precision);
+		bool failed = false;
+
+		worker.batch.Clear();
+		worker.batch.handleBase = handleBase;
+		if (task < lineTasks) {
+			int32_t first = task * LINEDEFS_PER_TASK;
+			int32_t max = std::min(level.linedefs.Num(), (task + 1) * LINEDEFS_PER_TASK);
+			if (cache == nullptr) {
+				for (int32_t i = first; i < max; i++)
+					if (!prefabs.LineInstanced(i))
+						QueueLineDef(level, i, worker.batch);
+				worker.batch.Write(level, chunkWriter);
+				chunkWriter.Flush();
+			}
+
+			// Only generate linedefs that aren't cached, then splice everything back in order
+			else {
+				std::vector<LineText>& lines = worker.lines;
+				lines.resize(max - first);
+				for (int32_t i = first; i < max; i++) {
+					LineText& line = lines[i - first];
+					if (prefabs.LineInstanced(i)) {
+						line.cached = true;
+						line.text.clear();
+						continue;
+					}
+					line.key = LineCacheKey(level, i, handleBase, settings.precision);
+					bool unused;
+					line.cached = cache->Find(line.key, line.text, unused);
+					if (!line.cached) {
+						line.firstWall = worker.batch.walls.size();
+						QueueLineDef(level, i, worker.batch);
+						line.endWall = worker.batch.walls.size();
+					}
+				}
+
+				worker.batch.planes.Compute();
+				for (LineText& line : lines) {
+					if (line.cached)
+						continue;
+					worker.batch.WriteWalls(chunkWriter, line.firstWall, line.endWall);
+					chunkWriter.Flush();
+					line.text.swap(worker.sink.data);
+					worker.sink.data.clear();
+					cache->Store(line.key, line.text, false);
+				}
+				for (const LineText& line : lines)
+					worker.sink.data.append(line.text);
+			}
+		}
+		else if (!prefabs.SectorInstanced(task - lineTasks)) {
+			int32_t sectorIndex = task - lineTasks;
+			uint64_t key = 0;
+			bool cached = false;
+			if (cache != nullptr) {
+				key = SectorCacheKey(level, sectorIndex, handleBase, settings.precision);
+				cached = cache->Find(key, worker.sink.data, failed);
+			}
+
+			if (!cached) {
+				failed = !QueueSector(level, sectorIndex, worker.batch, loopCache);
+				worker.batch.Write(level, chunkWriter);
+				chunkWriter.Flush();
+				if (cache != nullptr)
+					cache->Store(key, worker.sink.data, failed);
+			}
+		}
+
+		// Write every chunk that's ready, in canonical order
+		std::unique_lock<std::mutex> guard(commitLock);
+		chunks[task].text.swap(worker.sink.data);
+		chunks[task].done = true;
+		chunks[task].failed = failed;
+		worker.sink.data.clear();
+
+		while (nextChunk < taskCount && chunks[nextChunk].done) {
+			Chunk& chunk = chunks[nextChunk];
+			if(chunk.failed)
+				settings.events.Reportf(EVENT_WARNING, "Unable to generate floors/ceilings for Sector %i", nextChunk - lineTasks);
+			writer.WriteRaw(chunk.text.data(), chunk.text.length());
+			std::string().swap(chunk.text);
+			nextChunk++;
+		}
+		committed.notify_all();
+	};
+	ParallelForChecked(taskCount, jobs, [&](size_t scheduleIndex, int workerIndex) {
+		try {
+			formatTask(scheduleIndex, workerIndex);
+		}
+		catch (...) {
+			// The failed chunk is never written, so wake any task waiting for it
+			std::lock_guard<std::mutex> guard(commitLock);
+			aborted = true;
+			committed.notify_all();
+			throw;
+		}
+	});
+
+	if (settings.portals && !settings.clip)
+		writePortals();
+	if (settings.prefabs != nullptr)
+		WritePrefabs(level, prefabs, settings, writer);
+	if (settings.lights)
+		WriteLights(level, settings, writer);
+	if (settings.things != nullptr)
+		WriteThings(level, settings, writer);
+
+	// FINISH UP
+	writer.Finish();
+}
+
+template<typename Sink>
+void BuildLevelMesh(WadLevel& level, Sink& sink, const BuildSettings& settings) {
+	BuildSectorLines(level);
+
+	// Surfaces of prefab copies are in the prefab maps, and must not be in the mesh too
+	LevelPrefabs prefabs;
+	if (settings.prefabs != nullptr)
+		FindPrefabs(level, prefabs);
+
+	// Same tasks as BuildLevel. Each is converted into its own list of triangles,
+	// which are added to the mesh in canonical order once every task is done.
+	int jobs = settings.jobs < 1 ? 1 : settings.jobs;
+	int32_t lineTasks = settings.walls ? (level.linedefs.Num() + LINEDEFS_PER_TASK - 1) / LINEDEFS_PER_TASK : 0;
+	int32_t taskCount = lineTasks + (settings.floors ? level.sectors.Num() : 0);
+
+	struct Chunk {
+		std::vector<MeshTriangle> triangles;
+		bool failed = false;
+	};
+	std::vector<BrushBatch> batches(jobs);
+	std::vector<Chunk> chunks(taskCount);
+	uint32_t handleBase = LevelHandleBase(level.lumpHeader->name);
+	SectorLoopCache* loopCache = settings.loopCache;
+	if (loopCache != nullptr && loopCache->Num() != level.sectors.Num())
+		loopCache = nullptr;
+
+	ParallelForChecked(taskCount, jobs, [&](size_t taskIndex, int workerIndex) {
+		int32_t task = static_cast<int32_t>(taskIndex);
+		BrushBatch& batch = batches[workerIndex];
+		MeshWriter writer(level);
+
+		batch.Clear();
+		batch.handleBase = handleBase;
+		if (task < lineTasks) {
+			int32_t max = std::min(level.linedefs.Num(), (task + 1) * LINEDEFS_PER_TASK);
+			for (int32_t i = task * LINEDEFS_PER_TASK; i < max; i++)
+				if (!prefabs.LineInstanced(i))
+					QueueLineDef(level, i, batch);
+			batch.planes.Compute();
+			batch.WriteWalls(writer, 0, batch.walls.size());
+		}
+		else if (!prefabs.SectorInstanced(task - lineTasks)) {
+			chunks[task].failed = !QueueSector(level, task - lineTasks, batch, loopCache);
+			batch.WriteTriangles(level, writer);
+		}
+		chunks[task].triangles.swap(writer.triangles);
+	});
+
+	ObjWriter mesh;
+	for (int32_t i = 0; i < taskCount; i++) {
+		if (chunks[i].failed)
+			settings.events.Reportf(EVENT_WARNING, "Unable to generate floors/ceilings for Sector %i", i - lineTasks);
+		mesh.Add(chunks[i].triangles);
+		std::vector<MeshTriangle>().swap(chunks[i].triangles);
+	}
+	mesh.Write(sink, level.lumpHeader->name.Data(), settings.precision);
+}
+
+template void BuildLevel<FileSink>(WadLevel& level, FileSink& sink, const BuildSettings& settings);
+template void BuildLevel<AsyncFileSink>(WadLevel& level, AsyncFileSink& sink, const BuildSettings& settings);
+template void BuildLevel<MemorySink>(WadLevel& level, MemorySink& sink, const BuildSettings& settings);
+template void BuildLevel<StdoutSink>(WadLevel& level, StdoutSink& sink, const BuildSettings& settings);
+template void BuildLevel<CountingSink>(WadLevel& level, CountingSink& sink, const BuildSettings& settings);
+template void BuildLevel<CallbackSink>(WadLevel& level, CallbackSink& sink, const BuildSettings& settings);
+template void BuildLevel<BufferSink>(WadLevel& level, BufferSink& sink, const BuildSettings& settings);
+
+template void BuildLevelMesh<FileSink>(WadLevel& level, FileSink& sink, const BuildSettings& settings);
+template void BuildLevelMesh<AsyncFileSink>(WadLevel& level, AsyncFileSink& sink, const BuildSettings& settings);
+template void BuildLevelMesh<MemorySink>(WadLevel& level, MemorySink& sink, const BuildSettings& settings);
+template void BuildLevelMesh<StdoutSink>(WadLevel& level, StdoutSink& sink, const BuildSettings& settings);
+template void BuildLevelMesh<CountingSink>(WadLevel& level, CountingSink& sink, const BuildSettings& settings);
@@ -0,0 +1,110 @@
+#pragma once
+#include "MapWriter.h"
+#include "MeshWriter.h"
+#include "Events.h"
+#include "LevelCache.h"
+#include "AreaBuilder.h"
+#include "ClipBuilder.h"
+#include "LightBuilder.h"
+#include "ThingBuilder.h"
+#include "PrefabBuilder.h"
+#include <mutex>
+
+/*
+* The order in which a sector's linedefs join into a single closed loop, for
+* triangulating its floor and ceiling. It's built from the WAD's untransformed
+* vertices, so it's the same for every set of transforms.
+*/
+struct SectorLoop {
+	struct Edge {
+		int32_t line;   // Index into Sector::lines
+		bool reversed;  // The loop runs from the linedef's v1 to its v0
+	};
+	std::vector<Edge> edges;
+	bool complete = false; // False if the linedefs don't form a single loop
+};
+
+// Returns false if the sector's linedefs do not form a single loop
+bool SortSectorLoop(const Sector& sector, SectorLoop& loop);
+
+/*
+* Sector loops of a single level, sorted the first time each is needed. Sorting is
+* quadratic in the number of linedefs, so keeping this between conversions of the
+* same level saves most of the floor construction work. Safe to share between
+* threads and between conversions running at once.
+*/
+class SectorLoopCache {
+	private:
+	std::vector<SectorLoop> loops;
+	std::unique_ptr<std::once_flag[]> sorted;
+
+	public:
+	SectorLoopCache(int32_t sectorCount);
+	const SectorLoop& Get(int32_t sectorIndex, const Sector& sector);
+
+	int32_t Num() const {
+		return static_cast<int32_t>(loops.size());
+	}
+};
+
+// Options controlling how a level is converted
+struct BuildSettings {
+	int jobs = 1;        // Threads to convert with
+	int precision = -1;  // Decimals written for each number, or negative for the shortest exact form
+	EventSink events;    // Receives warnings about geometry that could not be converted
+	SectorLoopCache* loopCache = nullptr; // Reuses sector loops from earlier conversions of the level
+	LevelCache* cache = nullptr;          // Reuses brushes from earlier conversions, and stores the new ones
+	bool walls = true;   // Convert the walls
+	bool floors = true;  // Convert the floors and ceilings
+	float gridSize = 0;  // Splits brushes into square cells this wide, or 0 to write them in canonical order
+	bool portals = false; // Splits the level into areas with visportals, see AreaBuilder.h
+	bool clip = false;    // Adds a player clip hull and makes the drawn brushes non-solid, see ClipBuilder.h
+	bool lights = false;  // Adds lights approximating the sectors' light levels, see LightBuilder.h
+	LightSettings lighting;
+	const ThingTable* things = nullptr; // Converts the things with an entry in the table, see ThingBuilder.h
+	PrefabLibrary* prefabs = nullptr;   // Writes repeated structures once to this library and places copies of them, see PrefabBuilder.h
+};
+
+// Class of the entities holding each grid cell's brushes, or the drawn brushes alongside a clip hull
+#define GRID_ENTITY_INHERIT "func_static"
+
+/*
+* Converts an entire level into brushes, writing the completed map to the sink.
+*
+* Each block of linedefs and each sector is converted independently, into its
+* own text chunk, spread across the given number of threads. Chunks are written
+* to the sink in the same order regardless of how many threads are used, so the
+* output is byte-identical to a single-threaded conversion.
+*
+* If a grid size is set, brushes are instead split into square cells by their
+* position, and each cell is written as its own entity, named [Map]_cell_X_Y.
+* Within a cell, brushes are sorted along a Morton curve, so brushes close to
+* each other in the level are close to each other in the file. The level cache
+* is not used. Visportals must seal areas, so they stay in the worldspawn.
+*
+* With a clip hull, the hull is written to the worldspawn and every drawn brush
+* to non-solid entities: [Map]_render, or each grid cell. Prefab copies, lights
+* and things are written last, each as its own entity named
+* [Map]_prefab_[Linedef], [Map]_light_[Sector] or [Map]_thing_[Index]. A prefab
+* copy is named after its lowest numbered linedef, and its linedefs and
+* enclosed sectors are left out of the brushes.
+*/
+template<typename Sink>
+void BuildLevel(WadLevel& level, Sink& sink, const BuildSettings& settings = BuildSettings());
+
+/*
+* Splits the level into grid cells as BuildLevel does, but writes each cell to
+* its own map, [basePath]_X_Y.map, so it can be loaded separately. Cells are
+* written in parallel, and visportals go in the cell holding their midpoint.
+* The clip hull, light, thing and prefab settings are ignored. Returns false if a file could not be created.
+*/
+bool BuildLevelCells(WadLevel& level, const std::string& basePath, const BuildSettings& settings);
+
+/*
+* Converts the walls and floors selected in the settings into a triangle mesh,
+* written to the sink as a Wavefront OBJ. Like BuildLevel, the work is spread
+* across threads and the output is the same for any number of them. With a
+* prefab library, the surfaces BuildLevel places as prefab copies are left out.
+*/
+template<typename Sink>
+void BuildLevelMesh(WadLevel& level, Sink& sink, const BuildSettings& settings = BuildSettings());
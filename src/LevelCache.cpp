@@ -0,0 +1,130 @@
+#include "LevelCache.h"
+#include <cstdio>
+#include <fstream>
+
+const char cacheMagic[8] = {'W', '2', 'B', 'C', 'A', 'C', 'H', 'E'};
+
+// Reads a value from the buffer, returning false if it runs past the end
+template<typename T>
+bool ReadValue(const std::string& buffer, size_t& pos, T& value) {
+	if (buffer.length() - pos < sizeof(T))
+		return false;
+	memcpy(&value, buffer.data() + pos, sizeof(T));
+	pos += sizeof(T);
+	return true;
+}
+
+void LevelCache::Load(const std::string& path) {
+	std::lock_guard<std::mutex> guard(lock);
+	entries.clear();
+	dirty = true;
+
+	// Read the whole file at once - caches are as large as the map itself
+	std::ifstream file(path, std::ios_base::binary | std::ios_base::ate);
+	if (file.fail())
+		return;
+	std::string buffer(static_cast<size_t>(file.tellg()), '\0');
+	file.seekg(0, std::ios_base::beg);
+	file.read(&buffer[0], buffer.length());
+	if (file.fail())
+		return;
+
+	size_t pos = sizeof(cacheMagic);
+	uint32_t version = 0;
+	uint64_t count = 0;
+	if (buffer.length() < pos || memcmp(buffer.data(), cacheMagic, pos) != 0
+		|| !ReadValue(buffer, pos, version) || version != LEVEL_CACHE_VERSION || !ReadValue(buffer, pos, count))
+		return;
+
+	// Every entry takes at least its header, so a larger count is corrupt
+	const size_t entryHeader = sizeof(uint64_t) + sizeof(uint8_t) + sizeof(uint32_t);
+	if (count > (buffer.length() - pos) / entryHeader)
+		return;
+	entries.reserve(static_cast<size_t>(count));
+	for (uint64_t i = 0; i < count; i++) {
+		uint64_t key = 0;
+		uint8_t failed = 0;
+		uint32_t length = 0;
+		if (!ReadValue(buffer, pos, key) || !ReadValue(buffer, pos, failed) || !ReadValue(buffer, pos, length)
+			|| buffer.length() - pos < length)
+		{
+			// A truncated cache is only partly trustworthy
+			entries.clear();
+			return;
+		}
+
+		Entry& entry = entries[key];
+		entry.failed = failed != 0;
+		entry.text.assign(buffer.data() + pos, length);
+		pos += length;
+	}
+	dirty = false;
+}
+
+bool LevelCache::Save(const std::string& path) {
+	std::lock_guard<std::mutex> guard(lock);
+
+	// Nothing to do if every entry was reused and nothing new was generated
+	bool allUsed = true;
+	for (const auto& pair : entries)
+		allUsed = allUsed && pair.second.used;
+	if (!dirty && allUsed)
+		return true;
+
+	// Write a temporary file first, so a crash never leaves a half-written cache behind
+	std::string tempPath = path + ".tmp";
+	{
+		std::ofstream file(tempPath, std::ios_base::binary);
+		if (file.fail())
+			return false;
+
+		uint32_t version = LEVEL_CACHE_VERSION;
+		uint64_t count = 0;
+		for (const auto& pair : entries)
+			if (pair.second.used)
+				count++;
+		file.write(cacheMagic, sizeof(cacheMagic));
+		file.write(reinterpret_cast<const char*>(&version), sizeof(version));
+		file.write(reinterpret_cast<const char*>(&count), sizeof(count));
+
+		for (const auto& pair : entries) {
+			if (!pair.second.used)
+				continue;
+			uint8_t failed = pair.second.failed ? 1 : 0;
+			uint32_t length = static_cast<uint32_t>(pair.second.text.length());
+			file.write(reinterpret_cast<const char*>(&pair.first), sizeof(pair.first));
+			file.write(reinterpret_cast<const char*>(&failed), sizeof(failed));
+			file.write(reinterpret_cast<const char*>(&length), sizeof(length));
+			file.write(pair.second.text.data(), length);
+		}
+		if (file.fail())
+			return false;
+	}
+	dirty = false;
+
+	remove(path.data());
+	return rename(tempPath.data(), path.data()) == 0;
+}
+
+bool LevelCache::Find(uint64_t key, std::string& text, bool& failed) {
+	std::lock_guard<std::mutex> guard(lock);
+	auto found = entries.find(key);
+	if (found == entries.end()) {
+		misses++;
+		return false;
+	}
+	found->second.used = true;
+	text = found->second.text;
+	failed = found->second.failed;
+	hits++;
+	return true;
+}
+
+void LevelCache::Store(uint64_t key, const std::string& text, bool failed) {
+	std::lock_guard<std::mutex> guard(lock);
+	Entry& entry = entries[key];
+	entry.text = text;
+	entry.failed = failed;
+	entry.used = true;
+	dirty = true;
+}
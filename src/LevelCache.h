@@ -0,0 +1,64 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+// Change whenever the generated brushes change, so stale caches are discarded
+#define LEVEL_CACHE_VERSION 2
+
+// FNV-1a over the records a piece of the map is generated from
+struct CacheKey {
+	uint64_t hash = 14695981039346656037ULL;
+
+	void Add(const void* data, size_t length) {
+		const unsigned char* bytes = static_cast<const unsigned char*>(data);
+		for (size_t i = 0; i < length; i++) {
+			hash ^= bytes[i];
+			hash *= 1099511628211ULL;
+		}
+	}
+
+	template<typename T>
+	void Add(const T& value) {
+		Add(&value, sizeof(T));
+	}
+};
+
+/*
+* Brushes generated for each linedef and sector by an earlier conversion, kept
+* between runs so only the parts of a level that changed are generated again.
+*
+* Each entry is keyed by a hash of every record its brushes depend on, so an edit
+* to a vertex, sidedef, sector or texture simply misses the entries it affects,
+* without any explicit invalidation. Only entries used since loading are saved,
+* so the cache doesn't grow as a level is edited.
+*
+* Safe to share between the threads converting a level.
+*/
+class LevelCache {
+	private:
+	struct Entry {
+		std::string text;
+		bool failed = false;
+		bool used = false;
+	};
+
+	std::unordered_map<uint64_t, Entry> entries;
+	std::mutex lock;
+	bool dirty = false; // Differs from the file it was loaded from
+
+	public:
+	std::atomic<size_t> hits{0};
+	std::atomic<size_t> misses{0};
+
+	// Starts empty if the file is missing, corrupt or from another version
+	void Load(const std::string& path);
+	bool Save(const std::string& path);
+
+	// Returns false on a miss
+	bool Find(uint64_t key, std::string& text, bool& failed);
+	void Store(uint64_t key, const std::string& text, bool failed);
+};
@@ -0,0 +1,214 @@
+#include "LightBuilder.h"
+#include <numeric>
+#include <algorithm>
+#include <cmath>
+
+// Clusters darker than this light level emit no light
+#define LIGHT_MIN_LEVEL 48
+
+// Added to each side of a light's box, in Doom units, so light reaches the walls
+#define LIGHT_PADDING 64.0f
+
+// Area, centroid and bounds of a single sector
+struct SectorShape {
+	double area = 0;
+	double cx = 0;
+	double cy = 0;
+	float minX = FLT_MAX, minY = FLT_MAX, maxX = -FLT_MAX, maxY = -FLT_MAX;
+};
+
+// Sectors joined into a single light
+struct LightCluster {
+	double area = 0;
+	double level = 0; // Weighted by area
+	float minX = FLT_MAX, minY = FLT_MAX, maxX = -FLT_MAX, maxY = -FLT_MAX;
+	float minZ = FLT_MAX, maxZ = -FLT_MAX;
+	int32_t sector = -1;
+};
+
+/*
+* Sums each sector's area and centroid over the sides of its linedefs. A sector
+* is on the right of its front sides and the left of its back sides, so every
+* sector is traversed the same way round, and holes are subtracted without
+* having to sort the linedefs into loops.
+*/
+void MeasureSectors(const WadLevel& level, std::vector<SectorShape>& shapes) {
+	shapes.assign(level.sectors.Num(), SectorShape());
+	for (int32_t i = 0; i < level.linedefs.Num(); i++) {
+		const LineDef& line = level.linedefs[i];
+		if (line.sideFront == NO_SIDEDEF)
+			continue;
+		const Vertex& v0 = level.vertices[line.vertexStart];
+		const Vertex& v1 = level.vertices[line.vertexEnd];
+		double cross = static_cast<double>(v0.x) * v1.y - static_cast<double>(v1.x) * v0.y;
+
+		uint16_t sides[2] = {line.sideFront, line.sideBack};
+		for (int s = 0; s < 2; s++) {
+			if (sides[s] == NO_SIDEDEF)
+				continue;
+			SectorShape& shape = shapes[level.sidedefs[sides[s]].sector];
+			double sign = s == 0 ? -1 : 1; // Clockwise around the front
+			shape.area += sign * cross;
+			shape.cx += sign * cross * (v0.x + v1.x);
+			shape.cy += sign * cross * (v0.y + v1.y);
+			shape.minX = std::min(shape.minX, static_cast<float>(std::min(v0.x, v1.x)));
+			shape.minY = std::min(shape.minY, static_cast<float>(std::min(v0.y, v1.y)));
+			shape.maxX = std::max(shape.maxX, static_cast<float>(std::max(v0.x, v1.x)));
+			shape.maxY = std::max(shape.maxY, static_cast<float>(std::max(v0.y, v1.y)));
+		}
+	}
+
+	// Levels drawn the wrong way round have every area negated
+	for (SectorShape& shape : shapes) {
+		if (shape.area < 0) {
+			shape.area = -shape.area;
+			shape.cx = -shape.cx;
+			shape.cy = -shape.cy;
+		}
+		if (shape.area > 0) {
+			shape.cx /= 3 * shape.area;
+			shape.cy /= 3 * shape.area;
+			shape.area /= 2;
+		}
+	}
+}
+
+/*
+* Clusters the sectors, with each area's grid and tolerance coarsened the given
+* number of times. Returns each sector's cluster root.
+*/
+void ClusterSectors(const WadLevel& level, const LevelAreas& areas, const std::vector<SectorShape>& shapes,
+	const LightSettings& settings, const std::vector<int>& coarsening, std::vector<int32_t>& parents)
+{
+	int32_t sectorCount = level.sectors.Num();
+	parents.resize(sectorCount);
+	std::iota(parents.begin(), parents.end(), 0);
+
+	// The lowest and highest light level in each cluster, kept at its root
+	std::vector<int16_t> minLevel(sectorCount), maxLevel(sectorCount);
+	for (int32_t i = 0; i < sectorCount; i++)
+		minLevel[i] = maxLevel[i] = level.sectors[i].lightLevel;
+
+	auto cellOf = [&](int32_t sector, float cellSize, int64_t& x, int64_t& y) {
+		x = static_cast<int64_t>(floor(shapes[sector].cx / cellSize));
+		y = static_cast<int64_t>(floor(shapes[sector].cy / cellSize));
+	};
+
+	for (int32_t i = 0; i < level.linedefs.Num(); i++) {
+		const LineDef& line = level.linedefs[i];
+		if (line.sideFront == NO_SIDEDEF || line.sideBack == NO_SIDEDEF)
+			continue;
+		int32_t a = level.sidedefs[line.sideFront].sector;
+		int32_t b = level.sidedefs[line.sideBack].sector;
+		int32_t area = areas.sectorAreas[a];
+		if (area != areas.sectorAreas[b] || shapes[a].area == 0 || shapes[b].area == 0)
+			continue;
+
+		float cellSize = settings.cellSize * static_cast<float>(1 << coarsening[area]);
+		int64_t ax, ay, bx, by;
+		cellOf(a, cellSize, ax, ay);
+		cellOf(b, cellSize, bx, by);
+		if (ax != bx || ay != by)
+			continue;
+
+		int32_t rootA = FindRoot(parents, a);
+		int32_t rootB = FindRoot(parents, b);
+		if (rootA == rootB)
+			continue;
+		int16_t low = std::min(minLevel[rootA], minLevel[rootB]);
+		int16_t high = std::max(maxLevel[rootA], maxLevel[rootB]);
+		if (high - low > settings.tolerance << std::min(coarsening[area], 8)) // Past 8 doublings, any level is in range
+			continue;
+
+		// The lower index stays the root, so clusters are numbered the same way every time
+		if (rootB < rootA)
+			std::swap(rootA, rootB);
+		parents[rootB] = rootA;
+		minLevel[rootA] = low;
+		maxLevel[rootA] = high;
+	}
+}
+
+void BuildLights(const WadLevel& level, const LevelAreas& areas, const LightSettings& settings, std::vector<SectorLight>& lights) {
+	lights.clear();
+	int32_t sectorCount = level.sectors.Num();
+	if (sectorCount == 0 || settings.maxPerArea < 1 || settings.budget < 1)
+		return;
+
+	std::vector<SectorShape> shapes;
+	MeasureSectors(level, shapes);
+
+	// Coarsen each area that has too many clusters, until they all fit
+	std::vector<int> coarsening(areas.areaCount, 0);
+	std::vector<int32_t> parents;
+	std::vector<int32_t> areaClusters(areas.areaCount);
+	for (bool coarsened = true; coarsened; ) {
+		ClusterSectors(level, areas, shapes, settings, coarsening, parents);
+
+		std::fill(areaClusters.begin(), areaClusters.end(), 0);
+		for (int32_t i = 0; i < sectorCount; i++)
+			if (shapes[i].area > 0 && FindRoot(parents, i) == i)
+				areaClusters[areas.sectorAreas[i]]++;
+
+		// Past 30 doublings every sector linked to another is in the same cell
+		coarsened = false;
+		for (int32_t a = 0; a < areas.areaCount; a++) {
+			if (areaClusters[a] > settings.maxPerArea && coarsening[a] < 30) {
+				coarsening[a]++;
+				coarsened = true;
+			}
+		}
+	}
+
+	// Total up each cluster
+	std::vector<LightCluster> clusters(sectorCount);
+	for (int32_t i = 0; i < sectorCount; i++) {
+		const SectorShape& shape = shapes[i];
+		if (shape.area == 0)
+			continue;
+		const Sector& sector = level.sectors[i];
+		LightCluster& c = clusters[FindRoot(parents, i)];
+		if (c.sector < 0)
+			c.sector = i;
+		c.area += shape.area;
+		c.level += shape.area * sector.lightLevel;
+		c.minX = std::min(c.minX, shape.minX);
+		c.minY = std::min(c.minY, shape.minY);
+		c.maxX = std::max(c.maxX, shape.maxX);
+		c.maxY = std::max(c.maxY, shape.maxY);
+		c.minZ = std::min(c.minZ, sector.floorHeight);
+		c.maxZ = std::max(c.maxZ, sector.ceilHeight);
+	}
+
+	// Keep the lights contributing the most, up to the budget
+	std::vector<LightCluster*> lit;
+	for (LightCluster& c : clusters) {
+		if (c.sector < 0)
+			continue;
+		c.level /= c.area;
+		if (c.level >= LIGHT_MIN_LEVEL)
+			lit.push_back(&c);
+	}
+	if (lit.size() > static_cast<size_t>(settings.budget)) {
+		std::stable_sort(lit.begin(), lit.end(), [](const LightCluster* a, const LightCluster* b) {
+			return a->area * a->level > b->area * b->level;
+		});
+		lit.resize(settings.budget);
+		std::sort(lit.begin(), lit.end(), [](const LightCluster* a, const LightCluster* b) {
+			return a->sector < b->sector;
+		});
+	}
+
+	const VertexTransforms& tforms = level.transforms;
+	float padding = LIGHT_PADDING / tforms.xyDownscale;
+	for (const LightCluster* c : lit) {
+		SectorLight light;
+		light.origin = Vector(((c->minX + c->maxX) * 0.5f + tforms.xShift) / tforms.xyDownscale,
+			((c->minY + c->maxY) * 0.5f + tforms.yShift) / tforms.xyDownscale, (c->minZ + c->maxZ) * 0.5f);
+		light.radius = Vector((c->maxX - c->minX) * 0.5f / tforms.xyDownscale + padding,
+			(c->maxY - c->minY) * 0.5f / tforms.xyDownscale + padding, (c->maxZ - c->minZ) * 0.5f + LIGHT_PADDING / tforms.zDownscale);
+		light.brightness = std::min(1.0f, static_cast<float>(c->level) / 255.0f);
+		light.sector = c->sector;
+		lights.push_back(light);
+	}
+}
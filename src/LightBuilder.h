@@ -0,0 +1,38 @@
+#pragma once
+#include "BrushBuilder.h"
+#include "AreaBuilder.h"
+
+/*
+* Sector Lights
+*
+* Approximates each sector's light level with a bounded number of point lights.
+* Rather than one light per sector, neighbouring sectors are clustered:
+* - Sectors are binned into a square grid by their centroid
+* - Within a cell, sectors joined by a two-sided linedef are merged while the
+*   light levels in the cluster stay within a tolerance of each other
+* - Clusters never cross from one area to another (see AreaBuilder.h)
+*
+* Any area with more clusters than allowed is clustered again with a grid and
+* tolerance twice as coarse, until it fits. Each cluster becomes one light
+* centered on its sectors' bounds and sized to cover them, with their
+* area-weighted light level. Clusters too dark to be seen emit nothing, and if
+* the level still has more lights than its budget, those lighting the least
+* (by area times brightness) are dropped.
+*/
+
+struct LightSettings {
+	int maxPerArea = 8;     // Lights in each area
+	int budget = 256;       // Lights in the level
+	float cellSize = 512;   // Initial grid cell width, in Doom units
+	int tolerance = 16;     // Initial difference in light level allowed within a cluster
+};
+
+struct SectorLight {
+	Vector origin;     // With the level's transforms applied
+	Vector radius;     // Half the size of the lit box on each axis
+	float brightness;  // From 0 to 1
+	int32_t sector;    // Lowest numbered sector in the cluster
+};
+
+// Lights are returned in the order of their lowest numbered sector
+void BuildLights(const WadLevel& level, const LevelAreas& areas, const LightSettings& settings, std::vector<SectorLight>& lights);
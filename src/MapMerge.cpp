@@ -0,0 +1,209 @@
+#include "MapMerge.h"
+#include "BrushBuilder.h"
+#include "MapSinks.h"
+#include <cstring>
+#include <unordered_map>
+#include <vector>
+
+// A brush block, "{ handle = N brushDef3 { ... } }", and the newline following it
+struct BrushSpan {
+	uint32_t handle;
+	size_t start;
+	size_t end;
+};
+
+/*
+* Scans map text for the converter's brushes in the bands of the level at handleBase.
+* Also finds the closing brace of the first top-level block, which is the
+* worldspawn entity, for adding new brushes to.
+*/
+class MapScanner {
+	private:
+	const char* text;
+	size_t length;
+	size_t pos = 0;
+
+	bool IsSpace(char c) const {
+		return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+	}
+
+	void SkipSpace(size_t& p) const {
+		while (p < length && IsSpace(text[p]))
+			p++;
+	}
+
+	bool Match(size_t& p, const char* word, size_t wordLength) const {
+		if (length - p < wordLength || memcmp(text + p, word, wordLength) != 0)
+			return false;
+		p += wordLength;
+		return true;
+	}
+
+	// Reads "handle = N brushDef3" following the brace at p, if present
+	bool ReadBrushHeader(size_t p, uint32_t& handle) const {
+		p++;
+		SkipSpace(p);
+		if (!Match(p, "handle", 6))
+			return false;
+		SkipSpace(p);
+		if (!Match(p, "=", 1))
+			return false;
+		SkipSpace(p);
+
+		uint64_t value = 0;
+		size_t digits = p;
+		while (p < length && text[p] >= '0' && text[p] <= '9' && p - digits < 10)
+			value = value * 10 + (text[p++] - '0');
+		if (p == digits || value > UINT32_MAX)
+			return false;
+		handle = static_cast<uint32_t>(value);
+
+		SkipSpace(p);
+		return Match(p, "brushDef3", 9);
+	}
+
+	// Moves p past a quoted string or comment starting at p. Returns false if there's neither
+	bool SkipLiteral(size_t& p) const {
+		if (text[p] == '"') {
+			for (p++; p < length && text[p] != '"'; p++)
+				if (text[p] == '\\')
+					p++;
+			p++;
+			return true;
+		}
+		if (text[p] == '/' && p + 1 < length && text[p + 1] == '/') {
+			while (p < length && text[p] != '\n')
+				p++;
+			return true;
+		}
+		return false;
+	}
+
+	public:
+	size_t worldspawnEnd = SIZE_MAX; // Position of the worldspawn entity's closing brace
+
+	MapScanner(const char* p_text, size_t p_length) : text(p_text), length(p_length) {}
+
+	template<typename F>
+	void Scan(uint32_t handleBase, F onBrush) {
+		int32_t depth = 0;
+		while (pos < length) {
+			char c = text[pos];
+			if (SkipLiteral(pos))
+				continue;
+
+			if (c == '{') {
+				uint32_t handle;
+				if (ReadBrushHeader(pos, handle) && IsLevelHandle(handle, handleBase)) {
+					BrushSpan span = {handle, pos, pos};
+					for (int32_t brushDepth = 0; pos < length; ) {
+						if (SkipLiteral(pos))
+							continue;
+						if (text[pos] == '{')
+							brushDepth++;
+						else if (text[pos] == '}' && --brushDepth == 0) {
+							pos++;
+							break;
+						}
+						pos++;
+					}
+					if (pos < length && text[pos] == '\r')
+						pos++;
+					if (pos < length && text[pos] == '\n')
+						pos++;
+					span.end = pos;
+					onBrush(span);
+					continue;
+				}
+				depth++;
+			}
+			else if (c == '}') {
+				if (--depth == 0 && worldspawnEnd == SIZE_MAX)
+					worldspawnEnd = pos;
+			}
+			pos++;
+		}
+	}
+};
+
+template<typename Sink>
+bool MergeMap(const char* existing, size_t existingLength, const char* generated, size_t generatedLength,
+	uint32_t handleBase, Sink& sink, MergeStats& stats)
+{
+	// Index the regenerated brushes, in the order they were generated
+	std::vector<BrushSpan> fresh;
+	std::unordered_map<uint32_t, size_t> freshIndex;
+	MapScanner(generated, generatedLength).Scan(handleBase, [&](const BrushSpan& span) {
+		freshIndex[span.handle] = fresh.size();
+		fresh.push_back(span);
+	});
+	std::vector<bool> placed(fresh.size(), false);
+
+	// Find the converter's brushes in the existing map
+	std::vector<BrushSpan> old;
+	MapScanner scanner(existing, existingLength);
+	scanner.Scan(handleBase, [&](const BrushSpan& span) {
+		old.push_back(span);
+	});
+	if (scanner.worldspawnEnd == SIZE_MAX)
+		return false;
+
+	// New brushes go before the blank line that precedes the worldspawn's closing brace
+	size_t insertAt = scanner.worldspawnEnd;
+	if (insertAt > 0 && existing[insertAt - 1] == '\n')
+		insertAt--;
+
+	stats = MergeStats();
+	size_t copied = 0;
+	auto copyUntil = [&](size_t end) {
+		if (end > copied)
+			sink.Write(existing + copied, end - copied);
+		copied = end;
+	};
+	auto addNewBrushes = [&] {
+		for (size_t i = 0; i < fresh.size(); i++) {
+			if (placed[i])
+				continue;
+			sink.Write(generated + fresh[i].start, fresh[i].end - fresh[i].start);
+			stats.added++;
+		}
+	};
+
+	// Brushes already placed must be known before new ones are added, so old
+	// brushes after the worldspawn's end are matched up front
+	for (const BrushSpan& span : old) {
+		auto found = freshIndex.find(span.handle);
+		if (found != freshIndex.end())
+			placed[found->second] = true;
+	}
+
+	bool added = false;
+	for (const BrushSpan& span : old) {
+		if (!added && span.start >= insertAt) {
+			copyUntil(insertAt);
+			addNewBrushes();
+			added = true;
+		}
+		copyUntil(span.start);
+
+		auto found = freshIndex.find(span.handle);
+		if (found != freshIndex.end()) {
+			const BrushSpan& replacement = fresh[found->second];
+			sink.Write(generated + replacement.start, replacement.end - replacement.start);
+			stats.replaced++;
+		}
+		else stats.removed++;
+		copied = span.end;
+	}
+	if (!added) {
+		copyUntil(insertAt);
+		addNewBrushes();
+	}
+	copyUntil(existingLength);
+	return true;
+}
+
+template bool MergeMap<FileSink>(const char* existing, size_t existingLength, const char* generated, size_t generatedLength,
+	uint32_t handleBase, FileSink& sink, MergeStats& stats);
+template bool MergeMap<MemorySink>(const char* existing, size_t existingLength, const char* generated, size_t generatedLength,
+	uint32_t handleBase, MemorySink& sink, MergeStats& stats);
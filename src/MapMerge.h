@@ -0,0 +1,29 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+
+/*
+* Merges a freshly generated map into an existing one that may have been edited
+* by hand, so lights, entities and detail brushes added in the editor survive a
+* reconversion.
+*
+* The converter's brushes are recognized by their handles, which fall in bands
+* reserved for the level (see LevelHandleBase and ExtraHandle). Each of them in the existing map
+* is replaced in place by the regenerated brush with the same handle, or dropped
+* if the linedef or sector it came from no longer produces it. Regenerated brushes
+* that are new are added to the end of the worldspawn entity. Every other byte
+* of the existing map is copied through untouched.
+*
+* Both maps are scanned once, front to back, and unchanged text is written in
+* large spans straight from the input buffer.
+*/
+struct MergeStats {
+	size_t replaced = 0;
+	size_t removed = 0;
+	size_t added = 0;
+};
+
+// Returns false if the existing map has no entity to add new brushes to
+template<typename Sink>
+bool MergeMap(const char* existing, size_t existingLength, const char* generated, size_t generatedLength,
+	uint32_t handleBase, Sink& sink, MergeStats& stats);
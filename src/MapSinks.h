@@ -0,0 +1,176 @@
+#pragma once
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <thread>
+#include "Parallel.h"
+
+/*
+* Output sinks for MapWriter. The MapWriter formats brushes into a small
+* TextBuffer and hands it to the sink in fixed-size chunks as brushes are emitted,
+* so memory use does not grow with the size of the map. Any class providing
+* Write(const char*, size_t) and Close() can be used as a sink. Sinks writing
+* files also provide Failed(), to check once they're closed.
+*/
+
+// Streams chunks directly to a file on disk
+class FileSink {
+	private:
+	std::ofstream file;
+
+	public:
+	bool Open(const std::string& path) {
+		file.open(path, std::ios_base::binary);
+		return !file.fail();
+	}
+
+	void Write(const char* data, size_t length) {
+		file.write(data, length);
+	}
+
+	void Close() {
+		file.close();
+	}
+
+	// True if any write, or closing the file, failed
+	bool Failed() const {
+		return file.fail();
+	}
+};
+
+/*
+* Streams chunks to a file from a dedicated writer thread, so formatting never
+* waits on the disk. At most QUEUE_CHUNKS chunks are held in memory - once the
+* queue is full, Write blocks until the writer thread catches up.
+*/
+class AsyncFileSink {
+	private:
+	static constexpr size_t QUEUE_CHUNKS = 16;
+
+	std::ofstream file;
+	BoundedQueue<std::string> queue;
+	std::thread writerThread;
+
+	public:
+	AsyncFileSink() : queue(QUEUE_CHUNKS) {}
+
+	~AsyncFileSink() {
+		Close();
+	}
+
+	bool Open(const std::string& path) {
+		file.open(path, std::ios_base::binary);
+		if (file.fail())
+			return false;
+
+		// Chunks are still drained after a failed write, so Write never blocks forever
+		writerThread = std::thread([this] {
+			std::string chunk;
+			while (queue.Pop(chunk))
+				if (!file.fail())
+					file.write(chunk.data(), chunk.length());
+		});
+		return true;
+	}
+
+	void Write(const char* data, size_t length) {
+		queue.Push(std::string(data, length));
+	}
+
+	void Close() {
+		if (!writerThread.joinable())
+			return;
+		queue.Close();
+		writerThread.join();
+		file.close();
+	}
+
+	// True if any write, or closing the file, failed. Only valid after Close
+	bool Failed() const {
+		return file.fail();
+	}
+};
+
+// Collects the entire output in memory
+class MemorySink {
+	public:
+	std::string data;
+
+	void Write(const char* p_data, size_t length) {
+		data.append(p_data, length);
+	}
+
+	void Close() {}
+};
+
+// Streams chunks to stdout, allowing the output to be piped into another program
+class StdoutSink {
+	public:
+	void Write(const char* data, size_t length) {
+		fwrite(data, 1, length, stdout);
+	}
+
+	void Close() {
+		fflush(stdout);
+	}
+};
+
+// Hands each chunk to a callback, for programs embedding the converter
+typedef void (*WriteCallback)(const char* data, size_t length, void* userData);
+class CallbackSink {
+	private:
+	WriteCallback callback;
+	void* userData;
+
+	public:
+	CallbackSink(WriteCallback p_callback, void* p_userData) : callback(p_callback), userData(p_userData) {}
+
+	void Write(const char* data, size_t length) {
+		callback(data, length, userData);
+	}
+
+	void Close() {}
+};
+
+/*
+* Copies output into a fixed caller-provided buffer. Output that doesn't fit is
+* dropped, but still counted, so the caller can retry with a buffer of the
+* required size.
+*/
+class BufferSink {
+	private:
+	char* buffer;
+	size_t capacity;
+
+	public:
+	size_t required = 0;
+
+	BufferSink(char* p_buffer, size_t p_capacity) : buffer(p_buffer), capacity(p_capacity) {}
+
+	bool Overflowed() const {
+		return required > capacity;
+	}
+
+	void Write(const char* data, size_t length) {
+		if (required < capacity) {
+			size_t fits = capacity - required;
+			memcpy(buffer + required, data, length < fits ? length : fits);
+		}
+		required += length;
+	}
+
+	void Close() {}
+};
+
+// Discards all output, only counting the bytes written. Used for benchmarking.
+class CountingSink {
+	public:
+	size_t count = 0;
+
+	void Write(const char* /*data*/, size_t length) {
+		count += length;
+	}
+
+	void Close() {}
+};
@@ -1,4 +1,3 @@
-#include <fstream>
 #include "MapWriter.h"
 
 const char* rootMap = 
@@ -11,50 +10,112 @@ const char* rootMap =
 "		}\n"
 "	}\n";
 
-MapWriter::MapWriter(WadLevel& level) : tforms(level.transforms), wallRatios(level.metersPerPixel),
-	flatScale(0.015625f * tforms.xyDownscale), //Flats are always 64x64, allowing us to use 1 / 64 as a constant
-	flatXShift(-0.015625f * tforms.xShift),    // Full formula is xShift / xyDownscale * xyDownscale * 0.015625f * -1
-	flatYShift(0.015625f * tforms.yShift)      // Sign is flipped for right/left shift, but not for up/down shift
-{
-	writer.precision(8);
-	writer << std::fixed << rootMap;
+template<typename Sink>
+MapWriter<Sink>::MapWriter(const WadLevel& level, Sink& p_sink, int precision) : sink(p_sink), writer(precision), textures(level) {}
+
+template<typename Sink>
+void MapWriter<Sink>::Begin() {
+	writer.AppendCString(rootMap);
+}
+
+template<typename Sink>
+void MapWriter<Sink>::BeginEntity(const char* name, const char* inherit, const char* edits) {
+	writer.Append("\n}\nentity{\n\tentityDef ");
+	writer.AppendCString(name);
+	writer.Append(" {\n\t\tinherit = \"");
+	writer.AppendCString(inherit);
+	writer.Append("\";\n\t\tedit = {\n");
+	if (edits != nullptr)
+		writer.AppendCString(edits);
+	writer.Append("\t\t}\n\t}\n");
 }
 
-void MapWriter::SaveFile(WadString levelName) {
+template<typename Sink>
+void MapWriter<Sink>::Finish() {
 	// Close entity
-	writer << "\n}";
+	writer.Append("\n}");
+	Flush();
+	sink.Close();
+}
 
-	std::string output = writer.str();
-	std::string fileName;
-	fileName.append(levelName);
-	fileName.append(".map");
-	
-	printf("Creating output file %s\n", fileName.data());
-	std::ofstream file(fileName, std::ios_base::binary);
-	file.write(output.data(), output.length());
-	file.close();
+template<typename Sink>
+void MapWriter<Sink>::Flush() {
+	sink.Write(writer.Data(), writer.Length());
+	writer.Clear();
 }
 
-void MapWriter::WritePlane(const Plane p) {
-	writer << "( " << p.n.x << ' ' << p.n.y << ' ' << p.n.z << ' ' << -p.d
-		<< " ) ( ( 1 0 0 ) ( 0 1 0 ) ) \"art/tile/common/shadow_caster\" 0 0 0";
+template<typename Sink>
+void MapWriter<Sink>::WriteRaw(const char* text, size_t length) {
+	if (writer.Length() + length < FLUSH_THRESHOLD) {
+		writer.Append(text, length);
+		return;
+	}
+	Flush();
+	sink.Write(text, length);
 }
 
-void MapWriter::BeginBrushDef() {
-	writer << "{\n\thandle = " << brushHandle++ << "\n\tbrushDef3 {";
+template<typename Sink>
+void MapWriter<Sink>::WriteSurface(const Plane p) {
+	writer.Append("( ");
+	writer.AppendFloat(p.n.x);
+	writer.Append(' ');
+	writer.AppendFloat(p.n.y);
+	writer.Append(' ');
+	writer.AppendFloat(p.n.z);
+	writer.Append(' ');
+	writer.AppendFloat(-p.d);
+	writer.Append(" ) ");
 }
 
-void MapWriter::EndBrushDef() {
-	writer << "\n\t}\n}\n";
+template<typename Sink>
+void MapWriter<Sink>::WriteWallMatrix(const TextureMatrix& m) {
+	writer.Append("( ( ");
+	writer.AppendFloat(m.s[0]);
+	writer.Append(" 0 ");
+	writer.AppendFloat(m.s[2]);
+	writer.Append(" ) ( 0 ");
+	writer.AppendFloat(m.t[1]);
+	writer.Append(' ');
+	writer.AppendFloat(m.t[2]);
+	writer.Append(" ) ) ");
 }
 
-void MapWriter::WriteWallBrush(VertexFloat v0, VertexFloat v1, float minHeight, float maxHeight, float drawHeight, WadString texture, float offsetX) {
-	Plane bounds[5]; // Untextured surfaces
-	Plane surface;   // Texture surface
-	Vector horizontal(v0, v1);
+template<typename Sink>
+void MapWriter<Sink>::WriteFlatMatrix(const TextureMatrix& m) {
+	writer.Append("( ( 0 ");
+	writer.AppendFloat(m.s[1]);
+	writer.Append(' ');
+	writer.AppendFloat(m.s[2]);
+	writer.Append(" ) ( ");
+	writer.AppendFloat(m.t[0]);
+	writer.Append(" 0 ");
+	writer.AppendFloat(m.t[2]);
+	writer.Append(" ) ) ");
+}
 
-	// PART 1 - CONSTRUCT THE PLANES
-	surface.SetFrom(Vector(horizontal.y, -horizontal.x, 0), v1);
+template<typename Sink>
+void MapWriter<Sink>::WritePlane(const Plane p) {
+	WriteSurface(p);
+	writer.Append("( ( 1 0 0 ) ( 0 1 0 ) ) \"art/tile/common/shadow_caster\" 0 0 0");
+}
+
+template<typename Sink>
+void MapWriter<Sink>::BeginBrushDef(uint32_t handle) {
+	writer.Append("{\n\thandle = ");
+	writer.AppendInt(handle);
+	writer.Append("\n\tbrushDef3 {");
+}
+
+template<typename Sink>
+void MapWriter<Sink>::EndBrushDef() {
+	writer.Append("\n\t}\n}\n");
+	if(writer.Length() >= FLUSH_THRESHOLD)
+		Flush();
+}
+
+template<typename Sink>
+void MapWriter<Sink>::WallBounds(VertexFloat v0, VertexFloat v1, const Plane& surface, float minHeight, float maxHeight, Plane bounds[5]) {
+	// The textured surface plane is precomputed by the PlaneBatch
 
 	// Plane 0 - The "Back" SideDef to the LineDef's left
 	bounds[0].n.x = -surface.n.x;
@@ -66,8 +127,11 @@ void MapWriter::WriteWallBrush(VertexFloat v0, VertexFloat v1, float minHeight,
 	bounds[0].d = bounds[0].n.x * d1.x + bounds[0].n.y * d1.y;
 	
 	// Plane 1: Forward Border Sliver: d1 - v1
-	Vector deltaVector = Vector(v1, d1);
-	bounds[1].SetFrom(Vector(deltaVector.y, -deltaVector.x, 0), d1);
+	// d1 - v1 is parallel to Plane 0's normal, so its clockwise rotation is already normalized
+	bounds[1].n.x = bounds[0].n.y;
+	bounds[1].n.y = -bounds[0].n.x;
+	bounds[1].n.z = 0;
+	bounds[1].d = bounds[1].n.x * d1.x + bounds[1].n.y * d1.y;
 
 	// Plane 2: Rear Border Sliver: v0 - d0
 	bounds[2].n.x = -bounds[1].n.x;
@@ -82,60 +146,169 @@ void MapWriter::WriteWallBrush(VertexFloat v0, VertexFloat v1, float minHeight,
 	// Plane 4: Lower Bound
 	bounds[4].n = Vector(0, 0, -1);
 	bounds[4].d = minHeight * -1;
+}
 
+template<typename Sink>
+void MapWriter<Sink>::WriteWallBrush(uint32_t handle, VertexFloat v0, VertexFloat v1, const Plane& surface, float length, float minHeight, float maxHeight, float drawHeight, WadString texture, float offsetX) {
+	// PART 1 - CONSTRUCT THE PLANES
+	Plane bounds[5]; // Untextured surfaces
+	WallBounds(v0, v1, surface, minHeight, maxHeight, bounds);
 
 	// PART 2: DRAW THE SURFACE
-	BeginBrushDef();
+	BeginBrushDef(handle);
 	
 	// Write untextured bounds
 	for (int i = 0; i < 5; i++) {
-		writer << "\n\t\t";
+		writer.Append("\n\t\t");
 		WritePlane(bounds[i]);
 	}
 
 	// Write Textured surface
 	// REMOVED: TEST IF TEXTURE DOES NOT EXIST, draw as regular plane if it doesn't
-	writer << "\n\t\t";
+	writer.Append("\n\t\t");
 
-	DimFloat ratios = wallRatios[texture];
-	float xScale = ratios.width * tforms.xyDownscale;
-	float yScale = ratios.height * tforms.zDownscale;
+	WriteSurface(surface);
+	WriteWallMatrix(textures.Wall(v0, v1, length, drawHeight, texture, offsetX));
+	writer.Append("\"art/wadtobrush/walls/");
+	writer.AppendCString(texture.Data());
+	writer.Append("\" 0 0 0");
+	EndBrushDef();
+}
 
-	/*
-	* We must shift the texture grid such that the origin is centered on
-	* the wall's left vertex. To do this accurately, we calculate the magnitude
-	* of the projection of the shift vector onto the horizontal wall vector.
-	* We finalize this by adding the texture X offset to this value.
-	* The math works out such that the XY downscale cancels in both terms when
-	* the texture's X scale is multiplied in at the end.
-	*/
-	float projection = ((horizontal.x * v0.x + horizontal.y * v0.y) / horizontal.Magnitude() - offsetX) * xScale * -1;
+template<typename Sink>
+void MapWriter<Sink>::WritePortalBrush(uint32_t handle, VertexFloat v0, VertexFloat v1, float minHeight, float maxHeight) {
+	Plane surface;
+	surface.SetFrom(Vector(v1.y - v0.y, v0.x - v1.x, 0), v1);
+	Plane bounds[5];
+	WallBounds(v0, v1, surface, minHeight, maxHeight, bounds);
 
+	// The portal covers the same space a wall brush would
+	BeginBrushDef(handle);
+	for (int i = 0; i < 5; i++) {
+		writer.Append("\n\t\t");
+		WriteSurface(bounds[i]);
+		writer.Append("( ( 1 0 0 ) ( 0 1 0 ) ) \"" VISPORTAL_MATERIAL "\" 0 0 0");
+	}
+	writer.Append("\n\t\t");
+	WriteSurface(surface);
+	writer.Append("( ( 1 0 0 ) ( 0 1 0 ) ) \"" VISPORTAL_MATERIAL "\" 0 0 0");
+	EndBrushDef();
+}
+
+template<typename Sink>
+void MapWriter<Sink>::WriteClipBrush(uint32_t handle, const VertexFloat* points, size_t count, float minHeight, float maxHeight) {
+	BeginBrushDef(handle);
+	for (size_t i = 0; i < count; i++) {
+		// Counter-clockwise, so each side faces out on the edge's right
+		VertexFloat v0 = points[i];
+		VertexFloat v1 = points[(i + 1) % count];
+		Plane side;
+		side.SetFrom(Vector(v1.y - v0.y, v0.x - v1.x, 0), v0);
+		writer.Append("\n\t\t");
+		WriteSurface(side);
+		writer.Append("( ( 1 0 0 ) ( 0 1 0 ) ) \"" CLIP_MATERIAL "\" 0 0 0");
+	}
 
-	writer << "( " << surface.n.x << ' ' << surface.n.y << ' ' << surface.n.z << ' ' << -surface.d << " ) ";
-	writer << "( ( " << xScale << " 0 " << projection << " ) ( 0 " << yScale << " " << drawHeight * yScale << " ) ) \"art/wadtobrush/walls/" << texture.Data() << "\" 0 0 0";
+	Plane caps[2];
+	caps[0].n = Vector(0, 0, 1);
+	caps[0].d = maxHeight;
+	caps[1].n = Vector(0, 0, -1);
+	caps[1].d = -minHeight;
+	for (const Plane& cap : caps) {
+		writer.Append("\n\t\t");
+		WriteSurface(cap);
+		writer.Append("( ( 1 0 0 ) ( 0 1 0 ) ) \"" CLIP_MATERIAL "\" 0 0 0");
+	}
 	EndBrushDef();
 }
 
-void MapWriter::WriteFloorBrush(VertexFloat a, VertexFloat b, VertexFloat c, float height, bool isCeiling, WadString texture) {
+template<typename Sink>
+void MapWriter<Sink>::WriteEditVector(const char* field, const char* axes, const Vector& v) {
+	const float values[3] = {v.x, v.y, v.z};
+	writer.Append("\t\t\t");
+	writer.AppendCString(field);
+	writer.Append(" = {\n");
+	for (int i = 0; i < 3; i++) {
+		writer.Append("\t\t\t\t");
+		writer.Append(axes[i]);
+		writer.Append(" = ");
+		writer.AppendFloat(values[i]);
+		writer.Append(";\n");
+	}
+	writer.Append("\t\t\t}\n");
+}
+
+template<typename Sink>
+void MapWriter<Sink>::WriteLight(const char* name, const Vector& origin, const Vector& radius, float brightness) {
+	writer.Append("\n}\nentity{\n\tentityDef ");
+	writer.AppendCString(name);
+	writer.Append(" {\n\t\tinherit = \"" LIGHT_ENTITY_INHERIT "\";\n\t\tedit = {\n");
+	WriteEditVector("spawnPosition", "xyz", origin);
+	WriteEditVector("lightRadius", "xyz", radius);
+	WriteEditVector("color", "rgb", Vector(brightness, brightness, brightness));
+	writer.Append("\t\t}\n\t}\n");
+	if(writer.Length() >= FLUSH_THRESHOLD)
+		Flush();
+}
+
+template<typename Sink>
+void MapWriter<Sink>::WriteTemplateEntity(const char* name, const char* inherit, const Vector& origin, float angle) {
+	writer.Append("\n}\nentity{\n\tentityDef ");
+	writer.AppendCString(name);
+	writer.Append(" {\n\t\tinherit = \"");
+	writer.AppendCString(inherit);
+	writer.Append("\";\n\t\tedit = {\n");
+	WriteEditVector("spawnPosition", "xyz", origin);
+
+	// Entities face east unless rotated
+	if (angle != 0) {
+		// Right angles are common, and should come out exact
+		double radians = angle * 0.017453292519943295;
+		float c = static_cast<float>(cos(radians)), s = static_cast<float>(sin(radians));
+		c = fabsf(c) < 1e-6f ? 0.0f : c;
+		s = fabsf(s) < 1e-6f ? 0.0f : s;
+		writer.Append("\t\t\tspawnOrientation = {\n\t\t\t\tmat = {\n\t\t\t\t\tmat[0] = {\n\t\t\t\t\t\tx = ");
+		writer.AppendFloat(c);
+		writer.Append(";\n\t\t\t\t\t\ty = ");
+		writer.AppendFloat(s);
+		writer.Append(";\n\t\t\t\t\t}\n\t\t\t\t\tmat[1] = {\n\t\t\t\t\t\tx = ");
+		writer.AppendFloat(-s);
+		writer.Append(";\n\t\t\t\t\t\ty = ");
+		writer.AppendFloat(c);
+		writer.Append(";\n\t\t\t\t\t}\n\t\t\t\t}\n\t\t\t}\n");
+	}
+	writer.Append("\t\t}\n\t}\n");
+	if(writer.Length() >= FLUSH_THRESHOLD)
+		Flush();
+}
+
+template<typename Sink>
+void MapWriter<Sink>::WritePrefabInstance(const char* name, const char* map, const Vector& origin, const char* edits) {
+	writer.Append("\n}\nentity{\n\tentityDef ");
+	writer.AppendCString(name);
+	writer.Append(" {\n\t\tinherit = \"" PREFAB_ENTITY_INHERIT "\";\n\t\tedit = {\n\t\t\treferenceMap = \"");
+	writer.AppendCString(map);
+	writer.Append("\";\n");
+	WriteEditVector("spawnPosition", "xyz", origin);
+	if (edits != nullptr)
+		writer.AppendCString(edits);
+	writer.Append("\t\t}\n\t}\n");
+	if(writer.Length() >= FLUSH_THRESHOLD)
+		Flush();
+}
+
+template<typename Sink>
+void MapWriter<Sink>::WriteFloorBrush(uint32_t handle, const Plane sides[3], float height, bool isCeiling, WadString texture) {
 	Plane bounds[4]; // Untextured surfaces
 	Plane surface;   // Textured surface.
 
 	// PART 1 - CONSTRUCT PLANE OBJECTS
+	// Planes 0 - 2 are the triangle's walls, shared by the floor and ceiling brush.
 	// Based on the order Earcut yields in the points in,
-	// we cross horizontal X <0, 0, 1> to get our normal
-
-	// Plane 0 - First Wall
-	Vector h(a, b);
-	bounds[0].SetFrom(Vector(h.y, -h.x, 0), a);
-
-	// Plane 1 - Second Wall
-	h = Vector(b, c);
-	bounds[1].SetFrom(Vector(h.y, -h.x, 0), b);
-
-	// Plane 2 - Last Wall
-	h = Vector(c, a);
-	bounds[2].SetFrom(Vector(h.y, -h.x, 0), c);
+	// we cross horizontal X <0, 0, 1> to get their normals
+	bounds[0] = sides[0];
+	bounds[1] = sides[1];
+	bounds[2] = sides[2];
 
 	if (isCeiling) {
 		bounds[3].n = Vector(0, 0, 1);
@@ -151,17 +324,26 @@ void MapWriter::WriteFloorBrush(VertexFloat a, VertexFloat b, VertexFloat c, flo
 	}
 
 	// PART 2: DRAW THE SURFACE
-	BeginBrushDef();
+	BeginBrushDef(handle);
 	for (int i = 0; i < 4; i++) {
-		writer << "\n\t\t";
+		writer.Append("\n\t\t");
 		WritePlane(bounds[i]);
 	}
-	writer << "\n\t\t";
+	writer.Append("\n\t\t");
 
-	// horizontal: (0, -1) Vertical (1, 0) - Ensures proper rotation of textures (for floors)
-	writer << "( " << surface.n.x << ' ' << surface.n.y << ' ' << surface.n.z << ' ' << -surface.d << " ) ";
-	writer << "( ( 0 " <<  (isCeiling ? -flatScale : flatScale) << " " << flatXShift << " ) ( " << -flatScale << " 0 " << flatYShift
-		<< " ) ) \"art/wadtobrush/flats/" << texture.Data() << "\" 0 0 0";
+	WriteSurface(surface);
+	WriteFlatMatrix(textures.Flat(isCeiling));
+	writer.Append("\"art/wadtobrush/flats/");
+	writer.AppendCString(texture.Data());
+	writer.Append("\" 0 0 0");
 
 	EndBrushDef();
-}
\ No newline at end of file
+}
+
+template class MapWriter<FileSink>;
+template class MapWriter<AsyncFileSink>;
+template class MapWriter<MemorySink>;
+template class MapWriter<StdoutSink>;
+template class MapWriter<CountingSink>;
+template class MapWriter<CallbackSink>;
+template class MapWriter<BufferSink>;
\ No newline at end of file
@@ -1,30 +1,81 @@
+#pragma once
 #include "BrushBuilder.h"
-#include <sstream>
+#include "TextBuffer.h"
+#include "MapSinks.h"
 
+// Material of every face of a visportal brush
+#define VISPORTAL_MATERIAL "art/tile/common/visportal"
+
+// Material of every face of a player clip brush
+#define CLIP_MATERIAL "art/tile/common/clip/player"
+
+// Class of the entities lighting each cluster of sectors
+#define LIGHT_ENTITY_INHERIT "light"
+
+// Class of the entities placing a copy of a prefab map
+#define PREFAB_ENTITY_INHERIT "func_reference"
+
+// Entity edits that make an entity's brushes non-solid, so only clip brushes block movement
+#define NONSOLID_ENTITY_EDIT "\t\t\tclipModelInfo = {\n\t\t\t\ttype = \"CLIPMODEL_NONE\";\n\t\t\t}\n"
+
+template<typename Sink>
 class MapWriter {
 	private:
-	std::ostringstream writer;
-	VertexTransforms tforms;
-	std::unordered_map<WadString, DimFloat>& wallRatios;
+	// Formatted text is handed to the sink once it grows past this size
+	static constexpr size_t FLUSH_THRESHOLD = 64 * 1024;
+
+	Sink& sink;
+	TextBuffer writer;
+	TextureMapper textures;
 
-	const float flatScale;
-	const float flatXShift;
-	const float flatYShift;
 
+	public:
+	// Negative precision writes numbers in their shortest round-trip form
+	MapWriter(const WadLevel& level, Sink& p_sink, int precision = -1);
 
-	// Must increment with every written brush
-	int brushHandle = 100000000;
+	// Opens the map file and its worldspawn entity
+	void Begin();
 
+	// Closes the current entity and opens a new one, which following brushes belong to
+	// Edits are formatted lines placed in the entity's edit block, if given
+	void BeginEntity(const char* name, const char* inherit, const char* edits = nullptr);
 
-	public:
-	MapWriter(WadLevel& level);
-	void SaveFile(WadString levelName);
+	// Closes the last entity and the sink
+	void Finish();
+
+	// Hands everything formatted so far to the sink
+	void Flush();
+
+	// Writes text that was formatted by another MapWriter
+	void WriteRaw(const char* text, size_t length);
+
+
+	void WriteWallBrush(uint32_t handle, VertexFloat v0, VertexFloat v1, const Plane& surface, float length, float minHeight, float maxHeight, float drawHeight, WadString texture, float offsetX);
+	void WriteFloorBrush(uint32_t handle, const Plane sides[3], float height, bool isCeiling, WadString texture);
+
+	// A visportal across the opening between v0 and v1
+	void WritePortalBrush(uint32_t handle, VertexFloat v0, VertexFloat v1, float minHeight, float maxHeight);
+
+	// A player clip prism over a convex, counter-clockwise polygon
+	void WriteClipBrush(uint32_t handle, const VertexFloat* points, size_t count, float minHeight, float maxHeight);
+
+	// Closes the current entity and writes a white point light, lighting the box around its origin
+	void WriteLight(const char* name, const Vector& origin, const Vector& radius, float brightness);
+
+	// Closes the current entity and writes one inheriting from a template, facing the angle in degrees
+	void WriteTemplateEntity(const char* name, const char* inherit, const Vector& origin, float angle);
 
-	void WriteWallBrush(VertexFloat v0, VertexFloat v1, float minHeight, float maxHeight, float drawHeight, WadString texture, float offsetX);
-	void WriteFloorBrush(VertexFloat a, VertexFloat b, VertexFloat c, float height, bool isCeiling, WadString texture);
+	// Closes the current entity and writes one placing a prefab's map at the origin, with optional extra edits
+	void WritePrefabInstance(const char* name, const char* map, const Vector& origin, const char* edits = nullptr);
 
 	private:
-	void BeginBrushDef();
+	void WallBounds(VertexFloat v0, VertexFloat v1, const Plane& surface, float minHeight, float maxHeight, Plane bounds[5]);
+	void BeginBrushDef(uint32_t handle);
 	void EndBrushDef();
 	void WritePlane(const Plane p);
+	void WriteSurface(const Plane p);
+	// The entries a wall or flat matrix always leaves at zero are written as literal "0" fragments
+	void WriteWallMatrix(const TextureMatrix& m);
+	void WriteFlatMatrix(const TextureMatrix& m);
+	void WriteEditVector(const char* field, const char* axes, const Vector& v);
 };
\ No newline at end of file
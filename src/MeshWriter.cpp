@@ -0,0 +1,143 @@
+#include "MeshWriter.h"
+
+void MeshWriter::WriteWallBrush(uint32_t /*handle*/, VertexFloat v0, VertexFloat v1, const Plane& surface, float length, float minHeight, float maxHeight, float drawHeight, WadString texture, float offsetX) {
+	if (maxHeight <= minHeight)
+		return;
+
+	TextureMatrix matrix = textures.Wall(v0, v1, length, drawHeight, texture, offsetX);
+	Vector axisS, axisT;
+	TextureAxes(surface.n, axisS, axisT);
+
+	// Counter-clockwise when seen from the side the surface faces
+	Vector quad[4] = {
+		Vector(v0.x, v0.y, minHeight),
+		Vector(v1.x, v1.y, minHeight),
+		Vector(v1.x, v1.y, maxHeight),
+		Vector(v0.x, v0.y, maxHeight)
+	};
+	MeshCorner corners[4];
+	for (int i = 0; i < 4; i++) {
+		corners[i] = {quad[i].x, quad[i].y, quad[i].z, 0, 0};
+		matrix.Apply(quad[i], axisS, axisT, corners[i].u, corners[i].v);
+	}
+
+	triangles.push_back({{corners[0], corners[1], corners[2]}, texture, false});
+	triangles.push_back({{corners[0], corners[2], corners[3]}, texture, false});
+}
+
+void MeshWriter::WriteFloorTriangle(VertexFloat a, VertexFloat b, VertexFloat c, float height, bool isCeiling, WadString texture) {
+	// Floors face up and ceilings face down
+	float cross = (b.x - a.x) * (c.y - a.y) - (b.y - a.y) * (c.x - a.x);
+	if ((cross < 0) != isCeiling)
+		std::swap(b, c);
+
+	TextureMatrix matrix = textures.Flat(isCeiling);
+	Vector axisS, axisT;
+	TextureAxes(Vector(0, 0, isCeiling ? -1.0f : 1.0f), axisS, axisT);
+
+	MeshTriangle triangle;
+	VertexFloat points[3] = {a, b, c};
+	for (int i = 0; i < 3; i++) {
+		Vector p(points[i].x, points[i].y, height);
+		MeshCorner& corner = triangle.corners[i];
+		corner = {p.x, p.y, p.z, 0, 0};
+		matrix.Apply(p, axisS, axisT, corner.u, corner.v);
+	}
+	triangle.texture = texture;
+	triangle.isFlat = true;
+	triangles.push_back(triangle);
+}
+
+int32_t ObjWriter::Index(std::vector<CornerKey>& list, std::unordered_map<CornerKey, int32_t, CornerHash>& index, CornerKey key) {
+	// Negative zeroes are written as zeroes, so they must not count as a separate value
+	key.a += 0.0f;
+	key.b += 0.0f;
+	key.c += 0.0f;
+
+	auto inserted = index.emplace(key, static_cast<int32_t>(list.size()));
+	if (inserted.second)
+		list.push_back(key);
+	return inserted.first->second;
+}
+
+void ObjWriter::Add(const std::vector<MeshTriangle>& triangles) {
+	std::string material;
+	for (const MeshTriangle& t : triangles) {
+		material = t.isFlat ? "art/wadtobrush/flats/" : "art/wadtobrush/walls/";
+		material.append(t.texture.Data());
+
+		auto found = groupIndex.emplace(material, groups.size());
+		if (found.second)
+			groups.push_back({material, {}});
+		MaterialGroup& group = groups[found.first->second];
+
+		for (const MeshCorner& c : t.corners) {
+			group.corners.push_back(Index(positions, positionIndex, {c.x, c.y, c.z}));
+			group.corners.push_back(Index(uvs, uvIndex, {c.u, c.v, 0}));
+		}
+	}
+}
+
+template<typename Sink>
+void ObjWriter::Write(Sink& sink, const char* objectName, int precision) {
+	static constexpr size_t FLUSH_THRESHOLD = 64 * 1024;
+	TextBuffer writer(precision);
+	auto flush = [&](bool force) {
+		if (force || writer.Length() >= FLUSH_THRESHOLD) {
+			sink.Write(writer.Data(), writer.Length());
+			writer.Clear();
+		}
+	};
+
+	writer.Append("# WadToBrush\no ");
+	writer.AppendCString(objectName);
+	writer.Append('\n');
+
+	for (const CornerKey& p : positions) {
+		writer.Append("v ");
+		writer.AppendFloat(p.a);
+		writer.Append(' ');
+		writer.AppendFloat(p.b);
+		writer.Append(' ');
+		writer.AppendFloat(p.c);
+		writer.Append('\n');
+		flush(false);
+	}
+
+	// OBJ texture coordinates run upwards, while the engine's run downwards
+	for (const CornerKey& uv : uvs) {
+		writer.Append("vt ");
+		writer.AppendFloat(uv.a);
+		writer.Append(' ');
+		writer.AppendFloat(-uv.b);
+		writer.Append('\n');
+		flush(false);
+	}
+
+	// Indices start at 1
+	for (const MaterialGroup& group : groups) {
+		writer.Append("usemtl ");
+		writer.Append(group.name.data(), group.name.length());
+		writer.Append('\n');
+		for (size_t i = 0; i < group.corners.size(); i += 6) {
+			writer.Append('f');
+			for (size_t c = i; c < i + 6; c += 2) {
+				writer.Append(' ');
+				writer.AppendInt(group.corners[c] + 1);
+				writer.Append('/');
+				writer.AppendInt(group.corners[c + 1] + 1);
+			}
+			writer.Append('\n');
+			flush(false);
+		}
+	}
+
+	flush(true);
+	sink.Close();
+}
+
+template void ObjWriter::Write<FileSink>(FileSink& sink, const char* objectName, int precision);
+template void ObjWriter::Write<AsyncFileSink>(AsyncFileSink& sink, const char* objectName, int precision);
+template void ObjWriter::Write<MemorySink>(MemorySink& sink, const char* objectName, int precision);
+template void ObjWriter::Write<StdoutSink>(StdoutSink& sink, const char* objectName, int precision);
+template void ObjWriter::Write<CountingSink>(CountingSink& sink, const char* objectName, int precision);
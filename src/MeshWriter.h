@@ -0,0 +1,89 @@
+#pragma once
+#include "BrushBuilder.h"
+#include "TextBuffer.h"
+#include "MapSinks.h"
+#include <string>
+
+/*
+* Triangle mesh output
+*
+* Instead of a brush for every wall and floor triangle, surfaces can be written
+* as textured triangles of a static mesh, for scenery that does not need to be
+* editable CSG. Texture coordinates are computed with the same texture matrices
+* the brushes use, so a surface looks the same either way.
+*/
+
+// A corner of a triangle: its position, then its texture coordinates
+struct MeshCorner {
+	float x, y, z;
+	float u, v;
+};
+
+// A textured triangle, wound counter-clockwise when seen from its front
+struct MeshTriangle {
+	MeshCorner corners[3];
+	WadString texture;
+	bool isFlat;
+};
+
+// Generates the triangles of walls and floor triangles queued in a BrushBatch
+class MeshWriter {
+	private:
+	TextureMapper textures;
+
+	public:
+	std::vector<MeshTriangle> triangles;
+
+	MeshWriter(const WadLevel& level) : textures(level) {}
+
+	// Takes the same arguments as MapWriter::WriteWallBrush. The wall is written as two triangles.
+	void WriteWallBrush(uint32_t handle, VertexFloat v0, VertexFloat v1, const Plane& surface, float length, float minHeight, float maxHeight, float drawHeight, WadString texture, float offsetX);
+	void WriteFloorTriangle(VertexFloat a, VertexFloat b, VertexFloat c, float height, bool isCeiling, WadString texture);
+};
+
+/*
+* Writes triangles as a Wavefront OBJ mesh. Positions and texture coordinates
+* shared by several triangles are written once, and triangles are grouped by
+* material, each using the material the brushes would. Positions are in the same
+* Z-up coordinates as the .map, so the mesh lines up with the level's brushes.
+*/
+class ObjWriter {
+	private:
+	struct MaterialGroup {
+		std::string name;
+		std::vector<int32_t> corners; // Position and texture coordinate indices of each corner
+	};
+
+	struct CornerKey {
+		float a, b, c;
+
+		bool operator==(const CornerKey& k) const {
+			return a == k.a && b == k.b && c == k.c;
+		}
+	};
+
+	struct CornerHash {
+		size_t operator()(const CornerKey& k) const {
+			uint32_t bits[3];
+			memcpy(bits, &k, sizeof(bits));
+			return (static_cast<size_t>(bits[0]) * 73856093u) ^ (static_cast<size_t>(bits[1]) * 19349663u) ^ (static_cast<size_t>(bits[2]) * 83492791u);
+		}
+	};
+
+	std::vector<CornerKey> positions;
+	std::vector<CornerKey> uvs;
+	std::unordered_map<CornerKey, int32_t, CornerHash> positionIndex;
+	std::unordered_map<CornerKey, int32_t, CornerHash> uvIndex;
+	std::vector<MaterialGroup> groups;
+	std::unordered_map<std::string, size_t> groupIndex;
+
+	int32_t Index(std::vector<CornerKey>& list, std::unordered_map<CornerKey, int32_t, CornerHash>& index, CornerKey key);
+
+	public:
+	// Adds triangles to the mesh, in the order they should be written
+	void Add(const std::vector<MeshTriangle>& triangles);
+
+	// Writes the complete mesh to the sink, and closes it
+	template<typename Sink>
+	void Write(Sink& sink, const char* objectName, int precision = -1);
+};
@@ -0,0 +1,110 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*
+* Runs func(task, worker) for every task in [0, count), spread across the given
+* number of threads (the calling thread included). Idle threads claim the next
+* unstarted task from a shared counter, so tasks should be ordered with the most
+* expensive first to keep every thread busy until the end.
+*
+* Worker indices are in [0, jobs) and let callers keep per-thread state.
+*/
+template<typename F>
+void ParallelFor(size_t count, int jobs, F func) {
+	if (jobs < 1)
+		jobs = 1;
+	if (static_cast<size_t>(jobs) > count)
+		jobs = count > 0 ? static_cast<int>(count) : 1;
+
+	std::atomic<size_t> next(0);
+	auto work = [&](int worker) {
+		for (size_t task = next++; task < count; task = next++)
+			func(task, worker);
+	};
+
+	std::vector<std::thread> threads;
+	threads.reserve(jobs - 1);
+	for (int i = 1; i < jobs; i++)
+		threads.emplace_back(work, i);
+	work(0);
+	for (std::thread& t : threads)
+		t.join();
+}
+
+/*
+* ParallelFor, for tasks that may throw. Once a task throws, the remaining tasks
+* are skipped, and the first exception is rethrown on the calling thread after
+* every thread has stopped.
+*/
+template<typename F>
+void ParallelForChecked(size_t count, int jobs, F func) {
+	std::exception_ptr failure;
+	std::mutex failureLock;
+	std::atomic<bool> failed(false);
+	ParallelFor(count, jobs, [&](size_t task, int worker) {
+		if (failed)
+			return;
+		try {
+			func(task, worker);
+		}
+		catch (...) {
+			std::lock_guard<std::mutex> guard(failureLock);
+			if (!failure)
+				failure = std::current_exception();
+			failed = true;
+		}
+	});
+	if (failure)
+		std::rethrow_exception(failure);
+}
+
+/*
+* A fixed-capacity queue for handing work between pipeline stages.
+* Push blocks while the queue is full, so a slow consumer applies
+* back-pressure to its producers instead of letting memory grow.
+*/
+template<typename T>
+class BoundedQueue {
+	private:
+	std::deque<T> items;
+	size_t capacity;
+	bool closed = false;
+	std::mutex lock;
+	std::condition_variable notFull;
+	std::condition_variable notEmpty;
+
+	public:
+	BoundedQueue(size_t p_capacity) : capacity(p_capacity) {}
+
+	void Push(T item) {
+		std::unique_lock<std::mutex> guard(lock);
+		notFull.wait(guard, [this] { return items.size() < capacity; });
+		items.push_back(std::move(item));
+		notEmpty.notify_one();
+	}
+
+	// Returns false once the queue is closed and empty
+	bool Pop(T& item) {
+		std::unique_lock<std::mutex> guard(lock);
+		notEmpty.wait(guard, [this] { return !items.empty() || closed; });
+		if (items.empty())
+			return false;
+		item = std::move(items.front());
+		items.pop_front();
+		notFull.notify_one();
+		return true;
+	}
+
+	// No more items will be pushed
+	void Close() {
+		std::lock_guard<std::mutex> guard(lock);
+		closed = true;
+		notEmpty.notify_all();
+	}
+};
@@ -0,0 +1,340 @@
+#include "PrefabBuilder.h"
+#include "AreaBuilder.h"
+#include "LevelCache.h"
+#include <algorithm>
+#include <array>
+#include <numeric>
+#include <unordered_map>
+#include <cmath>
+#include <cstdio>
+
+// Flats repeat every 64 units of the WAD
+#define PREFAB_FLAT_GRID 64
+
+// The only linedef flags that change its brushes
+#define PREFAB_LINE_FLAGS (UPPER_UNPEGGED | LOWER_UNPEGGED)
+
+// A height in the WAD's units, as it was before the Z downscale
+inline int32_t RawHeight(float height, const VertexTransforms& tforms) {
+	return static_cast<int32_t>(lrintf(height * tforms.zDownscale));
+}
+
+template<typename T>
+inline void AppendForm(std::string& form, const T& value) {
+	form.append(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+// A linedef's vertices relative to its island's origin, the sort key of the canonical order
+struct CanonicalLine {
+	int32_t x0, y0, x1, y1;
+	int32_t line;
+
+	bool operator<(const CanonicalLine& b) const {
+		if (x0 != b.x0) return x0 < b.x0;
+		if (y0 != b.y0) return y0 < b.y0;
+		if (x1 != b.x1) return x1 < b.x1;
+		if (y1 != b.y1) return y1 < b.y1;
+		return line < b.line;
+	}
+};
+
+// Copies of a single shape, each by its island's index and local origin
+struct PrefabShape {
+	Prefab first;
+	std::vector<int32_t> islands;
+	std::vector<std::array<int32_t, 3>> origins; // X, Y and base height of each copy
+};
+
+void FindPrefabs(const WadLevel& level, LevelPrefabs& result) {
+	result.prefabs.clear();
+	result.instances.clear();
+	result.lines.assign(level.linedefs.Num(), false);
+	result.sectors.assign(level.sectors.Num(), false);
+	const VertexTransforms& tforms = level.transforms;
+
+	// STEP 1: ISLANDS
+	// Linedefs sharing a vertex are in the same island
+	std::vector<int32_t> parents(level.vertices.Num());
+	std::iota(parents.begin(), parents.end(), 0);
+	for (int32_t i = 0; i < level.linedefs.Num(); i++) {
+		const LineDef& line = level.linedefs[i];
+		if (line.sideFront == NO_SIDEDEF)
+			continue;
+		int32_t a = FindRoot(parents, line.vertexStart);
+		int32_t b = FindRoot(parents, line.vertexEnd);
+		if (a != b)
+			parents[std::max(a, b)] = std::min(a, b);
+	}
+
+	// Islands are numbered by their lowest linedef, and list their linedefs in order
+	std::vector<int32_t> rootIslands(level.vertices.Num(), -1);
+	std::vector<std::vector<int32_t>> islands;
+	for (int32_t i = 0; i < level.linedefs.Num(); i++) {
+		const LineDef& line = level.linedefs[i];
+		if (line.sideFront == NO_SIDEDEF)
+			continue;
+		int32_t& island = rootIslands[FindRoot(parents, line.vertexStart)];
+		if (island < 0) {
+			island = static_cast<int32_t>(islands.size());
+			islands.emplace_back();
+		}
+		islands[island].push_back(i);
+	}
+
+	// The island each sector lies entirely inside, -1 if it borders no linedef, or -2 if it spans several
+	std::vector<int32_t> sectorIslands(level.sectors.Num(), -1);
+	for (int32_t k = 0; k < static_cast<int32_t>(islands.size()); k++) {
+		for (int32_t lineIndex : islands[k]) {
+			const LineDef& line = level.linedefs[lineIndex];
+			uint16_t sides[2] = {line.sideFront, line.sideBack};
+			for (uint16_t side : sides) {
+				if (side == NO_SIDEDEF)
+					continue;
+				int32_t& island = sectorIslands[level.sidedefs[side].sector];
+				island = island == -1 || island == k ? k : -2;
+			}
+		}
+	}
+
+	// STEP 2: CANONICAL FORMS
+	std::unordered_map<std::string, size_t> shapeIndex;
+	std::vector<PrefabShape> shapes;
+	std::vector<int32_t> localSectors(level.sectors.Num(), -1);
+	std::vector<CanonicalLine> sorted;
+	std::string form;
+	for (int32_t k = 0; k < static_cast<int32_t>(islands.size()); k++) {
+		const std::vector<int32_t>& lines = islands[k];
+		if (lines.size() < PREFAB_MIN_LINES)
+			continue;
+
+		Prefab p;
+		int32_t minX = INT32_MAX, minY = INT32_MAX, maxX = INT32_MIN, maxY = INT32_MIN;
+		bool hasFlats = false;
+		for (int32_t lineIndex : lines) {
+			const LineDef& line = level.linedefs[lineIndex];
+			const Vertex& v0 = level.vertices[line.vertexStart];
+			const Vertex& v1 = level.vertices[line.vertexEnd];
+			minX = std::min<int32_t>(minX, std::min(v0.x, v1.x));
+			minY = std::min<int32_t>(minY, std::min(v0.y, v1.y));
+			maxX = std::max<int32_t>(maxX, std::max(v0.x, v1.x));
+			maxY = std::max<int32_t>(maxY, std::max(v0.y, v1.y));
+			hasFlats = hasFlats || sectorIslands[level.sidedefs[line.sideFront].sector] == k
+				|| (line.sideBack != NO_SIDEDEF && sectorIslands[level.sidedefs[line.sideBack].sector] == k);
+		}
+		auto snap = [](int32_t v) {
+			return (v >= 0 ? v / PREFAB_FLAT_GRID : -((PREFAB_FLAT_GRID - 1 - v) / PREFAB_FLAT_GRID)) * PREFAB_FLAT_GRID;
+		};
+		p.originX = hasFlats ? snap(minX) : minX;
+		p.originY = hasFlats ? snap(minY) : minY;
+
+		// Local vertices must fit in the WAD's 16 bits
+		if (maxX - p.originX > INT16_MAX || maxY - p.originY > INT16_MAX)
+			continue;
+
+		sorted.clear();
+		for (int32_t lineIndex : lines) {
+			const LineDef& line = level.linedefs[lineIndex];
+			const Vertex& v0 = level.vertices[line.vertexStart];
+			const Vertex& v1 = level.vertices[line.vertexEnd];
+			sorted.push_back({v0.x - p.originX, v0.y - p.originY, v1.x - p.originX, v1.y - p.originY, lineIndex});
+		}
+		std::sort(sorted.begin(), sorted.end());
+
+		// Sectors are numbered in order of first use, and heights are relative to the lowest floor
+		p.baseHeight = INT32_MAX;
+		for (const CanonicalLine& c : sorted) {
+			const LineDef& line = level.linedefs[c.line];
+			p.lines.push_back(c.line);
+			uint16_t sides[2] = {line.sideFront, line.sideBack};
+			for (uint16_t side : sides) {
+				if (side == NO_SIDEDEF)
+					continue;
+				int32_t sector = level.sidedefs[side].sector;
+				if (localSectors[sector] >= 0)
+					continue;
+				localSectors[sector] = static_cast<int32_t>(p.sectors.size());
+				if (sectorIslands[sector] == k)
+					p.enclosed.push_back(localSectors[sector]);
+				p.sectors.push_back(sector);
+				p.baseHeight = std::min(p.baseHeight, RawHeight(level.sectors[sector].floorHeight, tforms));
+			}
+		}
+
+		form.clear();
+		AppendForm(form, tforms.xyDownscale);
+		AppendForm(form, tforms.zDownscale);
+		for (const CanonicalLine& c : sorted) {
+			const LineDef& line = level.linedefs[c.line];
+			AppendForm(form, c.x0);
+			AppendForm(form, c.y0);
+			AppendForm(form, c.x1);
+			AppendForm(form, c.y1);
+			AppendForm(form, static_cast<uint16_t>(line.flags & PREFAB_LINE_FLAGS));
+
+			uint16_t sides[2] = {line.sideFront, line.sideBack};
+			for (uint16_t sideIndex : sides) {
+				AppendForm(form, sideIndex == NO_SIDEDEF);
+				if (sideIndex == NO_SIDEDEF)
+					continue;
+				const SideDef& side = level.sidedefs[sideIndex];
+				AppendForm(form, side.offsetX);
+				AppendForm(form, side.offsetY);
+				AppendForm(form, localSectors[side.sector]);
+
+				const WadString* textures[3] = {&side.upperTexture, &side.middleTexture, &side.lowerTexture};
+				for (const WadString* texture : textures) {
+					form.append(texture->Data(), LENGTH_WADSTRING);
+					auto ratios = level.metersPerPixel.find(*texture);
+					AppendForm(form, ratios == level.metersPerPixel.end() ? DimFloat() : ratios->second);
+				}
+			}
+		}
+		for (int32_t sectorIndex : p.sectors) {
+			const Sector& sector = level.sectors[sectorIndex];
+			bool enclosed = sectorIslands[sectorIndex] == k;
+			AppendForm(form, enclosed);
+			AppendForm(form, RawHeight(sector.floorHeight, tforms) - p.baseHeight);
+			AppendForm(form, RawHeight(sector.ceilHeight, tforms) - p.baseHeight);
+			if (enclosed) {
+				form.append(sector.floorTexture.Data(), LENGTH_WADSTRING);
+				form.append(sector.ceilingTexture.Data(), LENGTH_WADSTRING);
+			}
+			localSectors[sectorIndex] = -1;
+		}
+
+		std::array<int32_t, 3> origin = {p.originX, p.originY, p.baseHeight};
+		auto found = shapeIndex.emplace(form, shapes.size());
+		if (found.second) {
+			CacheKey key;
+			key.Add(form.data(), form.size());
+			p.hash = key.hash;
+			shapes.emplace_back();
+			shapes.back().first = std::move(p);
+		}
+		PrefabShape& shape = shapes[found.first->second];
+		shape.islands.push_back(k);
+		shape.origins.push_back(origin);
+	}
+
+	// STEP 3: INSTANCES
+	for (PrefabShape& shape : shapes) {
+		if (shape.islands.size() < PREFAB_MIN_COPIES)
+			continue;
+		int32_t prefabIndex = static_cast<int32_t>(result.prefabs.size());
+		for (size_t c = 0; c < shape.islands.size(); c++) {
+			int32_t k = shape.islands[c];
+			for (int32_t lineIndex : islands[k]) {
+				const LineDef& line = level.linedefs[lineIndex];
+				result.lines[lineIndex] = true;
+				uint16_t sides[2] = {line.sideFront, line.sideBack};
+				for (uint16_t side : sides)
+					if (side != NO_SIDEDEF && sectorIslands[level.sidedefs[side].sector] == k)
+						result.sectors[level.sidedefs[side].sector] = true;
+			}
+
+			const std::array<int32_t, 3>& o = shape.origins[c];
+			PrefabInstance instance;
+			instance.prefab = prefabIndex;
+			instance.line = islands[k][0];
+			instance.origin = Vector((o[0] + tforms.xShift) / tforms.xyDownscale, (o[1] + tforms.yShift) / tforms.xyDownscale,
+				o[2] / tforms.zDownscale);
+			result.instances.push_back(instance);
+		}
+		result.prefabs.push_back(std::move(shape.first));
+	}
+	std::sort(result.instances.begin(), result.instances.end(), [](const PrefabInstance& a, const PrefabInstance& b) {
+		return a.line < b.line;
+	});
+}
+
+void BuildPrefabLevel(const WadLevel& level, const Prefab& prefab, WadLevel& prefabLevel) {
+	const VertexTransforms& tforms = level.transforms;
+	prefabLevel.lumpHeader = prefabLevel.lumpThings = prefabLevel.lumpLines = prefabLevel.lumpSides = nullptr;
+	prefabLevel.lumpVertex = prefabLevel.lumpSectors = prefabLevel.lumpReject = nullptr;
+	prefabLevel.transforms = tforms;
+	prefabLevel.transforms.xShift = 0;
+	prefabLevel.transforms.yShift = 0;
+	prefabLevel.metersPerPixel = level.metersPerPixel;
+	prefabLevel.wallDimensions = level.wallDimensions;
+
+	// Vertices and sidedefs in order of first use
+	std::unordered_map<uint16_t, uint16_t> localVertices;
+	std::vector<uint16_t> vertices;
+	int32_t sideCount = 0;
+	for (int32_t lineIndex : prefab.lines) {
+		const LineDef& line = level.linedefs[lineIndex];
+		uint16_t ends[2] = {line.vertexStart, line.vertexEnd};
+		for (uint16_t v : ends)
+			if (localVertices.emplace(v, static_cast<uint16_t>(vertices.size())).second)
+				vertices.push_back(v);
+		sideCount += line.sideBack == NO_SIDEDEF ? 1 : 2;
+	}
+
+	prefabLevel.vertices.Reserve(static_cast<int32_t>(vertices.size()));
+	prefabLevel.verts.Reserve(prefabLevel.vertices.Num());
+	for (int32_t i = 0; i < prefabLevel.vertices.Num(); i++) {
+		Vertex& v = prefabLevel.vertices[i];
+		v.x = static_cast<int16_t>(level.vertices[vertices[i]].x - prefab.originX);
+		v.y = static_cast<int16_t>(level.vertices[vertices[i]].y - prefab.originY);
+		prefabLevel.verts[i].x = v.x / tforms.xyDownscale;
+		prefabLevel.verts[i].y = v.y / tforms.xyDownscale;
+	}
+
+	std::unordered_map<int32_t, int16_t> localSectors;
+	for (size_t i = 0; i < prefab.sectors.size(); i++)
+		localSectors[prefab.sectors[i]] = static_cast<int16_t>(i);
+
+	prefabLevel.linedefs.Reserve(static_cast<int32_t>(prefab.lines.size()));
+	prefabLevel.sidedefs.Reserve(sideCount);
+	uint16_t nextSide = 0;
+	for (int32_t i = 0; i < prefabLevel.linedefs.Num(); i++) {
+		const LineDef& source = level.linedefs[prefab.lines[i]];
+		LineDef& line = prefabLevel.linedefs[i];
+		line = source;
+		line.vertexStart = localVertices[source.vertexStart];
+		line.vertexEnd = localVertices[source.vertexEnd];
+
+		uint16_t* sides[2] = {&line.sideFront, &line.sideBack};
+		for (uint16_t* side : sides) {
+			if (*side == NO_SIDEDEF)
+				continue;
+			SideDef& copy = prefabLevel.sidedefs[nextSide];
+			copy = level.sidedefs[*side];
+			copy.sector = localSectors[copy.sector];
+			*side = nextSide++;
+		}
+	}
+
+	prefabLevel.sectors.Reserve(static_cast<int32_t>(prefab.sectors.size()));
+	prefabLevel.minHeight = FLT_MAX;
+	prefabLevel.maxHeight = FLT_TRUE_MIN;
+	for (int32_t i = 0; i < prefabLevel.sectors.Num(); i++) {
+		const Sector& source = level.sectors[prefab.sectors[i]];
+		Sector& sector = prefabLevel.sectors[i];
+		sector.floorHeight = (RawHeight(source.floorHeight, tforms) - prefab.baseHeight) / tforms.zDownscale;
+		sector.ceilHeight = (RawHeight(source.ceilHeight, tforms) - prefab.baseHeight) / tforms.zDownscale;
+		sector.floorTexture = source.floorTexture;
+		sector.ceilingTexture = source.ceilingTexture;
+		sector.lightLevel = source.lightLevel;
+		sector.specialType = source.specialType;
+		sector.tagNumber = source.tagNumber;
+		prefabLevel.minHeight = std::min(prefabLevel.minHeight, sector.floorHeight);
+		prefabLevel.maxHeight = std::max(prefabLevel.maxHeight, sector.ceilHeight);
+	}
+}
+
+bool PrefabLibrary::Claim(uint64_t hash) {
+	std::lock_guard<std::mutex> guard(claimLock);
+	return claimed.insert(hash).second;
+}
+
+bool PrefabLibrary::Write(uint64_t hash, const std::string& text) {
+	std::string path = MapPath(hash) + ".map";
+	return assets.Write(path, text.data(), text.length());
+}
+
+std::string PrefabLibrary::MapPath(uint64_t hash) {
+	char name[17];
+	snprintf(name, sizeof(name), "%016llx", static_cast<unsigned long long>(hash));
+	return std::string(PREFAB_MAP_PREFIX) + name;
+}
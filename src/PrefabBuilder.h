@@ -0,0 +1,98 @@
+#pragma once
+#include "BrushBuilder.h"
+#include <AssetWriter.h>
+#include <mutex>
+#include <string>
+#include <unordered_set>
+
+/*
+* Prefabs
+*
+* Levels repeat the same structures many times: pillars, light fixtures,
+* computer panels. Every island of linedefs, joined to each other through
+* shared vertices, is reduced to a canonical form:
+* - Its vertices relative to a local origin, and heights relative to its lowest floor
+* - Its linedefs sorted by their local vertices
+* - The textures, offsets and relative heights of each side
+* Islands with identical canonical forms are copies of each other.
+*
+* Each shape with enough copies is converted once, as a level of its own, into
+* a reference map named after the hash of its form. Every copy is then written
+* as an entity placing that map at the copy's origin, rather than as brushes.
+* The walls of an island are instanced, along with the floors and ceilings of
+* the sectors lying entirely inside it.
+*
+* Flats are aligned to a grid over the whole level, so islands holding floors
+* keep their origin on that grid, and only match copies offset by whole flats.
+* Walls are textured from their own vertices, so they match at any offset.
+*/
+
+// Copies of a shape needed for it to become a prefab
+#define PREFAB_MIN_COPIES 2
+
+// Islands with fewer linedefs can't enclose anything, and stay brushes
+#define PREFAB_MIN_LINES 3
+
+// Folder of the prefab maps, relative to the base folder
+#define PREFAB_MAP_PREFIX "maps/wadtobrush/prefabs/"
+
+struct Prefab {
+	uint64_t hash;                  // Of the canonical form
+	std::vector<int32_t> lines;     // Linedefs of the first copy, in canonical order
+	std::vector<int32_t> sectors;   // Sectors bordering the first copy, in order of first use
+	std::vector<int32_t> enclosed;  // Indices into sectors of those lying entirely inside the island
+	int32_t originX;                // Of the first copy, in the WAD's units
+	int32_t originY;
+	int32_t baseHeight;
+};
+
+struct PrefabInstance {
+	int32_t prefab;
+	int32_t line;    // Lowest numbered linedef of the copy
+	Vector origin;   // With the level's transforms applied
+};
+
+struct LevelPrefabs {
+	std::vector<Prefab> prefabs;
+	std::vector<PrefabInstance> instances; // In order of their lowest numbered linedef
+	std::vector<bool> lines;               // Linedefs whose walls are instanced
+	std::vector<bool> sectors;             // Sectors whose floors and ceilings are instanced
+
+	bool LineInstanced(int32_t lineIndex) const {
+		return static_cast<size_t>(lineIndex) < lines.size() && lines[lineIndex];
+	}
+
+	bool SectorInstanced(int32_t sectorIndex) const {
+		return static_cast<size_t>(sectorIndex) < sectors.size() && sectors[sectorIndex];
+	}
+};
+
+void FindPrefabs(const WadLevel& level, LevelPrefabs& prefabs);
+
+/*
+* Copies the first copy of a prefab into a level of its own, relative to its
+* origin. Linedefs and sectors are numbered in the prefab's canonical order.
+* The level has no lumps, so it must not be looked up by name.
+*/
+void BuildPrefabLevel(const WadLevel& level, const Prefab& prefab, WadLevel& prefabLevel);
+
+/*
+* Prefab maps written so far. Shared by every level converted at once, so a
+* shape repeated across levels is written a single time. Thread-safe.
+*/
+class PrefabLibrary {
+	private:
+	AssetWriter& assets;
+	std::unordered_set<uint64_t> claimed;
+	std::mutex claimLock;
+
+	public:
+	PrefabLibrary(AssetWriter& p_assets) : assets(p_assets) {}
+
+	// True only the first time it's called for a hash, when the caller should write the prefab
+	bool Claim(uint64_t hash);
+	bool Write(uint64_t hash, const std::string& text);
+
+	// The map's path, without its extension
+	static std::string MapPath(uint64_t hash);
+};
@@ -0,0 +1,178 @@
+#include "Process.h"
+#include <cctype>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <cerrno>
+#include <chrono>
+#include <thread>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#endif
+
+std::vector<std::string> SplitArguments(const std::string& line) {
+	std::vector<std::string> args;
+	size_t i = 0;
+	while (i < line.length()) {
+		if (isspace(static_cast<unsigned char>(line[i]))) {
+			i++;
+			continue;
+		}
+
+		size_t end;
+		if (line[i] == '"') {
+			end = line.find('"', i + 1);
+			if (end == std::string::npos)
+				end = line.length();
+			args.push_back(line.substr(i + 1, end - i - 1));
+			end++;
+		}
+		else {
+			end = i;
+			while (end < line.length() && !isspace(static_cast<unsigned char>(line[end])))
+				end++;
+			args.push_back(line.substr(i, end - i));
+		}
+		i = end;
+	}
+	return args;
+}
+
+#ifdef _WIN32
+
+// Quotes an argument following the rules CommandLineToArgvW uses to split it again
+void AppendQuoted(std::string& commandLine, const std::string& arg) {
+	commandLine.push_back('"');
+	size_t backslashes = 0;
+	for (char c : arg) {
+		if (c == '\\') {
+			backslashes++;
+			continue;
+		}
+		if (c == '"')
+			backslashes = backslashes * 2 + 1;
+		commandLine.append(backslashes, '\\');
+		commandLine.push_back(c);
+		backslashes = 0;
+	}
+	commandLine.append(backslashes * 2, '\\');
+	commandLine.push_back('"');
+}
+
+int RunProcess(const std::vector<std::string>& args, const std::string& logPath, double timeoutSeconds) {
+	std::string commandLine;
+	for (size_t i = 0; i < args.size(); i++) {
+		if (i > 0)
+			commandLine.push_back(' ');
+		AppendQuoted(commandLine, args[i]);
+	}
+
+	SECURITY_ATTRIBUTES inherit = {sizeof(SECURITY_ATTRIBUTES), nullptr, TRUE};
+	HANDLE log = CreateFileA(logPath.data(), GENERIC_WRITE, FILE_SHARE_READ, &inherit, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (log == INVALID_HANDLE_VALUE)
+		return PROCESS_NOT_STARTED;
+
+	// Only the log may be inherited, not the logs of children started by other threads
+	SIZE_T attributeSize = 0;
+	InitializeProcThreadAttributeList(nullptr, 1, 0, &attributeSize);
+	std::vector<char> attributeBuffer(attributeSize);
+	LPPROC_THREAD_ATTRIBUTE_LIST attributes = reinterpret_cast<LPPROC_THREAD_ATTRIBUTE_LIST>(attributeBuffer.data());
+	if (!InitializeProcThreadAttributeList(attributes, 1, 0, &attributeSize)) {
+		CloseHandle(log);
+		return PROCESS_NOT_STARTED;
+	}
+
+	// The child gets no stdin, since it would have to be listed as inheritable too
+	STARTUPINFOEXA startup = {};
+	startup.StartupInfo.cb = sizeof(startup);
+	startup.StartupInfo.dwFlags = STARTF_USESTDHANDLES;
+	startup.StartupInfo.hStdInput = nullptr;
+	startup.StartupInfo.hStdOutput = log;
+	startup.StartupInfo.hStdError = log;
+	startup.lpAttributeList = attributes;
+
+	PROCESS_INFORMATION process = {};
+	bool started = UpdateProcThreadAttribute(attributes, 0, PROC_THREAD_ATTRIBUTE_HANDLE_LIST, &log, sizeof(HANDLE), nullptr, nullptr)
+		&& CreateProcessA(nullptr, &commandLine[0], nullptr, nullptr, TRUE, CREATE_NO_WINDOW | EXTENDED_STARTUPINFO_PRESENT,
+			nullptr, nullptr, &startup.StartupInfo, &process);
+	DeleteProcThreadAttributeList(attributes);
+	if (!started) {
+		CloseHandle(log);
+		return PROCESS_NOT_STARTED;
+	}
+	CloseHandle(process.hThread);
+
+	DWORD wait = timeoutSeconds > 0 ? static_cast<DWORD>(timeoutSeconds * 1000) : INFINITE;
+	int result = PROCESS_TIMED_OUT;
+	DWORD waited = WaitForSingleObject(process.hProcess, wait);
+	if (waited != WAIT_OBJECT_0) {
+		TerminateProcess(process.hProcess, 1);
+		WaitForSingleObject(process.hProcess, INFINITE);
+		if (waited != WAIT_TIMEOUT)
+			result = PROCESS_WAIT_FAILED;
+	}
+	else {
+		DWORD exitCode = 0;
+		result = GetExitCodeProcess(process.hProcess, &exitCode) ? static_cast<int>(exitCode) : PROCESS_WAIT_FAILED;
+	}
+	CloseHandle(process.hProcess);
+	CloseHandle(log);
+	return result;
+}
+
+#else
+
+int RunProcess(const std::vector<std::string>& args, const std::string& logPath, double timeoutSeconds) {
+	// Close-on-exec, so children started by other threads don't inherit it. dup2 clears the flag for this child
+	int log = open(logPath.data(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	if (log < 0)
+		return PROCESS_NOT_STARTED;
+
+	std::vector<char*> argv;
+	for (const std::string& arg : args)
+		argv.push_back(const_cast<char*>(arg.data()));
+	argv.push_back(nullptr);
+
+	pid_t child = fork();
+	if (child == 0) {
+		dup2(log, STDOUT_FILENO);
+		dup2(log, STDERR_FILENO);
+		close(log);
+		execvp(argv[0], argv.data());
+		_exit(127);
+	}
+	close(log);
+	if (child < 0)
+		return PROCESS_NOT_STARTED;
+
+	// Poll, since there's no portable way to wait on a child with a timeout
+	auto deadline = std::chrono::steady_clock::now() + std::chrono::duration<double>(timeoutSeconds);
+	int status = 0;
+	for (;;) {
+		pid_t waited = waitpid(child, &status, timeoutSeconds > 0 ? WNOHANG : 0);
+		if (waited == child)
+			break;
+		if (waited < 0) {
+			if (errno == EINTR)
+				continue;
+			return PROCESS_WAIT_FAILED;
+		}
+		if (std::chrono::steady_clock::now() >= deadline) {
+			kill(child, SIGKILL);
+			while (waitpid(child, &status, 0) < 0 && errno == EINTR) {}
+			return PROCESS_TIMED_OUT;
+		}
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+	}
+
+	if (WIFEXITED(status))
+		return WEXITSTATUS(status);
+	return 128 + WTERMSIG(status); // Crashed
+}
+
+#endif
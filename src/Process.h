@@ -0,0 +1,21 @@
+#pragma once
+#include <string>
+#include <vector>
+
+// Splits a line into whitespace-separated arguments. Arguments containing spaces may be "quoted"
+std::vector<std::string> SplitArguments(const std::string& line);
+
+#define PROCESS_TIMED_OUT -1
+#define PROCESS_NOT_STARTED -2
+#define PROCESS_WAIT_FAILED -3
+
+/*
+* Runs a program in a child process and waits for it to finish, so a crash only
+* takes down the child. Its stdout and stderr are written to logPath. If it runs
+* for longer than timeoutSeconds (when positive) it's killed. The log is only
+* inherited by this child, so several may be run at once from different threads.
+*
+* Returns the program's exit code, PROCESS_TIMED_OUT, PROCESS_NOT_STARTED, or
+* PROCESS_WAIT_FAILED if its exit code could not be retrieved.
+*/
+int RunProcess(const std::vector<std::string>& args, const std::string& logPath, double timeoutSeconds);
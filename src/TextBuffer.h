@@ -0,0 +1,133 @@
+#pragma once
+#include <charconv>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+
+/*
+* Append-only text buffer used to format map files.
+*
+* Numbers are written with std::to_chars, which bypasses the locale-aware
+* iostream machinery entirely. Floats are written in their shortest round-trip
+* fixed notation by default ("1", "0.5", "25.6"), or with a fixed number of
+* decimals if a precision is set. Constant text should be appended as string
+* literals so its length is known at compile time.
+*/
+class TextBuffer {
+	private:
+	// Large enough for any float printed in fixed notation, with or without precision
+	static constexpr size_t MAX_NUMBER_CHARS = 64;
+
+	// A sign, 39 integer digits, the point and this many decimals fit in MAX_NUMBER_CHARS.
+	// Floats have no more than 9 significant digits anyway.
+	static constexpr int MAX_PRECISION = 20;
+
+	char* buffer = nullptr;
+	size_t length = 0;
+	size_t capacity = 0;
+	int precision = -1; // Negative for shortest round-trip output
+
+	void Grow(size_t required) {
+		size_t newCapacity = capacity < 4096 ? 4096 : capacity * 2;
+		while(newCapacity < required)
+			newCapacity *= 2;
+
+		char* newBuffer = new char[newCapacity];
+		if(length > 0)
+			memcpy(newBuffer, buffer, length);
+		delete[] buffer;
+		buffer = newBuffer;
+		capacity = newCapacity;
+	}
+
+	void Reserve(size_t extra) {
+		if(length + extra > capacity)
+			Grow(length + extra);
+	}
+
+	// Formats a number in place with format(first, last), making room if it didn't fit
+	template<typename Format>
+	void AppendNumber(Format format) {
+		for(size_t room = MAX_NUMBER_CHARS; ; room *= 2) {
+			Reserve(room);
+			std::to_chars_result result = format(buffer + length, buffer + capacity);
+			if(result.ec == std::errc()) {
+				length = result.ptr - buffer;
+				return;
+			}
+		}
+	}
+
+	static int ClampPrecision(int p_precision) {
+		return p_precision > MAX_PRECISION ? MAX_PRECISION : p_precision;
+	}
+
+	public:
+	TextBuffer() {}
+
+	// Precisions above MAX_PRECISION are clamped to it
+	TextBuffer(int p_precision) : precision(ClampPrecision(p_precision)) {}
+
+	TextBuffer(const TextBuffer&) = delete;
+	TextBuffer& operator=(const TextBuffer&) = delete;
+
+	~TextBuffer() {
+		delete[] buffer;
+	}
+
+	void SetPrecision(int p_precision) {
+		precision = ClampPrecision(p_precision);
+	}
+
+	const char* Data() const {
+		return buffer;
+	}
+
+	size_t Length() const {
+		return length;
+	}
+
+	void Clear() {
+		length = 0;
+	}
+
+	void Append(const char* s, size_t n) {
+		Reserve(n);
+		memcpy(buffer + length, s, n);
+		length += n;
+	}
+
+	// Pre-baked string fragments - length is resolved at compile time
+	template<size_t N>
+	void Append(const char (&s)[N]) {
+		Append(s, N - 1);
+	}
+
+	void AppendCString(const char* s) {
+		Append(s, strlen(s));
+	}
+
+	void Append(char c) {
+		Reserve(1);
+		buffer[length++] = c;
+	}
+
+	void AppendInt(int64_t value) {
+		AppendNumber([value](char* first, char* last) {
+			return std::to_chars(first, last, value);
+		});
+	}
+
+	void AppendFloat(float value) {
+		// Avoid writing negative zeroes
+		if(value == 0.0f)
+			value = 0.0f;
+
+		int digits = precision;
+		AppendNumber([value, digits](char* first, char* last) {
+			if(digits < 0)
+				return std::to_chars(first, last, value, std::chars_format::fixed);
+			return std::to_chars(first, last, value, std::chars_format::fixed, digits);
+		});
+	}
+};
@@ -0,0 +1,244 @@
+#include "ThingBuilder.h"
+#include <sstream>
+#include <fstream>
+#include <algorithm>
+#include <cmath>
+
+// Things with an obvious counterpart in the game. Player starts come first.
+const char* defaultThingTable = R"(# Type Name Inherit Edits
+1 player/start1 player_start
+2 player/start2 player_start
+3 player/start3 player_start
+4 player/start4 player_start
+11 player/deathmatch player_start_deathmatch
+
+3004 monsters/zombieman ai/fodder/zombie_t1
+9 monsters/shotgunguy ai/fodder/soldier_shotgun
+65 monsters/chaingunner ai/fodder/soldier_chaingun
+3001 monsters/imp ai/fodder/imp
+3002 monsters/demon ai/heavy/pinky
+58 monsters/spectre ai/heavy/pinky_spectre
+3006 monsters/lostsoul ai/fodder/lost_soul
+3005 monsters/cacodemon ai/heavy/cacodemon
+3003 monsters/baron ai/heavy/baron
+69 monsters/knight ai/heavy/hell_knight
+64 monsters/archvile ai/heavy/archvile
+66 monsters/revenant ai/heavy/revenant
+67 monsters/mancubus ai/heavy/mancubus
+68 monsters/arachnotron ai/heavy/arachnotron
+71 monsters/painelemental ai/heavy/pain_elemental
+16 monsters/cyberdemon ai/super_heavy/cyberdemon
+7 monsters/spidermastermind ai/super_heavy/spider_mastermind
+
+2001 weapons/shotgun pickup/weapon/shotgun
+82 weapons/supershotgun pickup/weapon/double_barrel
+2002 weapons/chaingun pickup/weapon/chaingun
+2003 weapons/rocketlauncher pickup/weapon/rocket_launcher
+2004 weapons/plasmagun pickup/weapon/plasma_rifle
+2006 weapons/bfg pickup/weapon/bfg
+2005 weapons/chainsaw pickup/weapon/chainsaw
+
+2011 pickups/stimpack pickup/health/small
+2012 pickups/medikit pickup/health/medium
+2014 pickups/healthbonus pickup/health/bonus
+2015 pickups/armorbonus pickup/armor/bonus
+2018 pickups/greenarmor pickup/armor/medium
+2019 pickups/bluearmor pickup/armor/large
+2013 pickups/soulsphere pickup/powerup/soulsphere
+83 pickups/megasphere pickup/powerup/megasphere
+2022 pickups/invulnerability pickup/powerup/invulnerability
+2023 pickups/berserk pickup/powerup/berserk
+2007 pickups/clip pickup/ammo/bullets_small
+2048 pickups/ammobox pickup/ammo/bullets_large
+2008 pickups/shells pickup/ammo/shells_small
+2049 pickups/shellbox pickup/ammo/shells_large
+2010 pickups/rocket pickup/ammo/rockets_small
+2046 pickups/rocketbox pickup/ammo/rockets_large
+2047 pickups/cell pickup/ammo/cells_small
+17 pickups/cellpack pickup/ammo/cells_large
+
+5 keys/bluecard pickup/key/blue
+6 keys/yellowcard pickup/key/yellow
+13 keys/redcard pickup/key/red
+40 keys/blueskull pickup/key/blue_skull
+39 keys/yellowskull pickup/key/yellow_skull
+38 keys/redskull pickup/key/red_skull
+)";
+
+void ThingTable::LoadDefaults() {
+	templates.clear();
+	types.clear();
+	Parse(defaultThingTable, EventSink());
+}
+
+bool ThingTable::Parse(const std::string& text, const EventSink& events) {
+	std::istringstream input(text);
+	std::string line;
+	int lineNumber = 0;
+	bool success = true;
+	while (std::getline(input, line)) {
+		lineNumber++;
+		std::istringstream fields(line);
+		int type;
+		ThingTemplate t;
+		if (!(fields >> type)) {
+			size_t first = line.find_first_not_of(" \t\r");
+			if (first != std::string::npos && line[first] != '#') {
+				events.Reportf(EVENT_ERROR, "Malformed thing table line %i", lineNumber);
+				success = false;
+			}
+			continue;
+		}
+		if (!(fields >> t.name >> t.inherit)) {
+			events.Reportf(EVENT_ERROR, "Malformed thing table line %i", lineNumber);
+			success = false;
+			continue;
+		}
+		std::getline(fields, t.edits);
+		size_t first = t.edits.find_first_not_of(" \t");
+		size_t last = t.edits.find_last_not_of(" \t\r");
+		t.edits = first == std::string::npos ? std::string() : t.edits.substr(first, last - first + 1);
+
+		// Types sharing a name share its template, defined by the last line naming it
+		auto existing = std::find_if(templates.begin(), templates.end(), [&](const ThingTemplate& e) {
+			return e.name == t.name;
+		});
+		types[static_cast<int16_t>(type)] = existing - templates.begin();
+		if (existing == templates.end())
+			templates.push_back(t);
+		else *existing = t;
+	}
+	return success;
+}
+
+bool ThingTable::Load(const std::string& path, const EventSink& events) {
+	std::ifstream file(path, std::ios_base::binary);
+	if (file.fail()) {
+		events.Reportf(EVENT_ERROR, "Unable to read thing table %s", path.data());
+		return false;
+	}
+	std::stringstream text;
+	text << file.rdbuf();
+	return Parse(text.str(), events);
+}
+
+const ThingTemplate* ThingTable::Find(int16_t type) const {
+	auto found = types.find(type);
+	return found == types.end() ? nullptr : &templates[found->second];
+}
+
+void ThingTable::WriteTemplates(AssetWriter& assets, const EventSink& events) const {
+	for (const ThingTemplate& t : templates) {
+		std::string decl = "declType( entityDef ) {\n\tinherit = \"" + t.inherit + "\";\n\tedit = {\n";
+		if (!t.edits.empty())
+			decl += "\t\t" + t.edits + "\n";
+		decl += "\t}\n}";
+
+		std::string path = "declTree/entityDef/" THING_TEMPLATE_PREFIX + t.name + ".decl";
+		if (!assets.Write(path, decl.data(), decl.length()))
+			events.Reportf(EVENT_ERROR, "ERROR: FAILED TO WRITE %s", path.data());
+	}
+}
+
+SectorLocator::SectorLocator(const WadLevel& p_level) : level(p_level) {
+	if (level.vertices.Num() == 0)
+		return;
+
+	int32_t minX = INT32_MAX, minY = INT32_MAX, maxX = INT32_MIN, maxY = INT32_MIN;
+	for (int32_t i = 0; i < level.vertices.Num(); i++) {
+		const Vertex& v = level.vertices[i];
+		minX = std::min(minX, static_cast<int32_t>(v.x));
+		minY = std::min(minY, static_cast<int32_t>(v.y));
+		maxX = std::max(maxX, static_cast<int32_t>(v.x));
+		maxY = std::max(maxY, static_cast<int32_t>(v.y));
+	}
+	originX = minX;
+	originY = minY;
+	columns = (maxX - minX) / CELL_SIZE + 1;
+	rows = (maxY - minY) / CELL_SIZE + 1;
+
+	// Count the linedefs overlapping each cell, then fill them in
+	auto forCells = [&](const LineDef& line, auto func) {
+		const Vertex& v0 = level.vertices[line.vertexStart];
+		const Vertex& v1 = level.vertices[line.vertexEnd];
+		int32_t c0 = (std::min(v0.x, v1.x) - originX) / CELL_SIZE, c1 = (std::max(v0.x, v1.x) - originX) / CELL_SIZE;
+		int32_t r0 = (std::min(v0.y, v1.y) - originY) / CELL_SIZE, r1 = (std::max(v0.y, v1.y) - originY) / CELL_SIZE;
+		for (int32_t r = r0; r <= r1; r++)
+			for (int32_t c = c0; c <= c1; c++)
+				func(r * columns + c);
+	};
+	cellStarts.assign(static_cast<size_t>(columns) * rows + 1, 0);
+	for (int32_t i = 0; i < level.linedefs.Num(); i++)
+		if (level.linedefs[i].sideFront != NO_SIDEDEF)
+			forCells(level.linedefs[i], [&](int32_t cell) { cellStarts[cell + 1]++; });
+	for (size_t i = 1; i < cellStarts.size(); i++)
+		cellStarts[i] += cellStarts[i - 1];
+
+	cellLines.resize(cellStarts.back());
+	std::vector<uint32_t> filled(cellStarts.begin(), cellStarts.end() - 1);
+	for (int32_t i = 0; i < level.linedefs.Num(); i++)
+		if (level.linedefs[i].sideFront != NO_SIDEDEF)
+			forCells(level.linedefs[i], [&](int32_t cell) { cellLines[filled[cell]++] = i; });
+}
+
+int32_t SectorLocator::Find(int32_t x, int32_t y) const {
+	int32_t row = (y - originY) / CELL_SIZE;
+	if (y < originY || row >= rows || x >= originX + columns * CELL_SIZE)
+		return -1;
+
+	double nearest = INFINITY;
+	int32_t hitLine = -1;
+	for (int32_t column = std::max(0, (x - originX) / CELL_SIZE); column < columns; column++) {
+		int32_t cell = row * columns + column;
+		for (uint32_t i = cellStarts[cell]; i < cellStarts[cell + 1]; i++) {
+			const LineDef& line = level.linedefs[cellLines[i]];
+			const Vertex& v0 = level.vertices[line.vertexStart];
+			const Vertex& v1 = level.vertices[line.vertexEnd];
+
+			// Lines ending on the ray's height only count at their lower end, so a vertex isn't hit twice
+			if ((v0.y > y) == (v1.y > y))
+				continue;
+			double crossX = v0.x + static_cast<double>(y - v0.y) * (v1.x - v0.x) / (v1.y - v0.y);
+			if (crossX >= x && crossX < nearest) {
+				nearest = crossX;
+				hitLine = cellLines[i];
+			}
+		}
+
+		// Nothing in a later cell can be closer
+		if (hitLine >= 0 && nearest <= originX + (column + 1) * CELL_SIZE)
+			break;
+	}
+	if (hitLine < 0)
+		return -1;
+
+	// Sectors are on the right of their front sides
+	const LineDef& line = level.linedefs[hitLine];
+	const Vertex& v0 = level.vertices[line.vertexStart];
+	const Vertex& v1 = level.vertices[line.vertexEnd];
+	int64_t side = static_cast<int64_t>(v1.x - v0.x) * (y - v0.y) - static_cast<int64_t>(v1.y - v0.y) * (x - v0.x);
+	uint16_t sideIndex = side <= 0 ? line.sideFront : line.sideBack;
+	return sideIndex == NO_SIDEDEF ? -1 : level.sidedefs[sideIndex].sector;
+}
+
+void BuildThings(const WadLevel& level, const ThingTable& table, std::vector<ThingEntity>& entities) {
+	entities.clear();
+	SectorLocator locator(level);
+	const VertexTransforms& tforms = level.transforms;
+	for (int32_t i = 0; i < level.things.Num(); i++) {
+		const Thing& thing = level.things[i];
+		const ThingTemplate* source = table.Find(thing.type);
+		if (source == nullptr || (thing.flags & THING_MULTIPLAYER))
+			continue;
+
+		int32_t sector = locator.Find(thing.x, thing.y);
+		float floor = sector < 0 ? level.minHeight : level.sectors[sector].floorHeight;
+
+		ThingEntity entity;
+		entity.thing = i;
+		entity.source = source;
+		entity.origin = Vector((thing.x + tforms.xShift) / tforms.xyDownscale, (thing.y + tforms.yShift) / tforms.xyDownscale, floor);
+		entity.angle = thing.angle;
+		entities.push_back(entity);
+	}
+}
@@ -0,0 +1,86 @@
+#pragma once
+#include "BrushBuilder.h"
+#include "Events.h"
+#include <AssetWriter.h>
+#include <string>
+#include <unordered_map>
+
+/*
+* Things
+*
+* Every thing whose type has an entry in a ThingTable is written as an entity.
+* The properties shared by all things of a type live in an entityDef template,
+* wadtobrush/things/[Name], exported once with WriteTemplates, so each entity
+* in the map only holds what differs between them: position and facing.
+*
+* Tables are text, with one type per line:
+*   [Type] [Name] [Inherit] [Edits...]
+* The template inherits from the entityDef Inherit, and the rest of the line is
+* copied into its edit block. Blank lines and lines starting with # are ignored.
+* Later lines replace earlier ones for the same type or template name.
+*/
+struct ThingTemplate {
+	std::string name;
+	std::string inherit;
+	std::string edits;
+};
+
+class ThingTable {
+	private:
+	std::vector<ThingTemplate> templates;
+	std::unordered_map<int16_t, size_t> types;
+
+	public:
+	// Replaces the table with the built-in one, covering the common things of Doom and Doom II
+	void LoadDefaults();
+
+	// Adds the table's entries to the current ones. Returns false if a line is malformed.
+	bool Parse(const std::string& text, const EventSink& events);
+	bool Load(const std::string& path, const EventSink& events);
+
+	// Nullptr if things of the type aren't converted
+	const ThingTemplate* Find(int16_t type) const;
+
+	// Writes a decl for each template, to declTree/entityDef/wadtobrush/things/
+	void WriteTemplates(AssetWriter& assets, const EventSink& events) const;
+};
+
+// Path of a template's entityDef, for entities to inherit from
+#define THING_TEMPLATE_PREFIX "wadtobrush/things/"
+
+// Things with this flag only appear in multiplayer, and are skipped
+#define THING_MULTIPLAYER 0x10
+
+/*
+* Finds the sector containing a point, from the nearest linedef crossed by a
+* ray cast east from it. The linedefs are binned into a grid of square cells,
+* so only the cells along the ray, up to the first hit, are searched.
+*/
+class SectorLocator {
+	private:
+	static constexpr int32_t CELL_SIZE = 128;
+
+	const WadLevel& level;
+	int32_t originX = 0;
+	int32_t originY = 0;
+	int32_t columns = 0;
+	int32_t rows = 0;
+	std::vector<uint32_t> cellStarts; // Index into cellLines of each cell's first linedef, plus one past the end
+	std::vector<int32_t> cellLines;
+
+	public:
+	SectorLocator(const WadLevel& p_level);
+
+	// The sector holding the point, in the WAD's units, or -1 if it's outside the level
+	int32_t Find(int32_t x, int32_t y) const;
+};
+
+struct ThingEntity {
+	int32_t thing;                  // Index into WadLevel::things
+	const ThingTemplate* source;
+	Vector origin;                  // On the floor, with the level's transforms applied
+	float angle;
+};
+
+// Entities are returned in the order of the THINGS lump
+void BuildThings(const WadLevel& level, const ThingTable& table, std::vector<ThingEntity>& entities);
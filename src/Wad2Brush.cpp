@@ -1,223 +1,317 @@
 #include <vector>
-#include "MapWriter.h"
+#include "LevelBuilder.h"
+#include "Parallel.h"
+#include "Daemon.h"
+#include "Batch.h"
+#include "MapMerge.h"
 #include <iostream>
-#include <earcut.hpp>
-#include <array>
 #include <filesystem>
+#include <thread>
+#include <mutex>
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cmath>
 
 
-void BuildLevel(WadLevel& level) {
-	MapWriter writer(level);
-
-	// STEP 1: WALL BRUSHES
-	for (int32_t i = 0; i < level.linedefs.Num(); i++) {	
-		LineDef& line = level.linedefs[i];
-		VertexFloat v0(level.verts[line.vertexStart]);
-		VertexFloat v1(level.verts[line.vertexEnd]);
-		bool upperUnpegged = line.flags & UPPER_UNPEGGED;
-		bool lowerUnpegged = line.flags & LOWER_UNPEGGED;
-
-		// We assume linedefs can't have a back sidedef without a front
-		if(line.sideFront == NO_SIDEDEF)
-			continue;
-
-		SideDef& frontSide = level.sidedefs[line.sideFront];
-		Sector& frontSector = level.sectors[frontSide.sector];
-
-		// Create this for later use
-		SimpleLineDef simple;
-		simple.v0 = level.verts[line.vertexStart];
-		simple.v1 = level.verts[line.vertexEnd];
-		frontSector.lines.push_back(simple);
-
-		/*
-		* Draw Height Rules:
-		*
-		* One Sided: Ceiling (Default) / Floor (Lower Unpegged)
-		* Lower Textures: Highest Floor (Default) / Ceiling the side is facing (Lower Unpegged) 
-			- WIKI IS INCORRECT: Falsely asserts Lower Unpegged draws it from the higher ceiling downward
-		* Upper Textures: Lowest Ceiling (Default) / Highest Ceiling (Upper Unpegged)
-		* Middle Textures:
-		*	- Do not repeat vertically - we must modify the brush bounds to account for this
-		*		- TODO: THIS QUIRK IS NOT YET IMPLEMENTED
-		*	- Highest Ceiling (Default) / Highest Floor (Lower Unpegged)
-		*
-		* No need for any crazy vector projection when calculating drawheight, so we can simply add in the
-		* vertical offset right now
-		*/
-
-		if (line.sideBack == NO_SIDEDEF) {
-			float drawHeight = frontSide.offsetY + (lowerUnpegged ? frontSector.floorHeight : frontSector.ceilHeight);
-			// level.minHeight, level.maxHeight
-			writer.WriteWallBrush(v0, v1, frontSector.floorHeight, frontSector.ceilHeight, drawHeight, frontSide.middleTexture, frontSide.offsetX);
-		} else {
-			SideDef& backSide = level.sidedefs[line.sideBack];
-			Sector& backSector = level.sectors[backSide.sector];
-			backSector.lines.push_back(simple);
-
-			// Texture pegging is based on the lowest/highest floor/ceiling - so we must distinguish
-			// which values are smaller / larger - no way around this ugly chain of if statements unfortunately
-			float lowerFloor, lowerCeiling, higherFloor, higherCeiling;
-			if (frontSector.ceilHeight < backSector.ceilHeight) {
-				lowerCeiling = frontSector.ceilHeight;
-				higherCeiling = backSector.ceilHeight;
-			} else {
-				lowerCeiling = backSector.ceilHeight;
-				higherCeiling = frontSector.ceilHeight;
-			}
-			if (frontSector.floorHeight < backSector.floorHeight) {
-				lowerFloor = frontSector.floorHeight;
-				higherFloor = backSector.floorHeight;
-			} else {
-				lowerFloor = backSector.floorHeight;
-				higherFloor = frontSector.floorHeight;
-			}
+void DebugTextures() {
+	Wad doomwad;
+	doomwad.ReadFrom("DOOM.WAD");
+	//doomwad.WriteLumpNames();
+	DiskAssetWriter assets("base/");
+	doomwad.ExportTextures(true, true, true, assets);
+}
 
-			// Brush the front sidedefs in relation to the back sector heights
-			if (frontSide.lowerTexture != "-") {
-				
-				//float drawHeight = frontSide.offsetY + (lowerUnpegged ? higherCeiling : higherFloor);
-				//float drawHeight = frontSide.offsetY + (lowerUnpegged ? frontSector.ceilHeight : frontSector.floorHeight);
-				float drawHeight = frontSide.offsetY + (lowerUnpegged ? frontSector.ceilHeight : higherFloor);
-				// level.minHeight, backSector.floorHeight
-				writer.WriteWallBrush(v0, v1, frontSector.floorHeight, backSector.floorHeight, drawHeight, frontSide.lowerTexture, frontSide.offsetX);
-			}
-			if (frontSide.middleTexture != "-") {
-				float drawHeight = frontSide.offsetY + (lowerUnpegged ? higherFloor : higherCeiling);
-				writer.WriteWallBrush(v0, v1, backSector.floorHeight, backSector.ceilHeight, drawHeight, frontSide.middleTexture, frontSide.offsetX);
-			}
-			if (frontSide.upperTexture != "-") {
-				float drawHeight = frontSide.offsetY + upperUnpegged ? higherCeiling : lowerCeiling;
-				// backSector.ceilHeight, level.maxHeight
-				writer.WriteWallBrush(v0, v1, backSector.ceilHeight, frontSector.ceilHeight, drawHeight, frontSide.upperTexture, frontSide.offsetX);
-			}
+// Guards status messages printed while several levels convert at once
+std::mutex logLock;
 
-			// Brush the back sidedefs in relation to the front sector heights
-			// Technically this results in two overlapped brushes. However, this is rare
-			// enough to not be considered an issue (yet) - back-textured surfaces mainly
-			// appear to be windows
-			// BUG FIXED: Must swap start/end vertices to ensure texture is drawn on correct face
-			// and begins at correct position
-			if (backSide.lowerTexture != "-") {
-				//float drawHeight = backSide.offsetY + lowerUnpegged ? higherCeiling : higherFloor;
-				//float drawHeight = backSide.offsetY + (lowerUnpegged ? backSector.ceilHeight : backSector.floorHeight);
-				float drawHeight = backSide.offsetY + lowerUnpegged ? backSector.ceilHeight : higherFloor;
-				// level.minHeight, frontSector.floorHeight
-				writer.WriteWallBrush(v1, v0, backSector.floorHeight, frontSector.floorHeight, drawHeight, backSide.lowerTexture, backSide.offsetX);
-			}
-			if (backSide.middleTexture != "-") {
-				float drawHeight = backSide.offsetY + (lowerUnpegged ? higherFloor : higherCeiling);
-				writer.WriteWallBrush(v1, v0, frontSector.floorHeight, frontSector.ceilHeight, drawHeight, backSide.middleTexture, backSide.offsetX);
-			}
-			if (backSide.upperTexture != "-") {
-				float drawHeight = backSide.offsetY + upperUnpegged ? higherCeiling : lowerCeiling;
-				// frontSector.ceilHeight, level.maxHeight
-				writer.WriteWallBrush(v1, v0, frontSector.ceilHeight, backSector.ceilHeight, drawHeight, backSide.upperTexture, backSide.offsetX);
-			}
-		}
-	}
+// Prints conversion events to the log, which is stderr when map data is written to stdout
+void LogEvent(const Event& e, void* userData) {
+	std::ostream& log = *static_cast<std::ostream*>(userData);
+	std::lock_guard<std::mutex> guard(logLock);
+	if (e.type == EVENT_INFO)
+		log << e.message << "\n";
+	else std::cerr << e.message << "\n";
+}
 
-	// STEP TWO: FLOOR AND CEILING BRUSHES....
-
-	for (int sectorIndex = 0; sectorIndex < level.sectors.Num(); sectorIndex++) {
-		Sector& sector = level.sectors[sectorIndex];
-		
-		//std::cout << "Sorting Sector " << sectorIndex << " with " << sector.lines.size() << " Linedefs\n";
-
-		// Assemble Data
-		std::vector<SimpleLineDef>& unsorted = sector.lines;
-		std::vector<SimpleLineDef> sorted;
-		sorted.reserve(sector.lines.size());
-
-		// Sort first linedef
-		sorted.push_back(unsorted[0]);
-		unsorted.erase(unsorted.begin());
-
-		bool forceBreak = false;
-		VertexFloat tempVertex;
-
-		while (!unsorted.empty() && !forceBreak) {
-			SimpleLineDef firstSorted = sorted[0];
-			SimpleLineDef lastSorted = sorted[sorted.size() - 1];
-
-			
-			for(int i = 0, max = unsorted.size(); i < max; i++) {
-				SimpleLineDef current = unsorted[i];
-				if (current.v0 == firstSorted.v0) { // TODO: CONSOLIDATE
-					current.swapOrder();
-					sorted.insert(sorted.begin(), current);
-					unsorted.erase(unsorted.begin() + i);
-					goto LABEL_SKIP_FORCEBREAK;
-				} else if (current.v1 == firstSorted.v0) {
-					sorted.insert(sorted.begin(), current);
-					unsorted.erase(unsorted.begin() + i);
-					goto LABEL_SKIP_FORCEBREAK;
-				} else if (current.v0 == lastSorted.v1) {
-					sorted.push_back(current);
-					unsorted.erase(unsorted.begin() + i);
-					goto LABEL_SKIP_FORCEBREAK;
-				} else if (current.v1 == lastSorted.v1) {
-					current.swapOrder();
-					sorted.push_back(current);
-					unsorted.erase(unsorted.begin() + i);
-					goto LABEL_SKIP_FORCEBREAK;
-				}
-				//std::cout << "----\n";
-				//std::cout << current.v0.x << " " << current.v0.y << " " << current.v1.x << " " << current.v1.y << "\n";
-				//std::cout << firstSorted.v0.x << " " << firstSorted.v0.y << " " << firstSorted.v1.x << " " << firstSorted.v1.y << "\n";
-				//std::cout << lastSorted.v0.x << " " << lastSorted.v0.y << " " << lastSorted.v1.x << " " << lastSorted.v1.y << "\n";
-				//std::cout << "NOTHINGFOUND\n";
-			}
-			forceBreak = true; // For polygons with holes
-			LABEL_SKIP_FORCEBREAK:;
-		}
+/*
+* Regenerates a level's brushes inside an existing .map file, keeping everything
+* else in the file as it is. The merged map replaces the file only once it has
+* been written in full.
+*/
+bool MergeLevel(WadLevel& level, const std::string& fileName, const BuildSettings& settings, std::ostream& log) {
+	std::string existing;
+	{
+		std::ifstream file(fileName, std::ios_base::binary | std::ios_base::ate);
+		if (file.fail())
+			return false;
+		existing.resize(static_cast<size_t>(file.tellg()));
+		file.seekg(0);
+		file.read(existing.data(), existing.size());
+		if (file.fail())
+			return false;
+	}
 
-		if (forceBreak) {
-			std::cout << "Unable to generate floors/ceilings for Sector " << sectorIndex << "\n";
-			continue;
-		}
+	MemorySink generated;
+	BuildLevel(level, generated, settings);
+
+	std::string tempName = fileName + ".tmp";
+	FileSink sink;
+	if (!sink.Open(tempName))
+		return false;
+	MergeStats stats;
+	bool merged = MergeMap(existing.data(), existing.size(), generated.data.data(), generated.data.size(),
+		LevelHandleBase(level.lumpHeader->name), sink, stats);
+	sink.Close();
+
+	// A partly written merge must never replace the edited map
+	merged = merged && !sink.Failed();
+	std::error_code error;
+	if (merged)
+		std::filesystem::rename(tempName, fileName, error);
+	if (!merged || error) {
+		std::filesystem::remove(tempName, error);
+		return false;
+	}
 
-		//for (SimpleLineDef s : sorted) {
-		//	std::cout << "[ (" << s.v0.x << ", " << s.v0.y << ") (" << s.v1.x << ", " << s.v1.y << " )] ";
-		//}
-		//if (!unsorted.empty()) std::cout << "UNSORTED IS NOT EMPTY\n";
-		//std::cout << "\n";
+	std::lock_guard<std::mutex> guard(logLock);
+	log << "Merged into " << fileName << ": " << stats.replaced << " brushes replaced, " << stats.added << " added, "
+		<< stats.removed << " removed\n";
+	return true;
+}
 
-		// Execute EarCut
+// Surfaces written as a triangle mesh instead of brushes
+enum MeshMode {
+	MESH_NONE,
+	MESH_FLOORS, // Floors and ceilings
+	MESH_ALL     // Floors, ceilings and walls, with no .map written
+};
+
+// Options applying to every level converted
+struct ConvertOptions {
+	const char* cachePath = nullptr; // Cache of the level's brushes to reuse and update, or nullptr to convert everything
+	bool merge = false;     // If the output file exists, merge the level into it instead of overwriting it
+	bool useStdout = false;
+	bool dryRun = false;
+	int jobs = 1;
+	MeshMode mesh = MESH_NONE;
+	float gridSize = 0;     // Splits the level into square cells this wide
+	bool gridFiles = false; // Writes each cell to its own .map file
+	bool portals = false;
+	bool clip = false;
+	int lightsPerArea = 0;  // Adds sector lights, this many in each area
+	int lightBudget = 256;
+	const ThingTable* things = nullptr; // Converts things with an entry in the table
+	PrefabLibrary* prefabs = nullptr;   // Places repeated structures as copies of prefab maps
+};
+
+/*
+* Writes the surfaces selected for mesh output to a .obj file, named after the
+* level's .map file, or to stdout if no .map is written.
+*/
+bool ConvertMesh(WadLevel& level, const std::string& mapName, const ConvertOptions& options, std::ostream& log) {
+	BuildSettings settings;
+	settings.jobs = options.jobs;
+	settings.events = EventSink(LogEvent, &log);
+	settings.walls = options.mesh == MESH_ALL;
+	settings.prefabs = options.prefabs;
+
+	if (options.dryRun) {
+		CountingSink sink;
+		BuildLevelMesh(level, sink, settings);
+
+		std::lock_guard<std::mutex> guard(logLock);
+		log << "Dry run of " << level.lumpHeader->name.Data() << " produced " << sink.count << " bytes of mesh data\n";
+	}
+	else if (options.useStdout && options.mesh == MESH_ALL) {
+		StdoutSink sink;
+		BuildLevelMesh(level, sink, settings);
+	}
+	else {
+		std::string fileName = std::filesystem::path(mapName).replace_extension(".obj").string();
+		AsyncFileSink sink;
 		{
-			typedef std::array<float, 2> Point;
-			std::vector<std::vector<Point>> polylines;
-			polylines.emplace_back();
-			std::vector<Point>& mainLine = polylines[0];
+			std::lock_guard<std::mutex> guard(logLock);
+			log << "Creating mesh file " << fileName << "\n";
+		}
+		if (!sink.Open(fileName)) {
+			std::lock_guard<std::mutex> guard(logLock);
+			log << "ERROR CREATING OUTPUT FILE " << fileName << "\n";
+			return false;
+		}
+		BuildLevelMesh(level, sink, settings);
+		if (sink.Failed()) {
+			std::lock_guard<std::mutex> guard(logLock);
+			log << "ERROR WRITING OUTPUT FILE " << fileName << "\n";
+			return false;
+		}
+	}
+	return true;
+}
 
-			for(SimpleLineDef s : sorted) // Each consecutive sorted linedef shares a end/beginning point
-				mainLine.push_back({s.v0.x, s.v0.y});
+/*
+* Converts a decoded level into the requested output
+* outputPath - File to write, or nullptr to write [Map].map
+*/
+bool ConvertLevel(WadLevel& level, const char* outputPath, const ConvertOptions& options, std::ostream& log) {
+	std::string fileName;
+	if (outputPath != nullptr && !options.useStdout)
+		fileName = outputPath;
+	else {
+		fileName.append(level.lumpHeader->name);
+		fileName.append(".map");
+	}
 
-			//std::cout << mainLine.size() << "\n";
-			std::vector<int16_t> triangleIndices = mapbox::earcut<int16_t>(polylines);
-			//std::cout << triangleIndices.size() << "\n";
+	if (options.mesh != MESH_NONE && !ConvertMesh(level, fileName, options, log))
+		return false;
+	if (options.mesh == MESH_ALL)
+		return true;
+
+	BuildSettings settings;
+	settings.jobs = options.jobs;
+	settings.events = EventSink(LogEvent, &log);
+	settings.floors = options.mesh == MESH_NONE;
+	settings.gridSize = options.gridSize;
+	settings.portals = options.portals;
+	settings.clip = options.clip;
+	settings.lights = options.lightsPerArea > 0;
+	settings.lighting.maxPerArea = options.lightsPerArea;
+	settings.lighting.budget = options.lightBudget;
+	settings.things = options.things;
+	settings.prefabs = options.prefabs;
+
+	const char* cachePath = options.cachePath;
+	LevelCache cache;
+	if (cachePath != nullptr) {
+		cache.Load(cachePath);
+		settings.cache = &cache;
+	}
 
-			for (int i = 0, max = triangleIndices.size(); i < max;) {
-				VertexFloat a(mainLine[triangleIndices[i++]]);
-				VertexFloat b(mainLine[triangleIndices[i++]]);
-				VertexFloat c(mainLine[triangleIndices[i++]]);
+	if (options.dryRun) {
+		CountingSink sink;
+		BuildLevel(level, sink, settings);
 
-				writer.WriteFloorBrush(a, b, c, sector.floorHeight, false, sector.floorTexture);
-				writer.WriteFloorBrush(a, b, c, sector.ceilHeight, true, sector.ceilingTexture);
+		std::lock_guard<std::mutex> guard(logLock);
+		log << "Dry run of " << level.lumpHeader->name.Data() << " produced " << sink.count << " bytes of map data\n";
+	}
+	else if (options.useStdout) {
+		StdoutSink sink;
+		BuildLevel(level, sink, settings);
+	}
+	else if (options.gridFiles) {
+		std::string basePath = std::filesystem::path(fileName).replace_extension().string();
+		{
+			std::lock_guard<std::mutex> guard(logLock);
+			log << "Creating output files " << basePath << "_X_Y.map\n";
+		}
+		if (!BuildLevelCells(level, basePath, settings))
+			return false;
+	}
+	else {
+		if (options.merge && std::filesystem::exists(fileName)) {
+			if (!MergeLevel(level, fileName, settings, log)) {
+				std::lock_guard<std::mutex> guard(logLock);
+				log << "ERROR MERGING INTO " << fileName << "\n";
+				return false;
 			}
+			goto LABEL_SAVE_CACHE;
 		}
 
+		// Brushes are formatted while a separate thread writes finished chunks to disk
+		AsyncFileSink sink;
+		{
+			std::lock_guard<std::mutex> guard(logLock);
+			log << "Creating output file " << fileName << "\n";
+		}
+		if (!sink.Open(fileName)) {
+			std::lock_guard<std::mutex> guard(logLock);
+			log << "ERROR CREATING OUTPUT FILE " << fileName << "\n";
+			return false;
+		}
+		BuildLevel(level, sink, settings);
+		if (sink.Failed()) {
+			std::lock_guard<std::mutex> guard(logLock);
+			log << "ERROR WRITING OUTPUT FILE " << fileName << "\n";
+			return false;
+		}
 	}
 
-	// FINISH UP
-	writer.SaveFile(level.lumpHeader->name);
+	LABEL_SAVE_CACHE:
+	if (cachePath != nullptr) {
+		std::lock_guard<std::mutex> guard(logLock);
+		log << "Reused " << cache.hits << " of " << cache.hits + cache.misses << " linedefs and sectors from " << cachePath << "\n";
+		if (!cache.Save(cachePath))
+			log << "ERROR SAVING CACHE " << cachePath << "\n";
+	}
+	return true;
 }
 
-void DebugTextures() {
-	Wad doomwad;
-	doomwad.ReadFrom("DOOM.WAD");
-	//doomwad.WriteLumpNames();
-	doomwad.ExportTextures(true, true, true);
+/*
+* Converts several levels from the same WAD, several at once. Each thread
+* decodes its own level from the shared Wad, largest levels first.
+* outputDir - Directory to write the .map files to, or nullptr for the working directory
+* options.cachePath - Directory holding a cache for each level, or nullptr to convert everything
+*/
+bool ConvertLevels(const Wad& doomWad, std::vector<int32_t> indices, VertexTransforms transforms,
+	const char* outputDir, const ConvertOptions& options, std::ostream& log)
+{
+	// Spread the threads between levels first, then within each level
+	int levelJobs = std::min<int>(options.jobs, static_cast<int>(indices.size()));
+	if (levelJobs < 1)
+		levelJobs = 1;
+	int innerJobs = std::max(1, options.jobs / levelJobs);
+
+	std::stable_sort(indices.begin(), indices.end(), [&](int32_t a, int32_t b) {
+		return doomWad.LevelSize(a) > doomWad.LevelSize(b);
+	});
+
+	auto convert = [&](int32_t index) {
+		std::unique_ptr<WadLevel> level = doomWad.DecodeLevel(index, transforms);
+		if (level == nullptr)
+			return false;
+		ConvertOptions levelOptions = options;
+		levelOptions.jobs = innerJobs;
+
+		std::string fileName, cacheName;
+		if (outputDir != nullptr) {
+			std::filesystem::path path(outputDir);
+			path /= std::string(level->lumpHeader->name) + ".map";
+			fileName = path.string();
+		}
+		if (options.cachePath != nullptr) {
+			std::filesystem::path path(options.cachePath);
+			path /= std::string(level->lumpHeader->name) + ".w2bcache";
+			cacheName = path.string();
+			levelOptions.cachePath = cacheName.data();
+		}
+		return ConvertLevel(*level, outputDir == nullptr ? nullptr : fileName.data(), levelOptions, log);
+	};
+
+	// A malformed level must not stop the conversion of the others
+	std::atomic<bool> success(true);
+	ParallelFor(indices.size(), levelJobs, [&](size_t task, int) {
+		try {
+			if (!convert(indices[task]))
+				success = false;
+		}
+		catch (const std::exception&) {
+			std::lock_guard<std::mutex> guard(logLock);
+			log << "ERROR CONVERTING " << doomWad.LevelName(indices[task]).Data() << ": LEVEL DATA IS TRUNCATED OR MALFORMED\n";
+			success = false;
+		}
+	});
+	return success;
+}
+
+// Parses a whole argument as an integer of at least 1, returning false if it isn't one
+bool ParsePositive(const char* text, int& value) {
+	char* end = nullptr;
+	errno = 0;
+	long parsed = strtol(text, &end, 10);
+	if (end == text || *end != '\0' || errno == ERANGE || parsed < 1 || parsed > INT_MAX)
+		return false;
+	value = static_cast<int>(parsed);
+	return true;
 }
 
 int main(int argc, char* argv[]) {
@@ -229,63 +323,312 @@ int main(int argc, char* argv[]) {
 	using namespace std;
 
 	const char* helpMessage = 
-R"(Usage: ./wadtobrush.exe [WAD] [Map] [XY Downscale] [Z Downscale] [X Shift] [Y Shift]
+R"(Usage: ./wadtobrush.exe [Options] [WAD] [Map] [XY Downscale] [Z Downscale] [X Shift] [Y Shift]
 
 [WAD] - Path to the .WAD file containing your level
 [Map] - Name of the Map Header Lump (i.e. "E1M1" or "MAP01") (Case Sensitive)
+	Use a comma-separated list and the * or ? wildcards to convert several levels at once (i.e. "E1M*,E2M1").
+	Use ALL to convert every level in the WAD.
 [XY Downscale] - Map geometry will be horizontally downsized by this scale factor. Recommend at least a value of 10.
 [Z Downscale] - Map geometry will be vertically downsized by this scale factor. Recommend at least a value of 10.
 [X Shift] - Map geometry will be shifted this many X units. Use if your map is built far away from the origin.
 [Y Shift] - Map geometry will be shifted this many Y units. Use if your map is built far away from the origin.
 
 Input [WAD] with no other arguments to export a WAD's textures instead of a level
+
+Options:
+--output [Path] - Write the .map file to this path instead of [Map].map. Use "-" to write to stdout.
+	When converting several levels, this is the directory the .map files are written to.
+--dry-run - Perform the conversion without writing a file, reporting the size of the output instead.
+--jobs [N] - Convert or export textures using N threads. Use 0 to use every available core. Defaults to 1.
+--incremental [Path] - Reuse the brushes of every linedef and sector that hasn't changed since the last conversion
+	using this cache file, and update it. When converting several levels, this is a directory holding a cache for each level.
+--merge - If the .map file already exists, only replace the brushes generated from the level and keep everything
+	else in it, such as entities and brushes added in the editor. Brushes of linedefs and sectors that no longer exist are removed.
+	Cannot be combined with --clip, --lights, --things, --prefabs or --grid.
+--portals - Split the level into areas at doors and other chokepoints, adding visportals between them so the
+	renderer can cull each area. See AreaBuilder.h for how chokepoints are found.
+--clip - Add a coarse player clip hull, built from each sector's shape and heights, and make the drawn brushes
+	non-solid by moving them to a [Map]_render entity. Cannot be combined with --grid-files or --merge.
+--lights [N] - Add light entities approximating the sectors' light levels, clustering neighbouring sectors with
+	similar levels so each area gets at most N lights. See LightBuilder.h for how sectors are clustered.
+	Cannot be combined with --grid-files or --merge.
+--light-budget [N] - With --lights, the most lights in the level. Defaults to 256.
+--things - Convert the level's things into entities, writing an entityDef template for each type of thing
+	to the base folder. See ThingBuilder.h for the built-in table of types. Cannot be combined with --grid-files or --merge.
+--thing-table [Path] - With --things, add the types listed in this table, replacing built-in entries.
+--prefabs - Write structures repeated throughout the level, such as pillars and light fixtures, once each as a
+	reference map in the base folder, and place an entity for each copy instead of its brushes. See PrefabBuilder.h
+	for how copies are found. Cannot be combined with --grid-files or --merge.
+--grid [Size] - Split the level into square cells of this size, after downscaling, writing each cell's brushes
+	to its own entity. Brushes close to each other in the level are close to each other in the file.
+	Cannot be combined with --incremental or --merge.
+--grid-files - With --grid, write each cell to its own map, [Map]_X_Y.map, instead of an entity.
+--mesh [floors|all] - Write floors and ceilings as a triangle mesh to [Map].obj instead of brushes, for scenery that
+	does not need to be editable. With "all", walls are written to the mesh too, and no .map file is written, so
+	none of the options affecting the .map may be used.
+--tga [rle|mapped] - When exporting textures, write run-length compressed images, or 8 bit images indexing a palette
+	of each image's colors, instead of uncompressed ones. Both are often several times smaller.
+--daemon - Serve conversion requests read from stdin until "quit", keeping WADs loaded between requests.
+	With --jobs, serves N requests at once. See Daemon.h for the request format.
+--cache [N] - In daemon mode, keep up to N WADs loaded. Defaults to 4.
+--batch [Manifest] - Convert every job listed in the manifest, one per line: [WAD] [Map] [Output Directory] [Transforms...]
+	Finished jobs are journaled, so running the same manifest again resumes an interrupted batch.
+	With --jobs, converts N jobs at once. See Batch.h for details.
+--shard [i/N] - In batch mode, only convert the i-th of N shards of the manifest (i starts at 0).
+--timeout [Seconds] - In batch mode, give up on jobs that take longer than this.
+--journal [Path] - In batch mode, record finished jobs here instead of next to the manifest.
+--summary [Path] - In batch mode, write the summary of every job here instead of next to the manifest.
 )";
 
-	cout << "WadToBrush by FlavorfulGecko5 - ALPHA VERSION 2\n\n";
-	if (argc < 2) {
-		cout << helpMessage;
+	// Separate options from positional arguments
+	vector<const char*> args;
+	const char* outputPath = nullptr;
+	ConvertOptions options;
+	bool daemon = false;
+	BatchSettings batch;
+	batch.executable = argv[0];
+	size_t cacheSize = 4;
+	bool convertThings = false;
+	const char* thingTablePath = nullptr; // Entries added to the built-in thing table
+	bool usePrefabs = false;
+	TextureFormat textureFormat = TEXTURE_TGA;
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--output") == 0 && i + 1 < argc)
+			outputPath = argv[++i];
+		else if (strcmp(argv[i], "--jobs") == 0 && i + 1 < argc) {
+			options.jobs = atoi(argv[++i]);
+			if (options.jobs < 1)
+				options.jobs = std::thread::hardware_concurrency();
+		}
+		else if (strcmp(argv[i], "--incremental") == 0 && i + 1 < argc)
+			options.cachePath = argv[++i];
+		else if (strcmp(argv[i], "--cache") == 0 && i + 1 < argc)
+			cacheSize = atoi(argv[++i]);
+		else if (strcmp(argv[i], "--batch") == 0 && i + 1 < argc)
+			batch.manifest = argv[++i];
+		else if (strcmp(argv[i], "--shard") == 0 && i + 1 < argc) {
+			if (sscanf(argv[++i], "%d/%d", &batch.shard, &batch.shardCount) != 2 || batch.shardCount < 1
+				|| batch.shard < 0 || batch.shard >= batch.shardCount) {
+				cerr << "ERROR: --shard EXPECTS i/N WITH 0 <= i < N\n";
+				return 1;
+			}
+		}
+		else if (strcmp(argv[i], "--timeout") == 0 && i + 1 < argc)
+			batch.timeout = atof(argv[++i]);
+		else if (strcmp(argv[i], "--journal") == 0 && i + 1 < argc)
+			batch.journal = argv[++i];
+		else if (strcmp(argv[i], "--summary") == 0 && i + 1 < argc)
+			batch.summary = argv[++i];
+		else if (strcmp(argv[i], "--dry-run") == 0)
+			options.dryRun = true;
+		else if (strcmp(argv[i], "--merge") == 0)
+			options.merge = true;
+		else if (strcmp(argv[i], "--grid") == 0 && i + 1 < argc) {
+			char* end = nullptr;
+			options.gridSize = strtof(argv[++i], &end);
+			if (end == argv[i] || *end != '\0' || !(options.gridSize > 0) || options.gridSize == HUGE_VALF) {
+				cerr << "ERROR: --grid EXPECTS A POSITIVE SIZE\n";
+				return 1;
+			}
+		}
+		else if (strcmp(argv[i], "--portals") == 0)
+			options.portals = true;
+		else if (strcmp(argv[i], "--clip") == 0)
+			options.clip = true;
+		else if (strcmp(argv[i], "--lights") == 0 && i + 1 < argc) {
+			if (!ParsePositive(argv[++i], options.lightsPerArea)) {
+				cerr << "ERROR: --lights EXPECTS A NUMBER OF LIGHTS OF AT LEAST 1\n";
+				return 1;
+			}
+		}
+		else if (strcmp(argv[i], "--light-budget") == 0 && i + 1 < argc) {
+			if (!ParsePositive(argv[++i], options.lightBudget)) {
+				cerr << "ERROR: --light-budget EXPECTS A NUMBER OF LIGHTS OF AT LEAST 1\n";
+				return 1;
+			}
+		}
+		else if (strcmp(argv[i], "--things") == 0)
+			convertThings = true;
+		else if (strcmp(argv[i], "--thing-table") == 0 && i + 1 < argc)
+			thingTablePath = argv[++i];
+		else if (strcmp(argv[i], "--prefabs") == 0)
+			usePrefabs = true;
+		else if (strcmp(argv[i], "--grid-files") == 0)
+			options.gridFiles = true;
+		else if (strcmp(argv[i], "--mesh") == 0 && i + 1 < argc) {
+			const char* mode = argv[++i];
+			if (strcmp(mode, "floors") == 0)
+				options.mesh = MESH_FLOORS;
+			else if (strcmp(mode, "all") == 0)
+				options.mesh = MESH_ALL;
+			else {
+				cerr << "ERROR: --mesh EXPECTS floors OR all\n";
+				return 1;
+			}
+		}
+		else if (strcmp(argv[i], "--tga") == 0 && i + 1 < argc) {
+			const char* format = argv[++i];
+			if (strcmp(format, "rle") == 0)
+				textureFormat = TEXTURE_TGA_RLE;
+			else if (strcmp(format, "mapped") == 0)
+				textureFormat = TEXTURE_TGA_MAPPED;
+			else {
+				cerr << "ERROR: --tga EXPECTS rle OR mapped\n";
+				return 1;
+			}
+		}
+		else if (strcmp(argv[i], "--daemon") == 0)
+			daemon = true;
+		else args.push_back(argv[i]);
+	}
+
+	// Responses are written to stdout, so nothing else may be
+	if (daemon) {
+		DaemonSettings settings;
+		settings.jobs = options.jobs;
+		settings.cacheSize = cacheSize;
+		RunDaemon(cin, cout, settings);
 		return 0;
 	}
-	cout << "If you do not see a \"SUCCESS\" message after some time, this program has likely failed.\n";
-	cout << "At this time, only the VANILLA DOOM WAD format is supported.\n\n";
 
+	// Status messages must not be mixed into map data written to stdout
+	options.useStdout = outputPath != nullptr && strcmp(outputPath, "-") == 0;
+	ostream& log = options.useStdout ? cerr : cout;
+	if (options.gridFiles && options.gridSize <= 0) {
+		cerr << "ERROR: --grid-files REQUIRES --grid\n";
+		return 1;
+	}
+	if (options.gridSize > 0 && options.cachePath != nullptr) {
+		cerr << "ERROR: --grid CANNOT BE COMBINED WITH --incremental\n";
+		return 1;
+	}
+	if (options.gridSize > 0 && options.merge) {
+		cerr << "ERROR: --grid CANNOT BE COMBINED WITH --merge\n";
+		return 1;
+	}
+	if (options.gridFiles && options.useStdout) {
+		cerr << "ERROR: --grid-files CANNOT BE COMBINED WITH WRITING TO STDOUT\n";
+		return 1;
+	}
+	if (options.gridFiles && (options.clip || options.lightsPerArea > 0 || convertThings)) {
+		cerr << "ERROR: --clip, --lights AND --things CANNOT BE COMBINED WITH --grid-files\n";
+		return 1;
+	}
+	if (options.merge && (options.clip || options.lightsPerArea > 0 || convertThings)) {
+		cerr << "ERROR: --clip, --lights AND --things CANNOT BE COMBINED WITH --merge\n";
+		return 1;
+	}
+	if (usePrefabs && (options.gridFiles || options.merge)) {
+		cerr << "ERROR: --prefabs CANNOT BE COMBINED WITH --grid-files OR --merge\n";
+		return 1;
+	}
+	if (options.mesh == MESH_ALL && (options.portals || options.clip || options.lightsPerArea > 0 || convertThings || usePrefabs
+		|| options.gridSize > 0 || options.merge || options.cachePath != nullptr))
+	{
+		cerr << "ERROR: --mesh all WRITES NO .map, SO IT CANNOT BE COMBINED WITH --portals, --clip, --lights, --things, --prefabs, --grid, --merge OR --incremental\n";
+		return 1;
+	}
 
-	Wad doomWad;
-	if(!doomWad.ReadFrom(argv[1])) {
-		printf("ERROR READING WAD FILE\n");
+	log << "WadToBrush by FlavorfulGecko5 - ALPHA VERSION 2\n\n";
+	if (!batch.manifest.empty()) {
+		batch.jobs = options.jobs;
+		return RunBatch(batch, log) ? 0 : 1;
+	}
+	if (args.empty()) {
+		log << helpMessage;
 		return 0;
 	}
-	printf("Successfully read WAD from file.\n");
+	log << "If you do not see a \"SUCCESS\" message after some time, this program has likely failed.\n";
+	log << "At this time, only the VANILLA DOOM WAD format is supported.\n\n";
+
+	ThingTable thingTable;
+	if (convertThings) {
+		EventSink events(LogEvent, &log);
+		thingTable.LoadDefaults();
+		if (thingTablePath != nullptr && !thingTable.Load(thingTablePath, events))
+			return 1;
+		if (!options.dryRun && !options.useStdout) {
+			DiskAssetWriter assets("base/");
+			thingTable.WriteTemplates(assets, events);
+		}
+		options.things = &thingTable;
+	}
+
+	// Like thing templates, prefab maps are only written when the levels are
+	std::unique_ptr<AssetWriter> prefabAssets;
+	std::unique_ptr<PrefabLibrary> prefabLibrary;
+	if (usePrefabs) {
+		if (options.dryRun || options.useStdout)
+			prefabAssets.reset(new CallbackAssetWriter([](const char*, const char*, size_t, void*) {}, nullptr));
+		else prefabAssets.reset(new DiskAssetWriter("base/"));
+		prefabLibrary.reset(new PrefabLibrary(*prefabAssets));
+		options.prefabs = prefabLibrary.get();
+	}
+
+	Wad doomWad;
+	if(!doomWad.ReadFrom(args[0])) {
+		log << "ERROR READING WAD FILE\n";
+		return 1;
+	}
+	log << "Successfully read WAD from file.\n";
 
 
-	if (argc == 2) {
-		cout << "No level input detected. WadToBrush will run in Export Textures Mode\n";
+	if (args.size() == 1) {
+		log << "No level input detected. WadToBrush will run in Export Textures Mode\n";
 		std::filesystem::path outputDir = std::filesystem::absolute("base/");
-		cout << "Files will be output to " << outputDir.string() << "\nThis may take some time\n\n";
+		log << "Files will be output to " << outputDir.string() << "\nThis may take some time\n\n";
 
-		doomWad.ExportTextures(true, true, true);
-		cout << "SUCCESS - Texture exporting completed.\n";
+		DiskAssetWriter assets("base/");
+		doomWad.ExportTextures(true, true, true, assets, EventSink(), options.jobs, textureFormat);
+		log << "SUCCESS - Texture exporting completed.\n";
 		return 0;
 	}
 
 
 	VertexTransforms transformations;
-	if(argc > 3) transformations.xyDownscale = atof(argv[3]);
-	if(argc > 4) transformations.zDownscale = atof(argv[4]);
-	if(argc > 5) transformations.xShift = atof(argv[5]);
-	if(argc > 6) transformations.yShift = atof(argv[6]);
+	if(args.size() > 2) transformations.xyDownscale = atof(args[2]);
+	if(args.size() > 3) transformations.zDownscale = atof(args[3]);
+	if(args.size() > 4) transformations.xShift = atof(args[4]);
+	if(args.size() > 5) transformations.yShift = atof(args[5]);
+
+	// Convert several levels
+	const char* mapName = args[1];
+	if (strcmp(mapName, "ALL") == 0 || strpbrk(mapName, "*?,") != nullptr) {
+		vector<int32_t> indices = doomWad.FindLevels(strcmp(mapName, "ALL") == 0 ? "*" : mapName);
+		if (indices.empty()) {
+			log << "ERROR: NO LEVELS MATCH " << mapName << "\n";
+			return 1;
+		}
+		if (options.useStdout) {
+			log << "ERROR: CANNOT WRITE SEVERAL LEVELS TO STDOUT\n";
+			return 1;
+		}
+		if (outputPath != nullptr)
+			std::filesystem::create_directories(outputPath);
+		if (options.cachePath != nullptr)
+			std::filesystem::create_directories(options.cachePath);
+
+		log << "Converting " << indices.size() << " levels\n-----\n";
+		if(!ConvertLevels(doomWad, indices, transformations, outputPath, options, log))
+			return 1;
+	}
 
-	//VertexTransforms e1m1Transforms(-1024, 3680, 10.0f, 10.0f);
-	WadLevel* level = doomWad.DecodeLevel(argv[2], transformations);
+	// Convert a single level
+	else {
+		//VertexTransforms e1m1Transforms(-1024, 3680, 10.0f, 10.0f);
+		std::unique_ptr<WadLevel> level = doomWad.DecodeLevel(mapName, transformations);
 
-	if(level == nullptr) {
-		printf("ERROR PARSING LEVEL DATA\n");
-		return 0;
-	}
-	printf("Successfully parsed level data.\n-----\nPerforming Conversion\n");
+		if(level == nullptr) {
+			log << "ERROR PARSING LEVEL DATA\n";
+			return 1;
+		}
+		log << "Successfully parsed level data.\n-----\nPerforming Conversion\n";
 
-	BuildLevel(*level);
+		if(!ConvertLevel(*level, outputPath, options, log))
+			return 1;
+	}
 
-	cout << "-----\nSUCCESS - Please remember that terrain generation is not fully complete, and some floors/ceilings may be missing.";
+	log << "-----\nSUCCESS - Please remember that terrain generation is not fully complete, and some floors/ceilings may be missing.";
 	return 0;
 }
\ No newline at end of file
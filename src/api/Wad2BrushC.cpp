@@ -0,0 +1,122 @@
+#include "Wad2BrushC.h"
+#include "WadConverter.h"
+
+// Forwards events to the C callback, which has the same layout but its own types
+struct EventForwarder {
+	w2b_event_fn callback;
+	void* userData;
+};
+
+static void ForwardEvent(const Event& e, void* userData) {
+	EventForwarder* forwarder = static_cast<EventForwarder*>(userData);
+	w2b_event converted = {e.type, e.message, e.current, e.total};
+	forwarder->callback(&converted, forwarder->userData);
+}
+
+struct w2b_converter {
+	EventForwarder forwarder;
+	EventSink events;
+	WadConverter converter;
+
+	w2b_converter(w2b_event_fn callback, void* userData) : forwarder{callback, userData},
+		events(callback == nullptr ? EventSink() : EventSink(ForwardEvent, &forwarder)), converter(events) {}
+};
+
+static BuildSettings ToBuildSettings(const w2b_converter* converter, const w2b_settings* settings, VertexTransforms& transforms) {
+	BuildSettings build;
+	build.events = converter->events;
+	w2b_settings defaults;
+	if (settings == nullptr) {
+		w2b_default_settings(&defaults);
+		settings = &defaults;
+	}
+	transforms.xyDownscale = settings->xy_downscale;
+	transforms.zDownscale = settings->z_downscale;
+	transforms.xShift = settings->x_shift;
+	transforms.yShift = settings->y_shift;
+	build.jobs = settings->jobs;
+	build.precision = settings->precision;
+	return build;
+}
+
+extern "C" {
+
+void w2b_default_settings(w2b_settings* settings) {
+	if (settings == nullptr)
+		return;
+	VertexTransforms transforms;
+	BuildSettings build;
+	settings->xy_downscale = transforms.xyDownscale;
+	settings->z_downscale = transforms.zDownscale;
+	settings->x_shift = transforms.xShift;
+	settings->y_shift = transforms.yShift;
+	settings->jobs = build.jobs;
+	settings->precision = build.precision;
+}
+
+w2b_converter* w2b_open(const void* data, size_t length, w2b_event_fn events, void* user_data) {
+	if (data == nullptr && length > 0)
+		return nullptr;
+	w2b_converter* converter = new w2b_converter(events, user_data);
+	if (!converter->converter.Load(static_cast<const char*>(data), length)) {
+		w2b_close(converter);
+		return nullptr;
+	}
+	return converter;
+}
+
+void w2b_close(w2b_converter* converter) {
+	delete converter;
+}
+
+int32_t w2b_level_count(const w2b_converter* converter) {
+	if (converter == nullptr)
+		return 0;
+	return converter->converter.GetWad().LevelCount();
+}
+
+const char* w2b_level_name(const w2b_converter* converter, int32_t index, char name[9]) {
+	if (converter == nullptr || name == nullptr)
+		return nullptr;
+	if (index < 0 || index >= converter->converter.GetWad().LevelCount()) {
+		converter->events.Reportf(EVENT_ERROR, "Level index %i is out of range", index);
+		return nullptr;
+	}
+	WadString levelName = converter->converter.GetWad().LevelName(index);
+	memcpy(name, levelName.Data(), 8);
+	name[8] = '\0';
+	return name;
+}
+
+int w2b_convert_level(const w2b_converter* converter, const char* map_name, const w2b_settings* settings,
+	w2b_write_fn write, void* user_data)
+{
+	if (converter == nullptr || map_name == nullptr || write == nullptr)
+		return 0;
+	VertexTransforms transforms;
+	BuildSettings build = ToBuildSettings(converter, settings, transforms);
+	return converter->converter.ConvertLevel(map_name, transforms, build, write, user_data) ? 1 : 0;
+}
+
+int w2b_convert_level_to_buffer(const w2b_converter* converter, const char* map_name, const w2b_settings* settings,
+	char* buffer, size_t capacity, size_t* required)
+{
+	if (converter == nullptr || map_name == nullptr || (buffer == nullptr && capacity > 0))
+		return 0;
+	VertexTransforms transforms;
+	BuildSettings build = ToBuildSettings(converter, settings, transforms);
+	size_t size = converter->converter.ConvertLevel(map_name, transforms, build, buffer, capacity);
+	if (required != nullptr)
+		*required = size;
+	return size > 0 && size <= capacity ? 1 : 0;
+}
+
+int w2b_export_textures(const w2b_converter* converter, int32_t flags, w2b_asset_fn asset, void* user_data) {
+	if (converter == nullptr || asset == nullptr)
+		return 0;
+	CallbackAssetWriter assets(asset, user_data);
+	return converter->converter.ExportTextures((flags & W2B_EXPORT_WALLS) != 0, (flags & W2B_EXPORT_FLATS) != 0,
+		(flags & W2B_EXPORT_PATCHES) != 0, assets) ? 1 : 0;
+}
+
+}
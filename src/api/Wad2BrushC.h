@@ -0,0 +1,78 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+* C interface to WadConverter, for embedding the converter in tools written in
+* other languages. Every function reports success with a nonzero return value,
+* and no function throws: malformed WAD data and out of range indices fail with
+* an error event, and NULL arguments fail silently. Events, map text and assets
+* are only valid for the duration of the callback they're passed to.
+*/
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct w2b_converter w2b_converter;
+
+enum {
+	W2B_EVENT_INFO,
+	W2B_EVENT_WARNING,
+	W2B_EVENT_ERROR,
+	W2B_EVENT_PROGRESS
+};
+
+typedef struct w2b_event {
+	int32_t type;
+	const char* message;
+	int32_t current; /* Progress events only */
+	int32_t total;
+} w2b_event;
+
+typedef void (*w2b_event_fn)(const w2b_event* event, void* user_data);
+typedef void (*w2b_write_fn)(const char* data, size_t length, void* user_data);
+typedef void (*w2b_asset_fn)(const char* path, const char* data, size_t length, void* user_data);
+
+typedef struct w2b_settings {
+	float xy_downscale;
+	float z_downscale;
+	float x_shift;
+	float y_shift;
+	int32_t jobs;
+	int32_t precision; /* Decimals of each number, clamped to 20, or negative for the shortest exact form */
+} w2b_settings;
+
+enum {
+	W2B_EXPORT_WALLS = 1,
+	W2B_EXPORT_FLATS = 2,
+	W2B_EXPORT_PATCHES = 4
+};
+
+/* Fills the settings with the same defaults as the command line */
+void w2b_default_settings(w2b_settings* settings);
+
+/* Events may be NULL to print them to the console. The data is not copied, and must outlive the converter */
+w2b_converter* w2b_open(const void* data, size_t length, w2b_event_fn events, void* user_data);
+void w2b_close(w2b_converter* converter);
+
+int32_t w2b_level_count(const w2b_converter* converter);
+
+/* Returns NULL if the index is not below w2b_level_count */
+const char* w2b_level_name(const w2b_converter* converter, int32_t index, char name[9]);
+
+/* Streams the map text to the write callback */
+int w2b_convert_level(const w2b_converter* converter, const char* map_name, const w2b_settings* settings,
+	w2b_write_fn write, void* user_data);
+
+/* Copies the map text into the buffer. *required receives the size of the map - if it exceeds
+   the capacity, the output was truncated and the call fails */
+int w2b_convert_level_to_buffer(const w2b_converter* converter, const char* map_name, const w2b_settings* settings,
+	char* buffer, size_t capacity, size_t* required);
+
+/* Hands each texture to the callback, with paths relative to the game's base directory */
+int w2b_export_textures(const w2b_converter* converter, int32_t flags, w2b_asset_fn asset, void* user_data);
+
+#ifdef __cplusplus
+}
+#endif
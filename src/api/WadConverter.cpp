@@ -0,0 +1,80 @@
+#include "WadConverter.h"
+#include <exception>
+
+bool WadConverter::Load(const char* data, size_t length) {
+	loaded = false;
+	try {
+		loaded = wad.ReadFrom(data, length, events);
+	}
+	catch (const std::exception&) {
+		events.Report(EVENT_ERROR, "WAD data is truncated or malformed");
+	}
+	return loaded;
+}
+
+std::unique_ptr<WadLevel> WadConverter::Decode(const char* mapName, VertexTransforms transforms) const {
+	if (!loaded) {
+		events.Report(EVENT_ERROR, "No WAD has been loaded");
+		return nullptr;
+	}
+
+	try {
+		return wad.DecodeLevel(mapName, transforms, events);
+	}
+	catch (const std::exception&) {
+		events.Reportf(EVENT_ERROR, "Level data for %s is truncated or malformed", mapName);
+		return nullptr;
+	}
+}
+
+template<typename Sink>
+bool WadConverter::Build(WadLevel& level, Sink& sink, const BuildSettings& settings) const {
+	try {
+		BuildLevel(level, sink, settings);
+	}
+	catch (const std::exception&) {
+		events.Reportf(EVENT_ERROR, "Conversion of %s failed", level.lumpHeader->name.Data());
+		return false;
+	}
+	return true;
+}
+
+bool WadConverter::ConvertLevel(const char* mapName, VertexTransforms transforms, const BuildSettings& settings,
+	WriteCallback output, void* userData) const
+{
+	std::unique_ptr<WadLevel> level = Decode(mapName, transforms);
+	if (level == nullptr)
+		return false;
+
+	CallbackSink sink(output, userData);
+	return Build(*level, sink, settings);
+}
+
+size_t WadConverter::ConvertLevel(const char* mapName, VertexTransforms transforms, const BuildSettings& settings,
+	char* buffer, size_t capacity) const
+{
+	std::unique_ptr<WadLevel> level = Decode(mapName, transforms);
+	if (level == nullptr)
+		return 0;
+
+	BufferSink sink(buffer, capacity);
+	if (!Build(*level, sink, settings))
+		return 0;
+	return sink.required;
+}
+
+bool WadConverter::ExportTextures(bool exportWalls, bool exportFlats, bool exportPatches, AssetWriter& assets) const {
+	if (!loaded) {
+		events.Report(EVENT_ERROR, "No WAD has been loaded");
+		return false;
+	}
+
+	try {
+		wad.ExportTextures(exportWalls, exportFlats, exportPatches, assets, events);
+	}
+	catch (const std::exception&) {
+		events.Report(EVENT_ERROR, "Texture data is truncated or malformed");
+		return false;
+	}
+	return true;
+}
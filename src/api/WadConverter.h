@@ -0,0 +1,58 @@
+#pragma once
+#include "LevelBuilder.h"
+#include "AssetWriter.h"
+#include "Events.h"
+
+/*
+* In-memory conversion API, for programs embedding the converter.
+*
+* Nothing here touches the filesystem: the WAD is read from memory, maps are
+* streamed to a callback or copied into a caller-provided buffer, and textures
+* are handed to an AssetWriter. Progress and errors are reported as events
+* instead of being printed. Malformed WAD data is reported as an error event
+* rather than thrown.
+*
+* A loaded converter is never modified by a conversion, so several levels
+* may be converted from it at once on different threads.
+*/
+class WadConverter {
+	private:
+	Wad wad;
+	EventSink events;
+	bool loaded = false;
+
+	std::unique_ptr<WadLevel> Decode(const char* mapName, VertexTransforms transforms) const;
+
+	// Reports an error event if the level can't be converted, instead of throwing
+	template<typename Sink>
+	bool Build(WadLevel& level, Sink& sink, const BuildSettings& settings) const;
+
+	public:
+	WadConverter() {}
+
+	WadConverter(const EventSink& p_events) : events(p_events) {}
+
+	// Reads a WAD from memory. The data is not copied, and must outlive the converter
+	bool Load(const char* data, size_t length);
+
+	bool IsLoaded() const {
+		return loaded;
+	}
+
+	const Wad& GetWad() const {
+		return wad;
+	}
+
+	// Converts a level, streaming the map text to the callback as it's generated
+	bool ConvertLevel(const char* mapName, VertexTransforms transforms, const BuildSettings& settings,
+		WriteCallback output, void* userData) const;
+
+	/*
+	* Converts a level into the buffer. Returns the size of the complete map, which
+	* is larger than the capacity if it did not fit, or 0 if the conversion failed.
+	*/
+	size_t ConvertLevel(const char* mapName, VertexTransforms transforms, const BuildSettings& settings,
+		char* buffer, size_t capacity) const;
+
+	bool ExportTextures(bool exportWalls, bool exportFlats, bool exportPatches, AssetWriter& assets) const;
+};
@@ -7,30 +7,150 @@
 
 #include <stdio.h>
 #include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+/// <summary> Size in bytes of the image tga_encode produces. </summary>
+inline size_t tga_encoded_size(uint32_t width, uint32_t height, uint8_t fileChannels=3)
+{
+	return 18 + (size_t)width * height * fileChannels;
+}
+
+/// <summary> Encodes an uncompressed 24 or 32 bit .tga image into memory, for callers that write the file themselves. </summary>
+/// <param name='out'>Receives the image. Must hold tga_encoded_size(width, height, fileChannels) bytes.</param>
+/// <param name='dataBGRA'>A chunk of color data, one channel per byte, ordered as BGRA. Size should be width*height*dataChanels.</param>
+/// <param name='dataChannels'>The number of channels in the color data. Use 1 for grayscale, 3 for BGR, and 4 for BGRA.</param>
+/// <param name='fileChannels'>The number of color channels to write. Must be 3 for BGR, or 4 for BGRA. Does NOT need to match dataChannels.</param>
+inline void tga_encode(uint8_t *out, uint32_t width, uint32_t height, const uint8_t *dataBGRA, uint8_t dataChannels=4, uint8_t fileChannels=3)
+{
+	uint8_t header[18] = { 0,0,2,0,0,0,0,0,0,0,0,0, (uint8_t)(width%256), (uint8_t)(width/256), (uint8_t)(height%256), (uint8_t)(height/256), (uint8_t)(fileChannels*8), 0x20 };
+	for (uint32_t i = 0; i < 18; i++)
+		*out++ = header[i];
+
+	for (uint32_t i = 0; i < width*height; i++)
+	{
+		for (uint32_t b = 0; b < fileChannels; b++)
+		{
+			*out++ = dataBGRA[(i*dataChannels) + (b%dataChannels)];
+		}
+	}
+}
+
+/// <summary> Largest size in bytes of the image tga_encode_rle may produce. </summary>
+inline size_t tga_rle_max_size(uint32_t width, uint32_t height, uint8_t fileChannels=3)
+{
+	// At worst, every row is raw packets of 128 pixels, each with a one byte header
+	return 18 + (size_t)height * ((size_t)width * fileChannels + (width + 127) / 128);
+}
+
+inline bool tga_pixel_equal(const uint8_t *a, const uint8_t *b, uint8_t dataChannels, uint8_t fileChannels)
+{
+	for (uint32_t c = 0; c < fileChannels; c++)
+		if (a[c % dataChannels] != b[c % dataChannels])
+			return false;
+	return true;
+}
+
+/// <summary> Encodes a run-length compressed (type 10) 24 or 32 bit .tga image into memory. Packets never cross rows. </summary>
+/// <param name='out'>Receives the image. Must hold tga_rle_max_size(width, height, fileChannels) bytes.</param>
+/// <param name='dataBGRA'>A chunk of color data, one channel per byte, ordered as BGRA. Size should be width*height*dataChanels.</param>
+/// <param name='dataChannels'>The number of channels in the color data. Use 1 for grayscale, 3 for BGR, and 4 for BGRA.</param>
+/// <param name='fileChannels'>The number of color channels to write. Must be 3 for BGR, or 4 for BGRA. Does NOT need to match dataChannels.</param>
+/// <returns>The number of bytes written to out.</returns>
+inline size_t tga_encode_rle(uint8_t *out, uint32_t width, uint32_t height, const uint8_t *dataBGRA, uint8_t dataChannels=4, uint8_t fileChannels=3)
+{
+	uint8_t header[18] = { 0,0,10,0,0,0,0,0,0,0,0,0, (uint8_t)(width%256), (uint8_t)(width/256), (uint8_t)(height%256), (uint8_t)(height/256), (uint8_t)(fileChannels*8), 0x20 };
+	uint8_t *start = out;
+	for (uint32_t i = 0; i < 18; i++)
+		*out++ = header[i];
+
+	for (uint32_t y = 0; y < height; y++)
+	{
+		const uint8_t *row = dataBGRA + (size_t)y * width * dataChannels;
+		uint32_t x = 0;
+		while (x < width)
+		{
+			const uint8_t *pixel = row + (size_t)x * dataChannels;
+
+			// Repeated pixels become a single run packet
+			uint32_t count = 1;
+			while (x + count < width && count < 128 && tga_pixel_equal(pixel, row + (size_t)(x + count) * dataChannels, dataChannels, fileChannels))
+				count++;
+			if (count > 1)
+			{
+				*out++ = (uint8_t)(0x80 | (count - 1));
+				for (uint32_t b = 0; b < fileChannels; b++)
+					*out++ = pixel[b % dataChannels];
+				x += count;
+				continue;
+			}
+
+			// Anything else is copied as a raw packet, up to where the next run starts
+			while (x + count < width && count < 128 && !(x + count + 1 < width &&
+				tga_pixel_equal(row + (size_t)(x + count) * dataChannels, row + (size_t)(x + count + 1) * dataChannels, dataChannels, fileChannels)))
+				count++;
+			*out++ = (uint8_t)(count - 1);
+			for (uint32_t i = 0; i < count; i++, pixel += dataChannels)
+				for (uint32_t b = 0; b < fileChannels; b++)
+					*out++ = pixel[b % dataChannels];
+			x += count;
+		}
+	}
+	return out - start;
+}
+
+/// <summary> Size in bytes of the image tga_encode_mapped produces. </summary>
+inline size_t tga_mapped_size(uint32_t width, uint32_t height, uint16_t paletteSize, uint8_t fileChannels=3)
+{
+	return 18 + (size_t)paletteSize * fileChannels + (size_t)width * height;
+}
+
+/// <summary> Encodes an uncompressed color-mapped (type 1) .tga image, with 8 bit indices into a 24 or 32 bit palette, into memory. </summary>
+/// <param name='out'>Receives the image. Must hold tga_mapped_size(width, height, paletteSize, fileChannels) bytes.</param>
+/// <param name='indices'>One palette index per pixel. Size should be width*height.</param>
+/// <param name='paletteBGRA'>The palette's colors, one channel per byte, ordered as BGRA. Size should be paletteSize*paletteChannels.</param>
+/// <param name='paletteSize'>The number of colors in the palette, at most 256.</param>
+/// <param name='paletteChannels'>The number of channels in the palette. Use 3 for BGR, and 4 for BGRA.</param>
+/// <param name='fileChannels'>The number of color channels to write for each palette entry. Must be 3 for BGR, or 4 for BGRA.</param>
+inline void tga_encode_mapped(uint8_t *out, uint32_t width, uint32_t height, const uint8_t *indices, const uint8_t *paletteBGRA, uint16_t paletteSize, uint8_t paletteChannels=4, uint8_t fileChannels=3)
+{
+	uint8_t header[18] = { 0,1,1,0,0, (uint8_t)(paletteSize%256), (uint8_t)(paletteSize/256), (uint8_t)(fileChannels*8), 0,0,0,0, (uint8_t)(width%256), (uint8_t)(width/256), (uint8_t)(height%256), (uint8_t)(height/256), 8, 0x20 };
+	for (uint32_t i = 0; i < 18; i++)
+		*out++ = header[i];
+
+	for (uint32_t i = 0; i < paletteSize; i++)
+		for (uint32_t b = 0; b < fileChannels; b++)
+			*out++ = paletteBGRA[(i*paletteChannels) + (b%paletteChannels)];
+
+	memcpy(out, indices, (size_t)width * height);
+}
 
 /// <summary> Writes an uncompressed 24 or 32 bit .tga image to the indicated file! </summary>
 /// <param name='filename'>I'd recommended you add a '.tga' to the end of this filename.</param>
 /// <param name='dataBGRA'>A chunk of color data, one channel per byte, ordered as BGRA. Size should be width*height*dataChanels.</param>
 /// <param name='dataChannels'>The number of channels in the color data. Use 1 for grayscale, 3 for BGR, and 4 for BGRA.</param>
 /// <param name='fileChannels'>The number of color channels to write to file. Must be 3 for BGR, or 4 for BGRA. Does NOT need to match dataChannels.</param>
-void tga_write(const char *filename, uint32_t width, uint32_t height, uint8_t *dataBGRA, uint8_t dataChannels=4, uint8_t fileChannels=3)
+inline void tga_write(const char *filename, uint32_t width, uint32_t height, uint8_t *dataBGRA, uint8_t dataChannels=4, uint8_t fileChannels=3)
 {
 	FILE *fp = NULL;
 	// MSVC prefers fopen_s, but it's not portable
-	//fp = fopen(filename, "wb");
+#ifdef _MSC_VER
 	fopen_s(&fp, filename, "wb");
+#else
+	fp = fopen(filename, "wb");
+#endif
 	if (fp == NULL) return;
 
 	// You can find details about TGA headers here: http://www.paulbourke.net/dataformats/tga/
-	uint8_t header[18] = { 0,0,2,0,0,0,0,0,0,0,0,0, (uint8_t)(width%256), (uint8_t)(width/256), (uint8_t)(height%256), (uint8_t)(height/256), (uint8_t)(fileChannels*8), 0x20 };
-	fwrite(&header, 18, 1, fp);
-
-	for (uint32_t i = 0; i < width*height; i++)
+	// The whole file is encoded first, so it's written with a single call
+	size_t size = tga_encoded_size(width, height, fileChannels);
+	uint8_t *image = (uint8_t*)malloc(size);
+	if (image != NULL)
 	{
-		for (uint32_t b = 0; b < fileChannels; b++)
-		{
-			fputc(dataBGRA[(i*dataChannels) + (b%dataChannels)], fp);
-		}
+		tga_encode(image, width, height, dataBGRA, dataChannels, fileChannels);
+		fwrite(image, size, 1, fp);
+		free(image);
 	}
 	fclose(fp);
 }
\ No newline at end of file
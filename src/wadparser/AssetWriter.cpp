@@ -0,0 +1,22 @@
+#include "AssetWriter.h"
+#include <filesystem>
+#include <fstream>
+
+bool DiskAssetWriter::Write(const std::string& path, const char* data, size_t length) {
+	std::filesystem::path fullPath(root);
+	fullPath /= path;
+
+	// Only ask the filesystem about each directory once
+	std::string directory = fullPath.parent_path().string();
+	{
+		std::lock_guard<std::mutex> guard(directoryLock);
+		if (createdDirectories.insert(directory).second)
+			std::filesystem::create_directories(directory);
+	}
+
+	std::ofstream file(fullPath, std::ios_base::binary);
+	if (file.fail())
+		return false;
+	file.write(data, length);
+	return !file.fail();
+}
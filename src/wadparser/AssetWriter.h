@@ -0,0 +1,42 @@
+#pragma once
+#include <string>
+#include <mutex>
+#include <unordered_set>
+
+/*
+* Destination for exported texture assets. Paths are relative to the
+* game's base directory, i.e. "art/wadtobrush/flats/FLOOR4_8.tga"
+*/
+class AssetWriter {
+	public:
+	virtual ~AssetWriter() {}
+	virtual bool Write(const std::string& path, const char* data, size_t length) = 0;
+};
+
+// Writes assets to disk, creating directories as needed. Thread-safe.
+class DiskAssetWriter : public AssetWriter {
+	private:
+	std::string root;
+	std::unordered_set<std::string> createdDirectories;
+	std::mutex directoryLock;
+
+	public:
+	DiskAssetWriter(const std::string& p_root) : root(p_root) {}
+	bool Write(const std::string& path, const char* data, size_t length) override;
+};
+
+// Hands assets to a callback
+typedef void (*AssetCallback)(const char* path, const char* data, size_t length, void* userData);
+class CallbackAssetWriter : public AssetWriter {
+	private:
+	AssetCallback callback;
+	void* userData;
+
+	public:
+	CallbackAssetWriter(AssetCallback p_callback, void* p_userData) : callback(p_callback), userData(p_userData) {}
+
+	bool Write(const std::string& path, const char* data, size_t length) override {
+		callback(path.data(), data, length, userData);
+		return true;
+	}
+};
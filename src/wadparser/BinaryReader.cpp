@@ -1,6 +1,7 @@
 #include "BinaryReader.h"
 #include <fstream>
 #include <vector>
+#include <cstring>
 
 BinaryReader::BinaryReader(const BinaryReader& b) {
 	SetBuffer(b.buffer, b.length);
@@ -19,25 +20,25 @@ BinaryReader::BinaryReader(char* p_buffer, size_t p_length)
 bool BinaryReader::SetBuffer(const std::string& path) {
 	ClearState();
 
-	// Read File
-	std::vector<char> tempVector;
-
-	std::ifstream file(path, std::ios_base::binary);
+	// Read File - straight into the buffer, with a single read
+	std::ifstream file(path, std::ios_base::binary | std::ios_base::ate);
 	if (file.fail())
 		return false;
 
-	while (!file.eof())
-	{
-		char temp[2048];
-		file.read(temp, 2048);
-		tempVector.insert(tempVector.end(), temp, temp + file.gcount());
-	}
-	file.close();
+	std::streamoff fileSize = file.tellg();
+	file.seekg(0, std::ios_base::beg);
+	if (fileSize < 0)
+		return false;
 
-	buffer = new char[tempVector.size()];
-	memcpy(buffer, tempVector.data(), tempVector.size());
-	length = tempVector.size();
+	buffer = new char[fileSize];
+	length = static_cast<size_t>(fileSize);
 	ownsBuffer = true;
+	file.read(buffer, fileSize);
+	if (file.gcount() != fileSize) {
+		ClearState();
+		return false;
+	}
+	file.close();
 	return true;
 }
 
@@ -93,8 +94,8 @@ void BinaryReader::ReadBytes(char* writeTo, const size_t numBytes)
 	if(pos + numBytes > length)
 		throw IndexOOBException();
 
-	for(size_t i = 0; i < numBytes; i++)
-		writeTo[i] = buffer[pos++];
+	memcpy(writeTo, buffer + pos, numBytes);
+	pos += numBytes;
 }
 
 char* BinaryReader::ReadCString()
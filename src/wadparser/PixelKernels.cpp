@@ -0,0 +1,287 @@
+#include "PixelKernels.h"
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#include <immintrin.h>
+#define PIXELS_X86
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#include <arm_neon.h>
+#define PIXELS_NEON
+#endif
+
+// GCC and Clang only emit instructions beyond the build's target in functions marked for them
+#if defined(PIXELS_X86) && defined(__GNUC__)
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#define TARGET_SSE41 __attribute__((target("sse4.1")))
+#else
+#define TARGET_AVX2
+#define TARGET_SSE41
+#endif
+
+struct PixelKernels {
+	void (*expandPalette)(const uint8_t* indices, const uint8_t* coverage, const uint8_t* palette, uint8_t* pixels, size_t count);
+	bool (*hasTransparency)(const uint8_t* pixels, size_t count);
+	void (*blitMasked)(uint8_t* dest, uint8_t* destCoverage, const uint8_t* source, const uint8_t* sourceCoverage, size_t count);
+};
+
+/*
+* Scalar
+*/
+
+void ExpandPalette_Scalar(const uint8_t* indices, const uint8_t* coverage, const uint8_t* palette, uint8_t* pixels, size_t count) {
+	for (size_t i = 0; i < count; i++) {
+		if (coverage != nullptr && coverage[i] == 0)
+			memset(pixels + i * 4, 0, 4);
+		else memcpy(pixels + i * 4, palette + indices[i] * 4, 4);
+	}
+}
+
+bool HasTransparency_Scalar(const uint8_t* pixels, size_t count) {
+	for (size_t i = 0; i < count; i++)
+		if (pixels[i * 4 + 3] < 255)
+			return true;
+	return false;
+}
+
+void BlitMasked_Scalar(uint8_t* dest, uint8_t* destCoverage, const uint8_t* source, const uint8_t* sourceCoverage, size_t count) {
+	for (size_t i = 0; i < count; i++) {
+		if (sourceCoverage[i] != 0) {
+			dest[i] = source[i];
+			destCoverage[i] |= sourceCoverage[i];
+		}
+	}
+}
+
+#ifdef PIXELS_X86
+
+/*
+* AVX2 - eight pixels or 32 indices at a time, with the palette read by a gather
+*/
+
+TARGET_AVX2 void ExpandPalette_AVX2(const uint8_t* indices, const uint8_t* coverage, const uint8_t* palette, uint8_t* pixels, size_t count) {
+	const int* table = reinterpret_cast<const int*>(palette);
+	const __m256i zero = _mm256_setzero_si256();
+	size_t i = 0;
+	for (; i + 8 <= count; i += 8) {
+		__m256i offsets = _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(indices + i)));
+		__m256i colors = _mm256_i32gather_epi32(table, offsets, 4);
+		if (coverage != nullptr) {
+			__m256i covered = _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(coverage + i)));
+			colors = _mm256_andnot_si256(_mm256_cmpeq_epi32(covered, zero), colors);
+		}
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(pixels + i * 4), colors);
+	}
+	ExpandPalette_Scalar(indices + i, coverage == nullptr ? nullptr : coverage + i, palette, pixels + i * 4, count - i);
+}
+
+TARGET_AVX2 bool HasTransparency_AVX2(const uint8_t* pixels, size_t count) {
+	const __m256i alpha = _mm256_set1_epi32(static_cast<int>(0xFF000000));
+	size_t i = 0;
+	for (; i + 8 <= count; i += 8) {
+		__m256i p = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(pixels + i * 4));
+		__m256i opaque = _mm256_cmpeq_epi32(_mm256_and_si256(p, alpha), alpha);
+		if (_mm256_movemask_epi8(opaque) != -1)
+			return true;
+	}
+	return HasTransparency_Scalar(pixels + i * 4, count - i);
+}
+
+TARGET_AVX2 void BlitMasked_AVX2(uint8_t* dest, uint8_t* destCoverage, const uint8_t* source, const uint8_t* sourceCoverage, size_t count) {
+	const __m256i zero = _mm256_setzero_si256();
+	size_t i = 0;
+	for (; i + 32 <= count; i += 32) {
+		__m256i s = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(source + i));
+		__m256i d = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(dest + i));
+		__m256i sc = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(sourceCoverage + i));
+		__m256i dc = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(destCoverage + i));
+		__m256i uncovered = _mm256_cmpeq_epi8(sc, zero);
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(dest + i), _mm256_blendv_epi8(s, d, uncovered));
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(destCoverage + i), _mm256_or_si256(dc, sc));
+	}
+	BlitMasked_Scalar(dest + i, destCoverage + i, source + i, sourceCoverage + i, count - i);
+}
+
+/*
+* SSE4.1 - four pixels or 16 indices at a time. Without a gather, each palette
+* expansion is assembled from four scalar loads.
+*/
+
+TARGET_SSE41 void ExpandPalette_SSE41(const uint8_t* indices, const uint8_t* coverage, const uint8_t* palette, uint8_t* pixels, size_t count) {
+	const int* table = reinterpret_cast<const int*>(palette);
+	const __m128i zero = _mm_setzero_si128();
+	size_t i = 0;
+	for (; i + 4 <= count; i += 4) {
+		__m128i colors = _mm_cvtsi32_si128(table[indices[i]]);
+		colors = _mm_insert_epi32(colors, table[indices[i + 1]], 1);
+		colors = _mm_insert_epi32(colors, table[indices[i + 2]], 2);
+		colors = _mm_insert_epi32(colors, table[indices[i + 3]], 3);
+		if (coverage != nullptr) {
+			int packed;
+			memcpy(&packed, coverage + i, 4);
+			__m128i covered = _mm_cvtepu8_epi32(_mm_cvtsi32_si128(packed));
+			colors = _mm_andnot_si128(_mm_cmpeq_epi32(covered, zero), colors);
+		}
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(pixels + i * 4), colors);
+	}
+	ExpandPalette_Scalar(indices + i, coverage == nullptr ? nullptr : coverage + i, palette, pixels + i * 4, count - i);
+}
+
+TARGET_SSE41 bool HasTransparency_SSE41(const uint8_t* pixels, size_t count) {
+	const __m128i alpha = _mm_set1_epi32(static_cast<int>(0xFF000000));
+	size_t i = 0;
+	for (; i + 4 <= count; i += 4) {
+		__m128i p = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pixels + i * 4));
+		__m128i opaque = _mm_cmpeq_epi32(_mm_and_si128(p, alpha), alpha);
+		if (_mm_movemask_epi8(opaque) != 0xFFFF)
+			return true;
+	}
+	return HasTransparency_Scalar(pixels + i * 4, count - i);
+}
+
+TARGET_SSE41 void BlitMasked_SSE41(uint8_t* dest, uint8_t* destCoverage, const uint8_t* source, const uint8_t* sourceCoverage, size_t count) {
+	const __m128i zero = _mm_setzero_si128();
+	size_t i = 0;
+	for (; i + 16 <= count; i += 16) {
+		__m128i s = _mm_loadu_si128(reinterpret_cast<const __m128i*>(source + i));
+		__m128i d = _mm_loadu_si128(reinterpret_cast<const __m128i*>(dest + i));
+		__m128i sc = _mm_loadu_si128(reinterpret_cast<const __m128i*>(sourceCoverage + i));
+		__m128i dc = _mm_loadu_si128(reinterpret_cast<const __m128i*>(destCoverage + i));
+		__m128i uncovered = _mm_cmpeq_epi8(sc, zero);
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(dest + i), _mm_blendv_epi8(s, d, uncovered));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(destCoverage + i), _mm_or_si128(dc, sc));
+	}
+	BlitMasked_Scalar(dest + i, destCoverage + i, source + i, sourceCoverage + i, count - i);
+}
+
+// Includes checking the OS saves the AVX registers
+bool CpuHasAVX2() {
+	#ifdef _MSC_VER
+	int info[4];
+	__cpuid(info, 1);
+	bool osAvx = (info[2] & (1 << 27)) && (info[2] & (1 << 28)) && (_xgetbv(0) & 6) == 6;
+	__cpuidex(info, 7, 0);
+	return osAvx && (info[1] & (1 << 5));
+	#else
+	return __builtin_cpu_supports("avx2");
+	#endif
+}
+
+bool CpuHasSSE41() {
+	#ifdef _MSC_VER
+	int info[4];
+	__cpuid(info, 1);
+	return (info[2] & (1 << 19)) != 0;
+	#else
+	return __builtin_cpu_supports("sse4.1");
+	#endif
+}
+
+#endif
+
+#ifdef PIXELS_NEON
+
+/*
+* NEON - 16 pixels or indices at a time. The palette is split into a 256 byte
+* table per channel, looked up 64 bytes at a time with table instructions.
+* Every AArch64 CPU has NEON, so these are always used there.
+*/
+
+void ExpandPalette_NEON(const uint8_t* indices, const uint8_t* coverage, const uint8_t* palette, uint8_t* pixels, size_t count) {
+	if (count < 16) {
+		ExpandPalette_Scalar(indices, coverage, palette, pixels, count);
+		return;
+	}
+
+	uint8_t planes[4][256];
+	for (int i = 0; i < 256; i++)
+		for (int c = 0; c < 4; c++)
+			planes[c][i] = palette[i * 4 + c];
+	uint8x16x4_t tables[4][4]; // Channel, then quarter of the palette
+	for (int c = 0; c < 4; c++) {
+		for (int q = 0; q < 4; q++) {
+			const uint8_t* start = planes[c] + q * 64;
+			tables[c][q] = {{ vld1q_u8(start), vld1q_u8(start + 16), vld1q_u8(start + 32), vld1q_u8(start + 48) }};
+		}
+	}
+
+	// Indices outside a table's 64 entries leave the lane as it was
+	const uint8x16_t quarter = vdupq_n_u8(64);
+	size_t i = 0;
+	for (; i + 16 <= count; i += 16) {
+		uint8x16_t index = vld1q_u8(indices + i);
+		uint8x16_t index1 = vsubq_u8(index, quarter);
+		uint8x16_t index2 = vsubq_u8(index1, quarter);
+		uint8x16_t index3 = vsubq_u8(index2, quarter);
+		uint8x16_t covered = vdupq_n_u8(0xFF);
+		if (coverage != nullptr) {
+			uint8x16_t c = vld1q_u8(coverage + i);
+			covered = vtstq_u8(c, c);
+		}
+		uint8x16x4_t colors;
+		for (int c = 0; c < 4; c++) {
+			uint8x16_t channel = vqtbl4q_u8(tables[c][0], index);
+			channel = vqtbx4q_u8(channel, tables[c][1], index1);
+			channel = vqtbx4q_u8(channel, tables[c][2], index2);
+			channel = vqtbx4q_u8(channel, tables[c][3], index3);
+			colors.val[c] = vandq_u8(channel, covered);
+		}
+		vst4q_u8(pixels + i * 4, colors);
+	}
+	ExpandPalette_Scalar(indices + i, coverage == nullptr ? nullptr : coverage + i, palette, pixels + i * 4, count - i);
+}
+
+bool HasTransparency_NEON(const uint8_t* pixels, size_t count) {
+	size_t i = 0;
+	for (; i + 16 <= count; i += 16) {
+		uint8x16x4_t p = vld4q_u8(pixels + i * 4);
+		if (vminvq_u8(p.val[3]) < 255)
+			return true;
+	}
+	return HasTransparency_Scalar(pixels + i * 4, count - i);
+}
+
+void BlitMasked_NEON(uint8_t* dest, uint8_t* destCoverage, const uint8_t* source, const uint8_t* sourceCoverage, size_t count) {
+	size_t i = 0;
+	for (; i + 16 <= count; i += 16) {
+		uint8x16_t sc = vld1q_u8(sourceCoverage + i);
+		uint8x16_t covered = vtstq_u8(sc, sc);
+		vst1q_u8(dest + i, vbslq_u8(covered, vld1q_u8(source + i), vld1q_u8(dest + i)));
+		vst1q_u8(destCoverage + i, vorrq_u8(vld1q_u8(destCoverage + i), sc));
+	}
+	BlitMasked_Scalar(dest + i, destCoverage + i, source + i, sourceCoverage + i, count - i);
+}
+
+#endif
+
+PixelKernels SelectKernels() {
+	#ifdef PIXELS_X86
+	if (CpuHasAVX2())
+		return { ExpandPalette_AVX2, HasTransparency_AVX2, BlitMasked_AVX2 };
+	if (CpuHasSSE41())
+		return { ExpandPalette_SSE41, HasTransparency_SSE41, BlitMasked_SSE41 };
+	#endif
+	#ifdef PIXELS_NEON
+	return { ExpandPalette_NEON, HasTransparency_NEON, BlitMasked_NEON };
+	#endif
+	return { ExpandPalette_Scalar, HasTransparency_Scalar, BlitMasked_Scalar };
+}
+
+const PixelKernels& Kernels() {
+	static const PixelKernels kernels = SelectKernels();
+	return kernels;
+}
+
+void ExpandPalette(const uint8_t* indices, const uint8_t* coverage, const uint8_t* palette, uint8_t* pixels, size_t count) {
+	Kernels().expandPalette(indices, coverage, palette, pixels, count);
+}
+
+bool HasTransparency(const uint8_t* pixels, size_t count) {
+	return Kernels().hasTransparency(pixels, count);
+}
+
+void BlitMasked(uint8_t* dest, uint8_t* destCoverage, const uint8_t* source, const uint8_t* sourceCoverage, size_t count) {
+	Kernels().blitMasked(dest, destCoverage, source, sourceCoverage, count);
+}
@@ -0,0 +1,24 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+
+/*
+* Pixel Kernels
+*
+* The inner loops of texture exporting. Images are composited as 8 bit palette
+* indices, with a byte of coverage for each, and expanded to 32 bit BGRA pixels
+* of 4 bytes each when they're written. Every kernel has a scalar version, and
+* SIMD versions for AVX2, SSE4.1 and NEON. The fastest one the CPU supports is
+* chosen the first time a kernel is called. Every version gives results
+* identical to the scalar one.
+*/
+
+// Looks up count palette indices in a 256 color BGRA palette. Pixels whose coverage
+// is zero become transparent black. Coverage may be nullptr if every pixel is covered.
+void ExpandPalette(const uint8_t* indices, const uint8_t* coverage, const uint8_t* palette, uint8_t* pixels, size_t count);
+
+// True if any pixel's alpha is below 255
+bool HasTransparency(const uint8_t* pixels, size_t count);
+
+// Copies every source index with a nonzero coverage over the destination, and adds its coverage to the destination's
+void BlitMasked(uint8_t* dest, uint8_t* destCoverage, const uint8_t* source, const uint8_t* sourceCoverage, size_t count);
@@ -1,12 +1,14 @@
 #include "WadStructs.h"
 #include <tga.h>
 #include <iostream>
-#include <filesystem>
 #include <fstream>
 #include <unordered_map>
+#include <mutex>
+#include "Parallel.h"
+#include "PixelKernels.h"
 
 bool WadLevel::ReadFrom(BinaryReader &reader, VertexTransforms p_transforms, 
-	std::unordered_map<WadString, Dimension>& p_wallDimensions) {
+	const std::unordered_map<WadString, Dimension>& p_wallDimensions, const EventSink& events) {
 	
 	// Set transform data
 	transforms = p_transforms;
@@ -24,13 +26,14 @@ bool WadLevel::ReadFrom(BinaryReader &reader, VertexTransforms p_transforms,
 	// Read Vertices
 	reader.Goto(lumpVertex->offset);
 	verts.Reserve(lumpVertex->size / VertexFloat::size());
-	int16_t tempX = 0, tempY = 0;
+	vertices.Reserve(verts.Num());
 	for (int32_t i = 0; i < verts.Num(); i++) {
-		reader.ReadLE(tempX);
-		reader.ReadLE(tempY);
+		Vertex& v = vertices[i];
+		reader.ReadLE(v.x);
+		reader.ReadLE(v.y);
 
-		verts[i].x = (tempX + transforms.xShift) / transforms.xyDownscale;
-		verts[i].y = (tempY + transforms.yShift) / transforms.xyDownscale;
+		verts[i].x = (v.x + transforms.xShift) / transforms.xyDownscale;
+		verts[i].y = (v.y + transforms.yShift) / transforms.xyDownscale;
 	}
 
 	// Read LineDefs
@@ -89,6 +92,49 @@ bool WadLevel::ReadFrom(BinaryReader &reader, VertexTransforms p_transforms,
 		if(s.ceilHeight > maxHeight)
 			maxHeight = s.ceilHeight;
 	}
+
+	// Every index must point inside the level, since the builders look them up unchecked
+	for (int32_t i = 0; i < linedefs.Num(); i++) {
+		const LineDef& d = linedefs[i];
+		if (d.vertexStart >= verts.Num() || d.vertexEnd >= verts.Num()) {
+			events.Reportf(EVENT_ERROR, "ERROR: LINEDEF %i OF %s HAS A MISSING VERTEX", i, lumpHeader->name.Data());
+			return false;
+		}
+		if ((d.sideFront != NO_SIDEDEF && d.sideFront >= sidedefs.Num()) || (d.sideBack != NO_SIDEDEF && d.sideBack >= sidedefs.Num())) {
+			events.Reportf(EVENT_ERROR, "ERROR: LINEDEF %i OF %s HAS A MISSING SIDEDEF", i, lumpHeader->name.Data());
+			return false;
+		}
+	}
+	for (int32_t i = 0; i < sidedefs.Num(); i++) {
+		if (sidedefs[i].sector < 0 || sidedefs[i].sector >= sectors.Num()) {
+			events.Reportf(EVENT_ERROR, "ERROR: SIDEDEF %i OF %s HAS A MISSING SECTOR", i, lumpHeader->name.Data());
+			return false;
+		}
+	}
+
+	// Read Things - every field is a 16-bit integer, so the lump is decoded in one
+	// pass straight from the file buffer
+	if (lumpThings->offset < 0 || lumpThings->size < 0)
+		throw IndexOOBException();
+	things.Reserve(lumpThings->size / Thing::size());
+	if (static_cast<size_t>(lumpThings->offset) + static_cast<size_t>(things.Num()) * Thing::size() > reader.GetLength())
+		throw IndexOOBException();
+	const uint8_t* thingData = reinterpret_cast<const uint8_t*>(reader.GetBuffer()) + lumpThings->offset;
+	for (int32_t i = 0; i < things.Num(); i++, thingData += Thing::size()) {
+		int16_t fields[5];
+		for (int f = 0; f < 5; f++)
+			fields[f] = static_cast<int16_t>(thingData[f * 2] | thingData[f * 2 + 1] << 8);
+		things[i] = {fields[0], fields[1], fields[2], fields[3], fields[4]};
+	}
+
+	// Read the REJECT table
+	reject.clear();
+	size_t rejectSize = (static_cast<size_t>(sectors.Num()) * sectors.Num() + 7) / 8;
+	if (lumpReject != nullptr && lumpReject->size > 0 && static_cast<size_t>(lumpReject->size) >= rejectSize) {
+		reader.Goto(lumpReject->offset);
+		reject.resize(rejectSize);
+		reader.ReadBytes(reinterpret_cast<char*>(reject.data()), rejectSize);
+	}
 	return true;
 }
 
@@ -100,11 +146,22 @@ void WadLevel::Debug() {
 	printf("Sector Count: %i\n", sectors.Num());
 }
 
-bool Wad::ReadFrom(const char* wadpath) {
-	if (!reader.SetBuffer(wadpath)) {
-		printf("Failed to read file from disk\n");
+bool Wad::ReadFrom(const char* wadpath, const EventSink& events) {
+	if (!file.SetBuffer(wadpath)) {
+		events.Report(EVENT_ERROR, "Failed to read file from disk");
 		return false;
 	}
+	return ReadDirectory(events);
+}
+
+bool Wad::ReadFrom(const char* data, size_t length, const EventSink& events) {
+	// The reader never writes to its buffer
+	file.SetBuffer(const_cast<char*>(data), length);
+	return ReadDirectory(events);
+}
+
+bool Wad::ReadDirectory(const EventSink& events) {
+	BinaryReader reader = Cursor();
 
 	// Read WAD Magic
 	{
@@ -112,7 +169,7 @@ bool Wad::ReadFrom(const char* wadpath) {
 		char magic[SIZE_MAGIC];
 		reader.ReadBytes(magic, SIZE_MAGIC);
 		if (memcmp(magic, "IWAD", SIZE_MAGIC) != 0 && memcmp(magic, "PWAD", SIZE_MAGIC) != 0) {
-			printf("File must be an IWAD or a PWAD\n");
+			events.Report(EVENT_ERROR, "File must be an IWAD or a PWAD");
 			return false;
 		}
 	}
@@ -152,6 +209,8 @@ bool Wad::ReadFrom(const char* wadpath) {
 		levels[lvlNum].lumpVertex = &lumps[i++];
 		i += 3; // Skipping segments, subsectors, and nodes
 		levels[lvlNum].lumpSectors = &lumps[i];
+		if (i + 1 < lumps.Num() && lumps[i + 1].name == "REJECT")
+			levels[lvlNum].lumpReject = &lumps[i + 1];
 		lvlNum++;
 	}
 
@@ -169,22 +228,88 @@ bool Wad::ReadFrom(const char* wadpath) {
 	return true;
 }
 
-WadLevel* Wad::DecodeLevel(const char* name, VertexTransforms transforms) {
+const uint8_t* Wad::LumpData(const LumpEntry& lump) const {
+	BinaryReader reader = Cursor();
+	if (lump.offset < 0 || lump.size < 0 || static_cast<size_t>(lump.offset) + lump.size > reader.GetLength())
+		return nullptr;
+	return reinterpret_cast<const uint8_t*>(reader.GetBuffer()) + lump.offset;
+}
+
+std::unique_ptr<WadLevel> Wad::DecodeLevel(const char* name, VertexTransforms transforms, const EventSink& events) const {
 	for (int32_t i = 0; i < levels.Num(); i++)
-		if (levels[i].lumpHeader->name == name) {
-			levels[i].ReadFrom(reader, transforms, textureSizes);
-			return &levels[i];
-		}
+		if (levels[i].lumpHeader->name == name)
+			return DecodeLevel(i, transforms, events);
 
-	printf("Failed to find level with specified name.\n");
+	events.Report(EVENT_ERROR, "Failed to find level with specified name.");
 	return nullptr;
 }
 
-void Wad::WriteLumpNames() {
+std::unique_ptr<WadLevel> Wad::DecodeLevel(int32_t index, VertexTransforms transforms, const EventSink& events) const {
+	const WadLevel& lumpRefs = levels[index];
+	std::unique_ptr<WadLevel> level(new WadLevel);
+	level->lumpHeader = lumpRefs.lumpHeader;
+	level->lumpThings = lumpRefs.lumpThings;
+	level->lumpLines = lumpRefs.lumpLines;
+	level->lumpSides = lumpRefs.lumpSides;
+	level->lumpVertex = lumpRefs.lumpVertex;
+	level->lumpSectors = lumpRefs.lumpSectors;
+	level->lumpReject = lumpRefs.lumpReject;
+
+	BinaryReader reader = Cursor();
+	if (!level->ReadFrom(reader, transforms, textureSizes, events))
+		return nullptr;
+	return level;
+}
+
+// Matches an uppercase WadString against a wildcard pattern of the given length
+bool MatchesPattern(const char* name, const char* pattern, size_t patternLength) {
+	if (patternLength == 0)
+		return *name == '\0';
+
+	char p = *pattern;
+	if (p == '*') {
+		for (const char* n = name; ; n++) {
+			if (MatchesPattern(n, pattern + 1, patternLength - 1))
+				return true;
+			if (*n == '\0')
+				return false;
+		}
+	}
+
+	if (*name == '\0')
+		return false;
+	if (p >= 'a' && p <= 'z')
+		p -= 32;
+	if (p != '?' && p != *name)
+		return false;
+	return MatchesPattern(name + 1, pattern + 1, patternLength - 1);
+}
+
+std::vector<int32_t> Wad::FindLevels(const char* patterns) const {
+	std::vector<int32_t> indices;
+	for (int32_t i = 0; i < levels.Num(); i++) {
+		const char* start = patterns;
+		while (true) {
+			const char* end = strchr(start, ',');
+			size_t length = end == nullptr ? strlen(start) : end - start;
+
+			if (MatchesPattern(levels[i].lumpHeader->name.Data(), start, length)) {
+				indices.push_back(i);
+				break;
+			}
+			if (end == nullptr)
+				break;
+			start = end + 1;
+		}
+	}
+	return indices;
+}
+
+void Wad::WriteLumpNames() const {
 	std::ofstream output("lumpnames.txt", std::ios_base::binary);
 
 	for(int i = 0; i < lumps.Num(); i++)
-		output << lumps[i].name << "\n";
+		output << lumps[i].name.Data() << "\n";
 }
 
 
@@ -198,7 +323,8 @@ void Wad::GetTextureDimensions(WadString name) {
 
 	size_t startPosition = lumpMap.at(name)->offset;
 	int32_t textureCount = 0;
-	BinaryReader offsetReader(reader);
+	BinaryReader reader = Cursor();
+	BinaryReader offsetReader = Cursor();
 	offsetReader.Goto(startPosition);
 	offsetReader.ReadLE(textureCount);
 
@@ -220,13 +346,9 @@ void Wad::GetTextureDimensions(WadString name) {
 	}
 }
 
-const char* dir_critical =    "base/art/wadtobrush/";
-const char* dir_flats =		  "base/art/wadtobrush/flats/";
-const char* dir_flats_mat =   "base/declTree/material2/art/wadtobrush/flats/";
-const char* dir_walls =       "base/art/wadtobrush/walls/";
-const char* dir_walls_mat =   "base/declTree/material2/art/wadtobrush/walls/";
-const char* dir_patches =     "base/art/wadtobrush/patches/";
-const char* dir_patches_mat = "base/declTree/material2/art/wadtobrush/patches/";
+// Asset folders, relative to the game's base directory
+const char* dir_art =      "art/wadtobrush/";
+const char* dir_art_mat =  "declTree/material2/art/wadtobrush/";
 
 struct Color { // This BGRA variable order is what the TGA writer expects
 	uint8_t b = 0;
@@ -235,14 +357,64 @@ struct Color { // This BGRA variable order is what the TGA writer expects
 	uint8_t a = 0;
 };
 
-void WriteArtAsset(const char* subFolder, WadString name, Color* pixels, uint32_t width, uint32_t height) {
+// Encodes a color-mapped image, with a palette of the image's own colors. False if it has more than 256 colors
+bool EncodeMapped(const Color* pixels, uint32_t width, uint32_t height, std::vector<uint8_t>& image) {
+	const size_t maxColors = 256;
+	std::vector<Color> palette;
+	std::vector<uint8_t> indices(static_cast<size_t>(width) * height);
+	std::unordered_map<uint32_t, uint8_t> lookup;
+	for (size_t i = 0; i < indices.size(); i++) {
+		uint32_t key;
+		memcpy(&key, &pixels[i], sizeof(key));
+		auto found = lookup.find(key);
+		if (found == lookup.end()) {
+			if (palette.size() == maxColors)
+				return false;
+			found = lookup.emplace(key, static_cast<uint8_t>(palette.size())).first;
+			palette.push_back(pixels[i]);
+		}
+		indices[i] = found->second;
+	}
+
+	uint16_t paletteSize = static_cast<uint16_t>(palette.size());
+	image.resize(tga_mapped_size(width, height, paletteSize, 4));
+	tga_encode_mapped(image.data(), width, height, indices.data(), (uint8_t*)palette.data(), paletteSize, 4, 4);
+	return true;
+}
+
+void EncodeArt(TextureFormat format, const Color* pixels, uint32_t width, uint32_t height, std::vector<uint8_t>& image) {
+	if (format == TEXTURE_TGA_RLE) {
+		image.resize(tga_rle_max_size(width, height, 4));
+		image.resize(tga_encode_rle(image.data(), width, height, (const uint8_t*)pixels, 4, 4));
+		return;
+	}
+	if (format == TEXTURE_TGA_MAPPED && EncodeMapped(pixels, width, height, image))
+		return;
+	image.resize(tga_encoded_size(width, height, 4));
+	tga_encode(image.data(), width, height, (const uint8_t*)pixels, 4, 4);
+}
+
+/*
+* Images are only expanded from palette indices to colors here, into a buffer
+* reused by the calling thread. Coverage may be nullptr if every pixel is covered.
+*/
+void WriteArtAsset(AssetWriter& assets, const EventSink& events, TextureFormat format, const char* subFolder, WadString name,
+	const Color* palette, const uint8_t* indices, const uint8_t* coverage, uint32_t width, uint32_t height, std::vector<Color>& expanded)
+{
+	expanded.resize(static_cast<size_t>(width) * height);
+	Color* pixels = expanded.data();
+	ExpandPalette(indices, coverage, reinterpret_cast<const uint8_t*>(palette), reinterpret_cast<uint8_t*>(pixels), expanded.size());
 
 	// PART ONE - Write the art file
-	std::string artPath = "base/art/wadtobrush/";
+	std::string artPath = dir_art;
 	artPath.append(subFolder);
 	artPath.append(name);
 	artPath.append(".tga");
-	tga_write(artPath.data(), width, height, (uint8_t*)pixels, 4, 4);
+
+	std::vector<uint8_t> image;
+	EncodeArt(format, pixels, width, height, image);
+	if (!assets.Write(artPath, (char*)image.data(), image.size()))
+		events.Reportf(EVENT_ERROR, "ERROR: FAILED TO WRITE %s", artPath.data());
 
 	// PART TWO - Write the material2 decl
 
@@ -293,13 +465,7 @@ R"(declType( material2 ) {
 	}
 })";
 
-	bool useAlpha = false;
-	for(uint32_t i = 0, max = width * height; i < max; i++) {
-		if (pixels[i].a < 255) {
-			useAlpha = true;
-			break;
-		}
-	}
+	bool useAlpha = HasTransparency(reinterpret_cast<const uint8_t*>(pixels), static_cast<size_t>(width) * height);
 
 	const size_t BUFFER_MAX = 1024;
 	char buffer[BUFFER_MAX];
@@ -310,42 +476,167 @@ R"(declType( material2 ) {
 	else 
 		writtenLength = snprintf(buffer, BUFFER_MAX, mat2_static, subFolder, name.Data());
 	if (writtenLength >= BUFFER_MAX) {
-		printf("\nERROR: MATERIAL2 BUFFER OVERRUN %s\n", name.Data());
+		events.Reportf(EVENT_ERROR, "ERROR: MATERIAL2 BUFFER OVERRUN %s", name.Data());
 		return;
 	}
 
-	std::string matPath = "base/declTree/material2/art/wadtobrush/";
+	std::string matPath = dir_art_mat;
 	matPath.append(subFolder);
 	matPath.append(name);
 	matPath.append(".decl");
-
-	std::ofstream mat2Writer(matPath.data(), std::ios_base::binary);
-	mat2Writer.write(buffer, writtenLength);
-	mat2Writer.close();
+	if (!assets.Write(matPath, buffer, writtenLength))
+		events.Reportf(EVENT_ERROR, "ERROR: FAILED TO WRITE %s", matPath.data());
 }
 
+/*
+* A decoded patch, as palette indices and a coverage mask with a bit per pixel,
+* set where a post covers it - about a quarter of the memory of 32 bit colors.
+* Both point into a slab shared by every patch.
+*/
 struct PatchImage {
 	uint16_t width = 0;
 	uint16_t height = 0;
-	Color* pixels = nullptr;
+	uint8_t* indices = nullptr;
+	uint8_t* coverage = nullptr; // Each row starts on a new byte, with its first pixel in the lowest bit
+
+	size_t MaskStride() const {
+		return (static_cast<size_t>(width) + 7) / 8;
+	}
 
-	~PatchImage() {
-		delete[] pixels;
+	static size_t SlabSize(uint16_t width, uint16_t height) {
+		return static_cast<size_t>(width) * height + (static_cast<size_t>(width) + 7) / 8 * height;
+	}
+
+	// Expands count pixels of a row's coverage, from the given column on, to a byte each
+	void UnpackCoverage(int row, int firstCol, uint8_t* out, size_t count) const {
+		const uint8_t* mask = coverage + row * MaskStride();
+		for (size_t i = 0; i < count; i++) {
+			size_t col = firstCol + i;
+			out[i] = (mask[col >> 3] >> (col & 7)) & 1;
+		}
 	}
 };
 
-void Wad::ExportTextures(bool exportWalls, bool exportFlats, bool exportPatches) {
+// Reused by a thread for every image it composites and writes
+struct ExportBuffers {
+	std::vector<uint8_t> indices;
+	std::vector<uint8_t> coverage; // A byte per pixel
+	std::vector<uint8_t> row;
+	std::vector<Color> pixels;
+};
+
+/*
+* Patches are stored as columns of posts: vertical runs of palette indices.
+* - Header: width, height, left offset and top offset, 16 bits each
+* - A 32 bit offset to each column, from the start of the lump
+* - Each column's posts, ended by a topDelta of 0xFF
+* - Each post: topDelta, length, a padding byte, length indices and another padding byte
+*
+* Tall patches, from DeePsea and other editors, can't reach rows past 254 with
+* a single byte. A post whose topDelta is no greater than the previous post's
+* top is placed relative to it instead.
+*
+* The image's size is read from the header beforehand, and its indices and
+* coverage must start zeroed. Every column offset and post is checked against
+* the lump before anything is decoded, so the copy loops run unchecked. Posts
+* running past the bottom of the patch are clipped. Returns false if the patch
+* is malformed, leaving it transparent.
+*/
+bool DecodePatch(const uint8_t* lump, size_t lumpSize, PatchImage& image) {
+	auto read32 = [lump](size_t pos) {
+		return static_cast<uint32_t>(lump[pos] | lump[pos + 1] << 8 | lump[pos + 2] << 16 | static_cast<uint32_t>(lump[pos + 3]) << 24);
+	};
+	const size_t headerSize = 8;
+	uint16_t width = image.width;
+	uint16_t height = image.height;
+
+	// Column offsets, then every post
+	if (lumpSize < headerSize + 4 * static_cast<size_t>(width))
+		return false;
+	for (uint16_t col = 0; col < width; col++) {
+		size_t pos = read32(headerSize + 4 * static_cast<size_t>(col));
+		while (true) {
+			if (pos >= lumpSize)
+				return false;
+			if (lump[pos] == 0xFF)
+				break;
+			if (pos + 4 > lumpSize || pos + 4 + lump[pos + 1] > lumpSize)
+				return false;
+			pos += 4 + lump[pos + 1];
+		}
+	}
+
+	size_t maskStride = image.MaskStride();
+	for (uint16_t col = 0; col < width; col++) {
+		size_t pos = read32(headerSize + 4 * static_cast<size_t>(col));
+		uint8_t* column = image.indices + col;
+		uint8_t* mask = image.coverage + col / 8;
+		uint8_t bit = static_cast<uint8_t>(1 << (col & 7));
+		int top = -1;
+		while (lump[pos] != 0xFF) {
+			int topDelta = lump[pos];
+			int length = lump[pos + 1];
+			top = topDelta <= top ? top + topDelta : topDelta;
+
+			const uint8_t* indices = lump + pos + 3;
+			int end = top + length < height ? top + length : height;
+			for (int row = top; row < end; row++) {
+				column[static_cast<size_t>(row) * width] = indices[row - top];
+				mask[row * maskStride] |= bit;
+			}
+			pos += 4 + length;
+		}
+	}
+	return true;
+}
+
+/*
+* Passes events from several threads on to a sink one at a time, since the
+* sink's callback may not be thread-safe. Completed items are counted here, so
+* progress only ever increases.
+*/
+class SerialEvents {
+	private:
+	const EventSink& target;
+	std::mutex lock;
+	int32_t completed = 0;
+
+	static void Forward(const Event& e, void* userData) {
+		SerialEvents* self = static_cast<SerialEvents*>(userData);
+		std::lock_guard<std::mutex> guard(self->lock);
+		self->target.Report(e.type, e.message, e.current, e.total);
+	}
+
+	public:
+	SerialEvents(const EventSink& p_target) : target(p_target) {}
+
+	EventSink Sink() {
+		return EventSink(Forward, this);
+	}
+
+	void Completed(const char* message, int32_t total) {
+		std::lock_guard<std::mutex> guard(lock);
+		target.Progress(message, ++completed, total);
+	}
+};
+
+/*
+* Index of the last item using each name. When several items share a name, only
+* the last is written, as it would have overwritten the others when exported one
+* at a time - and two threads must never write the same file at once.
+*/
+std::unordered_map<WadString, int32_t> LastUses(const std::vector<WadString>& names) {
+	std::unordered_map<WadString, int32_t> lastUses;
+	for (size_t i = 0; i < names.size(); i++)
+		lastUses[names[i]] = static_cast<int32_t>(i);
+	return lastUses;
+}
+
+void Wad::ExportTextures(bool exportWalls, bool exportFlats, bool exportPatches, AssetWriter& assets, const EventSink& events, int jobs, TextureFormat format) const {
+	BinaryReader reader = Cursor();
 	const int32_t paletteSize = 256;
 	Color palette[paletteSize];
 
-	// Create directories
-	std::filesystem::create_directories(dir_flats);
-	std::filesystem::create_directories(dir_flats_mat);
-	std::filesystem::create_directories(dir_walls);
-	std::filesystem::create_directories(dir_walls_mat);
-	std::filesystem::create_directories(dir_patches);
-	std::filesystem::create_directories(dir_patches_mat);
-
 	// Read First PlayPal Palette
 	reader.Goto(lumpMap.at("PLAYPAL")->offset);
 	for (int i = 0; i < lumps.Num(); i++) {
@@ -372,103 +663,97 @@ void Wad::ExportTextures(bool exportWalls, bool exportFlats, bool exportPatches)
 			black[i].b = 0;
 			black[i].a = 255;
 		}
-		tga_write("base/art/wadtobrush/black.tga", 16, 16, (uint8_t*)black, 4, 4);
+		std::vector<uint8_t> image;
+		EncodeArt(format, black, 16, 16, image);
+		assets.Write(std::string(dir_art) + "black.tga", (char*)image.data(), image.size());
 	}
 
-	struct PatchColumn {
-		uint32_t offset = 0; // Relative to beginning of patch header
-		uint8_t topDelta = 0;
-		uint8_t length = 0;
-		uint8_t unused = 0;
-		//WadArray<uint8_t, uint8_t> colors;
-		uint8_t unused2 = 0;
-	};
-
-	struct PatchHeader {
-		WadString name;
-		uint16_t width = 0;
-		uint16_t height = 0;
-		int16_t leftOffset = 0; // Used to create standalone image file - NOT to offset patch in texture
-		int16_t topOffset = 0;
-		//WadArray<PatchColumn, uint16_t> columns;
-	};
-
 	if(exportWalls || exportPatches) {
-		PatchImage* images = nullptr;
 		int32_t imageCount = 0;
 
-		// Allocate Color array
-		BinaryReader columnReader(reader);
 		BinaryReader pnameReader(reader);
 		pnameReader.Goto(lumpMap.at("PNAMES")->offset);
 		pnameReader.ReadLE(imageCount);
-		images = new PatchImage[imageCount];
+
+		std::vector<WadString> names(imageCount);
+		for (int32_t i = 0; i < imageCount; i++)
+			names[i].ReadFrom(pnameReader);
+		std::unordered_map<WadString, int32_t> lastUses = LastUses(names);
 
 		//std::ofstream patchmeta("patchmeta.txt", std::ios_base::binary);
-		printf("%i Wall Patches Found\n", imageCount);
+		events.Reportf(EVENT_INFO, "%i Wall Patches Found", imageCount);
 		//patchmeta << imageCount << " Patches Found\n";
-		for (int i = 0; i < imageCount; i++) {
-			PatchHeader patch;
-			patch.name.ReadFrom(pnameReader);
-
-			size_t startPosition = lumpMap.at(patch.name)->offset;
-			reader.Goto(startPosition);
-			reader.ReadLE(patch.width);
-			reader.ReadLE(patch.height);
-			reader.ReadLE(patch.leftOffset);
-			reader.ReadLE(patch.topOffset);
-
-			//printf("%i %s (%i, %i)\n", i, patch.name.Data(), patch.width, patch.height);
-			//patchmeta << i << " " << patch.name.Data() << " (" << patch.width << ", " << patch.height 
-			//	<< " ) (" << patch.leftOffset << " " << patch.topOffset << ")\n";
-
-			Color* pixels = new Color[patch.width * patch.height];
-			images[i].pixels = pixels;
-			images[i].width = patch.width;
-			images[i].height = patch.height;
-			uint8_t row = 0, col = 0;
-
-			for (int k = 0; k < patch.width; k++) { // Width dictates column count
-				PatchColumn column;
-				reader.ReadLE(column.offset);
-				columnReader.Goto(startPosition + column.offset);
-
-				while (true) {
-					columnReader.ReadLE(column.topDelta);
-					if (column.topDelta == 0xFF) {
-						col++;
-						break;
-					}
-					else row = column.topDelta;
 
-					columnReader.ReadLE(column.length);
-					columnReader.ReadLE(column.unused);
-					uint8_t index;
+		// Size every patch from its header, then allocate them all at once
+		std::vector<PatchImage> images(imageCount);
+		std::vector<const LumpEntry*> patchLumps(imageCount);
+		std::vector<size_t> slabOffsets(imageCount);
+		size_t slabSize = 0;
+		for (int32_t i = 0; i < imageCount; i++) {
+			auto found = lumpMap.find(names[i]);
+			if (found == lumpMap.end()) {
+				events.Reportf(EVENT_ERROR, "ERROR: MISSING PATCH %s", names[i].Data());
+				continue;
+			}
+			patchLumps[i] = found->second;
+			const uint8_t* data = LumpData(*found->second);
+			if (data != nullptr && found->second->size >= 4) {
+				images[i].width = static_cast<uint16_t>(data[0] | data[1] << 8);
+				images[i].height = static_cast<uint16_t>(data[2] | data[3] << 8);
+			}
+			slabOffsets[i] = slabSize;
+			slabSize += PatchImage::SlabSize(images[i].width, images[i].height);
+		}
+		std::vector<uint8_t> slab(slabSize);
+		for (int32_t i = 0; i < imageCount; i++) {
+			images[i].indices = slab.data() + slabOffsets[i];
+			images[i].coverage = images[i].indices + static_cast<size_t>(images[i].width) * images[i].height;
+		}
 
-					for (int z = 0; z < column.length; z++) {
-						columnReader.ReadLE(index);
-						pixels[patch.width * row++ + col] = palette[index];
-					}
-					columnReader.ReadLE(column.unused2);
-				}
+		std::vector<ExportBuffers> threadBuffers(jobs < 1 ? 1 : jobs);
+		SerialEvents serial(events);
+		EventSink taskEvents = serial.Sink();
+		ParallelForChecked(imageCount, jobs, [&](size_t task, int worker) {
+			int32_t i = static_cast<int32_t>(task);
+			if (patchLumps[i] == nullptr) {
+				if (exportPatches)
+					serial.Completed("Exporting", imageCount);
+				return;
+			}
+
+			WadString name = names[i];
+			const LumpEntry& lump = *patchLumps[i];
+			const uint8_t* data = LumpData(lump);
+			PatchImage& image = images[i];
+			if (data == nullptr || !DecodePatch(data, lump.size, image)) {
+				taskEvents.Reportf(EVENT_ERROR, "ERROR: MALFORMED PATCH %s", name.Data());
+				if (exportPatches)
+					serial.Completed("Exporting", imageCount);
+				return;
 			}
+
 			if (exportPatches) {
-				printf("\r   - Exporting: %i / %i", i + 1, imageCount);
-				WriteArtAsset("patches/", patch.name, pixels, patch.width, patch.height);
+				if (lastUses.at(name) == i) {
+					ExportBuffers& buffers = threadBuffers[worker];
+					buffers.coverage.resize(static_cast<size_t>(image.width) * image.height);
+					for (int row = 0; row < image.height; row++)
+						image.UnpackCoverage(row, 0, buffers.coverage.data() + static_cast<size_t>(row) * image.width, image.width);
+					WriteArtAsset(assets, taskEvents, format, "patches/", name, palette, image.indices, buffers.coverage.data(),
+						image.width, image.height, buffers.pixels);
+				}
+				serial.Completed("Exporting", imageCount);
 			}
-		}
-		printf("\n   - Done\n");
+		});
+		events.Report(EVENT_INFO, "   - Done");
 		//patchmeta.close();
 		if (exportWalls) {
-			ExportTextures_Walls(images, "TEXTURE1");
-			ExportTextures_Walls(images, "TEXTURE2");
+			ExportTextures_Walls(images.data(), imageCount, palette, "TEXTURE1", assets, events, jobs, format);
+			ExportTextures_Walls(images.data(), imageCount, palette, "TEXTURE2", assets, events, jobs, format);
 		}
-		delete[] images;
-
 	}
 
 	if(exportFlats)
-		ExportTextures_Flats(palette);
+		ExportTextures_Flats(palette, assets, events, jobs, format);
 }
 
 struct MapPatch {
@@ -490,24 +775,42 @@ struct MapTexture {
 	//WadArray<MapPatch, int16_t> patches;
 };
 
-void Wad::ExportTextures_Walls(PatchImage* patches, WadString name) {
+void Wad::ExportTextures_Walls(const PatchImage* patches, int32_t patchCount, const Color* palette, WadString name, AssetWriter& assets,
+	const EventSink& events, int jobs, TextureFormat format) const
+{
 	if(lumpMap.find(name) == lumpMap.end())
 		return;
-	printf("Reading Wall Textures from %s Lump\n", name.Data());
+	BinaryReader reader = Cursor();
+	events.Reportf(EVENT_INFO, "Reading Wall Textures from %s Lump", name.Data());
 
-	MapTexture texture;
-	MapPatch patchDef;
-	BinaryReader patchReader(reader);
 	int32_t wallCount = 0;
 
 	size_t startPosition = lumpMap.at(name)->offset;
 	reader.Goto(startPosition);
 	reader.ReadLE(wallCount);
 
-	printf("   - %i Wall Textures Found\n", wallCount);
+	events.Reportf(EVENT_INFO, "   - %i Wall Textures Found", wallCount);
 
+	// Read the offsets and names up front, so each texture can be composited on its own thread
+	std::vector<int32_t> offsets(wallCount);
+	std::vector<WadString> names(wallCount);
+	BinaryReader nameReader(reader);
 	for (int32_t i = 0; i < wallCount; i++) {
-		reader.ReadLE(texture.offset);
+		reader.ReadLE(offsets[i]);
+		nameReader.Goto(startPosition + offsets[i]);
+		names[i].ReadFrom(nameReader);
+	}
+	std::unordered_map<WadString, int32_t> lastUses = LastUses(names);
+
+	std::vector<ExportBuffers> threadBuffers(jobs < 1 ? 1 : jobs);
+	SerialEvents serial(events);
+	EventSink taskEvents = serial.Sink();
+	ParallelForChecked(wallCount, jobs, [&](size_t task, int worker) {
+		int32_t i = static_cast<int32_t>(task);
+		ExportBuffers& buffers = threadBuffers[worker];
+		MapTexture texture;
+		BinaryReader patchReader = Cursor();
+		texture.offset = offsets[i];
 		patchReader.Goto(startPosition + texture.offset);
 
 		texture.name.ReadFrom(patchReader);
@@ -519,24 +822,61 @@ void Wad::ExportTextures_Walls(PatchImage* patches, WadString name) {
 		patchReader.ReadLE(texture.patchCount);
 		//printf("%i %s (%i x %i) %i", i, texture.name, texture.width, texture.height, texture.patchCount);
 
-		Color* pixels = new Color[texture.width * texture.height];
-		for (int16_t k = 0; k < texture.patchCount; k++) {
+		std::vector<MapPatch> patchDefs(texture.patchCount > 0 ? texture.patchCount : 0);
+		for (MapPatch& patchDef : patchDefs) {
 			patchReader.ReadLE(patchDef.originX);
 			patchReader.ReadLE(patchDef.originY);
 			patchReader.ReadLE(patchDef.patchIndex);
 			patchReader.ReadLE(patchDef.stepDir);
 			patchReader.ReadLE(patchDef.colormap);
+		}
+		if (texture.width < 0 || texture.height < 0) {
+			taskEvents.Reportf(EVENT_ERROR, "ERROR: MALFORMED TEXTURE %s", texture.name.Data());
+			serial.Completed("Exporting", wallCount);
+			return;
+		}
+		size_t area = static_cast<size_t>(texture.width) * texture.height;
+
+		// A single patch covering the whole canvas is written straight from the patch, with nothing to composite
+		// Negative vertical offsets are ignored, as below
+		const PatchImage* whole = nullptr;
+		if (patchDefs.size() == 1 && patchDefs[0].originX == 0 && patchDefs[0].originY <= 0
+			&& patchDefs[0].patchIndex >= 0 && patchDefs[0].patchIndex < patchCount)
+		{
+			const PatchImage& patch = patches[patchDefs[0].patchIndex];
+			if (patch.width == texture.width && patch.height == texture.height)
+				whole = &patch;
+		}
+
+		const uint8_t* indices = nullptr;
+		buffers.coverage.assign(area, 0);
+		if (whole != nullptr) {
+			indices = whole->indices;
+			for (int row = 0; row < texture.height; row++)
+				whole->UnpackCoverage(row, 0, buffers.coverage.data() + static_cast<size_t>(row) * texture.width, texture.width);
+		}
+		else {
+			buffers.indices.assign(area, 0);
+			indices = buffers.indices.data();
+		}
+
+		for (size_t k = 0; k < patchDefs.size() && whole == nullptr; k++) {
+			const MapPatch& patchDef = patchDefs[k];
 
 			//printf(" (%i %i, %i)", patchDef.patchIndex, patchDef.originX, patchDef.originY);
 
 			// IMPORTANT: PATCHES MAY BE BIGGER THAN THE FINAL WALL TEXTURES (running off the screen)
-			// IMPORTANT: PATCHES WITH OPACITY 0 PIXELS CAN GET OVERLAYED OVER OTHER TEXTURES
-			//	SOLUTION: Initialize wall texture with all opacity 0 pixels. Only copy a pixel onto the texture
-			// if it's opacity isn't 0
+			// IMPORTANT: PATCHES WITH TRANSPARENT PIXELS CAN GET OVERLAYED OVER OTHER TEXTURES
+			//	SOLUTION: Start with an uncovered canvas. Only copy a pixel onto the texture
+			// if the patch covers it
 
-			Color* patchImage = patches[patchDef.patchIndex].pixels;
-			int patchWidth = patches[patchDef.patchIndex].width;
-			int patchHeight = patches[patchDef.patchIndex].height;
+			if (patchDef.patchIndex < 0 || patchDef.patchIndex >= patchCount) {
+				taskEvents.Reportf(EVENT_ERROR, "ERROR: MISSING PATCH %i IN TEXTURE %s", patchDef.patchIndex, texture.name.Data());
+				continue;
+			}
+			const PatchImage& patch = patches[patchDef.patchIndex];
+			int patchWidth = patch.width;
+			int patchHeight = patch.height;
 
 
 			// Define bounds on the canvas
@@ -554,54 +894,63 @@ void Wad::ExportTextures_Walls(PatchImage* patches, WadString name) {
 			if(colMax > texture.width)
 				colMax = texture.width;
 
+			// Columns left of the canvas are skipped, so each row is read from the first column that lands on it
+			int firstCol = colMin < 0 ? 0 : colMin;
+			if (firstCol >= colMax)
+				continue;
+			size_t count = colMax - firstCol;
+			buffers.row.resize(count);
 			for (int currentRow = rowMin; currentRow < rowMax; currentRow++) {
-				//if(currentRow < 0) // We won't be drawing any out of bounds rows
-				//	continue;
 				// Ensure we're reading correct row of patch image (if patch runs off texture)
-				int patchImageIndex = patchWidth * (currentRow - rowMin); 
-				int index = currentRow * texture.width;
-				for (int currentCol = colMin; currentCol < colMax; currentCol++) {
-					// Current column may be out of bounds while future columns are not.
-					// We must ensure the patch index continues to get incremented no matter what
-					if(currentCol > -1 && patchImage[patchImageIndex].a > 0)
-						pixels[index + currentCol] = patchImage[patchImageIndex];
-					patchImageIndex++;
-				}
+				size_t patchImageIndex = static_cast<size_t>(patchWidth) * (currentRow - rowMin) + firstCol - colMin;
+				size_t index = static_cast<size_t>(currentRow) * texture.width + firstCol;
+				patch.UnpackCoverage(currentRow - rowMin, firstCol - colMin, buffers.row.data(), count);
+				BlitMasked(buffers.indices.data() + index, buffers.coverage.data() + index, patch.indices + patchImageIndex, buffers.row.data(), count);
 			}
 
 		}
 
-		printf("\r   - Exporting: %i / %i", i+1, wallCount);
-		WriteArtAsset("walls/", texture.name, pixels, texture.width, texture.height);
+		if (lastUses.at(texture.name) == i)
+			WriteArtAsset(assets, taskEvents, format, "walls/", texture.name, palette, indices, buffers.coverage.data(),
+				texture.width, texture.height, buffers.pixels);
+		serial.Completed("Exporting", wallCount);
 		
 		//printf("\n");
-		delete[] pixels;
-	}
-	printf("\n   - Done\n");
+	});
+	events.Report(EVENT_INFO, "   - Done");
 
 }
 
-void Wad::ExportTextures_Flats(Color* palette) {
+void Wad::ExportTextures_Flats(const Color* palette, AssetWriter& assets, const EventSink& events, int jobs, TextureFormat format) const {
 	const int32_t flatSize = 4096;
-	Color flat[flatSize];
 
-	int foundFlats = 0;
-	printf("Scanning for Flat textures\n");
+	// This will cause ANY 4096 byte lump to
+	// get interpreted as a texture, not just genuine flat textures
+	std::vector<int32_t> flats;
+	std::vector<WadString> names;
+	events.Report(EVENT_INFO, "Scanning for Flat textures");
 	for (int i = 0; i < lumps.Num(); i++) {
-		// This will cause ANY 4096 byte lump to
-		// get interpreted as a texture, not just genuine flat textures
-		if (lumps[i].size != flatSize)
-			continue;
-		reader.Goto(lumps[i].offset);
-
-		uint8_t colorIndex;
-		for (int c = 0; c < flatSize; c++) {
-			reader.ReadLE(colorIndex);
-			flat[c] = palette[colorIndex];
+		if (lumps[i].size == flatSize) {
+			flats.push_back(i);
+			names.push_back(lumps[i].name);
 		}
-
-		printf("\r   - Exporting %i Flats", ++foundFlats);
-		WriteArtAsset("flats/", lumps[i].name, flat, 64, 64);
 	}
-	printf("\n   - Done\n");
+	std::unordered_map<WadString, int32_t> lastUses = LastUses(names);
+	int32_t flatCount = static_cast<int32_t>(flats.size());
+
+	std::vector<ExportBuffers> threadBuffers(jobs < 1 ? 1 : jobs);
+	SerialEvents serial(events);
+	EventSink taskEvents = serial.Sink();
+	ParallelForChecked(flats.size(), jobs, [&](size_t task, int worker) {
+		const LumpEntry& lump = lumps[flats[task]];
+		BinaryReader reader = Cursor();
+		uint8_t indices[flatSize];
+		reader.Goto(lump.offset);
+		reader.ReadBytes(reinterpret_cast<char*>(indices), flatSize);
+
+		if (lastUses.at(lump.name) == static_cast<int32_t>(task))
+			WriteArtAsset(assets, taskEvents, format, "flats/", lump.name, palette, indices, nullptr, 64, 64, threadBuffers[worker].pixels);
+		serial.Completed("Exporting Flats", flatCount);
+	});
+	events.Report(EVENT_INFO, "   - Done");
 }
\ No newline at end of file
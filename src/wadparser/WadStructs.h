@@ -1,8 +1,12 @@
+#pragma once
 #include <cstdint>
 #include <BinaryReader.h>
 #include <vector>
 #include <array>
 #include <unordered_map>
+#include <memory>
+#include "AssetWriter.h"
+#include "Events.h"
 
 template<typename T, typename N>
 class WadArray {
@@ -11,6 +15,12 @@ class WadArray {
 	N num = 0;
 
 	public:
+	WadArray() {}
+
+	// Arrays own their items, and must not be copied
+	WadArray(const WadArray&) = delete;
+	WadArray& operator=(const WadArray&) = delete;
+
 	~WadArray() {
 		delete[] items;
 	}
@@ -31,7 +41,11 @@ class WadArray {
 		return items[index];
 	}
 
-	N Num() {
+	const T& operator[](const N index) const {
+		return items[index];
+	}
+
+	N Num() const {
 		return num;
 	}
 };
@@ -132,6 +146,17 @@ struct LumpEntry {
 	LumpType type = LumpType::UNIDENTIFIED;
 };
 
+// A vertex as stored in the WAD, before any transforms are applied
+struct Vertex {
+	int16_t x = 0;
+	int16_t y = 0;
+
+	// The position packed into a single value, for exact comparisons
+	uint32_t Key() const {
+		return static_cast<uint32_t>(static_cast<uint16_t>(x)) << 16 | static_cast<uint16_t>(y);
+	}
+};
+
 // Not part of original doom wad structures. But we need this for precision when converting
 // We will convert from 16-bit integer vertices read from WADs, to float32 vertices
 struct VertexFloat {
@@ -153,6 +178,18 @@ struct VertexFloat {
 	}
 };
 
+struct Thing {
+	int16_t x;
+	int16_t y;
+	int16_t angle; // Degrees, counter-clockwise from east
+	int16_t type;
+	int16_t flags;
+
+	static constexpr int32_t size() {
+		return 10;
+	}
+};
+
 enum LineFlags : uint16_t {
 	UPPER_UNPEGGED = 0x08,
 	LOWER_UNPEGGED = 0x10
@@ -195,10 +232,22 @@ struct SimpleLineDef {
 	VertexFloat v0;
 	VertexFloat v1;
 
+	// The untransformed positions of v0 and v1, used to join linedefs into loops
+	uint32_t key0 = 0;
+	uint32_t key1 = 0;
+
+	// The linedef this was created from, and whether the sector is on its back side
+	int32_t lineIndex = 0;
+	bool isBack = false;
+
 	void swapOrder() {
 		VertexFloat temp = v0;
 		v0 = v1;
 		v1 = temp;
+
+		uint32_t tempKey = key0;
+		key0 = key1;
+		key1 = tempKey;
 	}
 };
 
@@ -251,40 +300,100 @@ struct WadLevel {
 	LumpEntry* lumpSides;
 	LumpEntry* lumpVertex;
 	LumpEntry* lumpSectors;
+	LumpEntry* lumpReject = nullptr; // Not every level has one
 
-	//WadArray<Vertex> vertices;
-	WadArray<VertexFloat, int32_t> verts;
+	WadArray<Vertex, int32_t> vertices; // As stored in the WAD
+	WadArray<VertexFloat, int32_t> verts; // With the transforms applied
 	WadArray<LineDef, int32_t> linedefs;
 	WadArray<SideDef, int32_t> sidedefs;
 	WadArray<Sector, int32_t> sectors;
+	WadArray<Thing, int32_t> things;
+
+	// One bit for each pair of sectors, set if nothing in the second can be seen
+	// from the first. Empty if the level's REJECT lump is missing or too short
+	std::vector<uint8_t> reject;
 
 	float maxHeight;
 	float minHeight;
 
 	VertexTransforms transforms;
 	std::unordered_map<WadString, DimFloat> metersPerPixel;
-	std::unordered_map<WadString, Dimension>* wallDimensions = nullptr; // Need this for middle texture shenanigans
+	const std::unordered_map<WadString, Dimension>* wallDimensions = nullptr; // Need this for middle texture shenanigans
 
 	bool ReadFrom(BinaryReader &reader, VertexTransforms p_transforms,
-		std::unordered_map<WadString, Dimension>& p_wallDimensions);
+		const std::unordered_map<WadString, Dimension>& p_wallDimensions, const EventSink& events = EventSink());
 	void Debug();
+
+	bool Rejected(int32_t from, int32_t to) const {
+		if (reject.empty())
+			return false;
+		size_t bit = static_cast<size_t>(from) * sectors.Num() + to;
+		return (reject[bit >> 3] >> (bit & 7)) & 1;
+	}
 };
 
 
+// How exported images are encoded
+enum TextureFormat : int32_t {
+	TEXTURE_TGA,        // Uncompressed 32 bit
+	TEXTURE_TGA_RLE,    // Run-length compressed 32 bit
+	TEXTURE_TGA_MAPPED  // 8 bit indices into a palette of the image's own colors. Images with more than 256 colors are written uncompressed
+};
+
 struct Color;
 struct PatchImage;
+
+/*
+* A Wad is immutable once ReadFrom completes. Every other function reads through
+* its own cursor over the file buffer, and decoded levels are owned by the caller,
+* so any number of threads may decode and export from the same Wad at once.
+*/
 class Wad {
 	private:
-	BinaryReader reader;
+	BinaryReader file;
 	int32_t lumptableOffset = 0;
 	WadArray<LumpEntry, int32_t> lumps;
-	WadArray<WadLevel, int32_t> levels;
+	WadArray<WadLevel, int32_t> levels; // Lump references only - never decoded into
 	std::unordered_map<WadString, LumpEntry*> lumpMap;
 
+	// An independent reader over the file buffer
+	BinaryReader Cursor() const {
+		return BinaryReader(file);
+	}
+
+	// Indexes the lumps of the loaded file
+	bool ReadDirectory(const EventSink& events);
+
+	// The lump's bytes, or nullptr if they run past the end of the file
+	const uint8_t* LumpData(const LumpEntry& lump) const;
+
 	public:
-	bool ReadFrom(const char* wadpath);
-	WadLevel* DecodeLevel(const char* name, VertexTransforms transforms);
-	void WriteLumpNames();
+	bool ReadFrom(const char* wadpath, const EventSink& events = EventSink());
+
+	// Reads a WAD already in memory. The data is not copied, and must outlive the Wad
+	bool ReadFrom(const char* data, size_t length, const EventSink& events = EventSink());
+
+	// Returns nullptr if the level is missing, or references vertices, sidedefs or sectors it doesn't have
+	std::unique_ptr<WadLevel> DecodeLevel(const char* name, VertexTransforms transforms, const EventSink& events = EventSink()) const;
+	std::unique_ptr<WadLevel> DecodeLevel(int32_t index, VertexTransforms transforms, const EventSink& events = EventSink()) const;
+
+	int32_t LevelCount() const {
+		return levels.Num();
+	}
+
+	WadString LevelName(int32_t index) const {
+		return levels[index].lumpHeader->name;
+	}
+
+	// Size of the level's LINEDEFS lump - a cheap estimate of its conversion cost
+	int32_t LevelSize(int32_t index) const {
+		return levels[index].lumpLines->size;
+	}
+
+	// Indices of every level matching a comma-separated list of names.
+	// Names may use the * and ? wildcards, and are case-insensitive
+	std::vector<int32_t> FindLevels(const char* patterns) const;
+	void WriteLumpNames() const;
 
 	/* Texture Exporting */
 
@@ -293,9 +402,15 @@ class Wad {
 	void GetTextureDimensions(WadString name);
 
 	
-	void ExportTextures_Walls(PatchImage* patches, WadString name);
-	void ExportTextures_Flats(Color* palette);
+	void ExportTextures_Walls(const PatchImage* patches, int32_t patchCount, const Color* palette, WadString name, AssetWriter& assets,
+		const EventSink& events, int jobs, TextureFormat format) const;
+	void ExportTextures_Flats(const Color* palette, AssetWriter& assets, const EventSink& events, int jobs, TextureFormat format) const;
 
 	public:
-	void ExportTextures(bool exportWalls, bool exportFlats, bool exportPatches);
+	// Writes every texture as a .tga image and material2 decl. Paths given to the
+	// writer are relative to the game's base directory. Textures are decoded and
+	// written on the given number of threads, so with more than one, the writer
+	// must be thread-safe. The files written don't depend on the thread count.
+	void ExportTextures(bool exportWalls, bool exportFlats, bool exportPatches, AssetWriter& assets, const EventSink& events = EventSink(),
+		int jobs = 1, TextureFormat format = TEXTURE_TGA) const;
 };
\ No newline at end of file